@@ -57,6 +57,7 @@
 #include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
 #include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/pid_namespace.h>
@@ -133,6 +134,23 @@ module_param_named(debug_mask, binder_debug_mask, uint, 0644);
 char *binder_devices_param = CONFIG_ANDROID_BINDER_DEVICES;
 module_param_named(devices, binder_devices_param, charp, 0444);
 
+/*
+ * Stock binder asks userspace for one new looper at a time. While at least
+ * spawn_queue_depth transactions wait on proc->todo, or the oldest one has
+ * waited spawn_wait_us, up to spawn_burst requests may be outstanding so
+ * the pool grows ahead of a burst. spawn_burst of 1 keeps stock behaviour.
+ */
+static unsigned int binder_spawn_queue_depth = 4;
+module_param_named(spawn_queue_depth, binder_spawn_queue_depth, uint, 0644);
+static unsigned int binder_spawn_wait_us = 2000;
+module_param_named(spawn_wait_us, binder_spawn_wait_us, uint, 0644);
+static unsigned int binder_spawn_burst = 4;
+module_param_named(spawn_burst, binder_spawn_burst, uint, 0644);
+
+/* smallest TF_ZERO_COPY payload worth lending pages for instead of copying */
+static unsigned int binder_zero_copy_min = SZ_64K;
+module_param_named(zero_copy_min, binder_zero_copy_min, uint, 0644);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -982,6 +1000,7 @@ static struct binder_node *binder_init_node_ilocked(
 	node->accept_fds = !!(flags & FLAT_BINDER_FLAG_ACCEPTS_FDS);
 	node->inherit_rt = !!(flags & FLAT_BINDER_FLAG_INHERIT_RT);
 	node->txn_security_ctx = !!(flags & FLAT_BINDER_FLAG_TXN_SECURITY_CTX);
+	node->accept_zero_copy = !!(flags & FLAT_BINDER_FLAG_ACCEPTS_ZERO_COPY);
 	spin_lock_init(&node->lock);
 	INIT_LIST_HEAD(&node->work.entry);
 	INIT_LIST_HEAD(&node->async_todo);
@@ -2601,6 +2620,112 @@ static inline bool is_binder_proc_sf(struct binder_proc *proc)
  * Return:	true if the transactions was successfully queued
  *		false if the target process or thread is dead
  */
+/*
+ * TF_ZERO_COPY lends the sender's pages to the target instead of copying
+ * them. Only plain data to a node that opted in qualifies; replies never
+ * do. binder_alloc_new_buf_shared() further checks that the pages belong
+ * to a sealed memfd, so neither side can change them once lent.
+ */
+static bool binder_can_share_data(struct binder_transaction_data *tr,
+				  struct binder_node *target_node, u32 flags)
+{
+	return target_node && target_node->accept_zero_copy &&
+		(flags & TF_ZERO_COPY) && !(flags & TF_CLEAR_BUF) &&
+		!tr->offsets_size && PAGE_ALIGNED(tr->data.ptr.buffer) &&
+		tr->data_size >= max_t(unsigned int,
+				       READ_ONCE(binder_zero_copy_min),
+				       PAGE_SIZE);
+}
+
+static inline void binder_lat_start(struct binder_transaction *t)
+{
+	t->lat_ts = ktime_get();
+}
+
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+/*
+ * Count the time since @t->lat_ts in @proc's @type histogram and start
+ * the next interval from now.
+ */
+static void binder_lat_account(struct binder_proc *proc,
+			       enum binder_lat_type type,
+			       struct binder_transaction *t)
+{
+	ktime_t now = ktime_get();
+	s64 us = ktime_us_delta(now, t->lat_ts);
+	int bucket = 0;
+
+	if (us > 1)
+		bucket = min_t(int, ilog2(us), BINDER_LAT_BUCKETS - 1);
+	atomic_inc(&proc->lat.hist[type][t->lat_ux][bucket]);
+	t->lat_ts = now;
+}
+
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
+/* inheritance only changes anything when @from is UX itself */
+static inline void binder_lat_mark_ux(struct binder_transaction *t,
+				      struct task_struct *from)
+{
+	if (test_task_ux(from))
+		t->lat_ux = true;
+}
+#endif
+#else
+static inline void binder_lat_account(struct binder_proc *proc,
+				      enum binder_lat_type type,
+				      struct binder_transaction *t) {}
+static inline void binder_lat_mark_ux(struct binder_transaction *t,
+				      struct task_struct *from) {}
+#endif
+
+/* work went on @proc->todo and no thread of the pool was idle to take it */
+static void binder_proc_sat_start_ilocked(struct binder_proc *proc)
+{
+	if (proc->sat_start)
+		return;
+	proc->sat_start = ktime_get();
+	proc->sat_count++;
+}
+
+/* a pool thread found nothing left to do */
+static void binder_proc_sat_end_ilocked(struct binder_proc *proc)
+{
+	if (!proc->sat_start)
+		return;
+	proc->sat_ns += ktime_to_ns(ktime_sub(ktime_get(), proc->sat_start));
+	proc->sat_start = 0;
+}
+
+/*
+ * True when the pool is falling behind: binder_spawn_queue_depth
+ * transactions are waiting on @proc->todo, or the oldest of them has
+ * waited binder_spawn_wait_us. Walks at most binder_spawn_queue_depth
+ * entries.
+ */
+static bool binder_proc_backlogged_ilocked(struct binder_proc *proc)
+{
+	unsigned int depth = READ_ONCE(binder_spawn_queue_depth);
+	unsigned int wait_us = READ_ONCE(binder_spawn_wait_us);
+	struct binder_transaction *t;
+	struct binder_work *w;
+	unsigned int n = 0;
+
+	list_for_each_entry(w, &proc->todo, entry) {
+		if (w->type != BINDER_WORK_TRANSACTION)
+			continue;
+		if (!n++ && wait_us) {
+			t = container_of(w, struct binder_transaction, work);
+			if (ktime_us_delta(ktime_get(), t->lat_ts) >= wait_us)
+				return true;
+		}
+		if (!depth)
+			break;
+		if (n >= depth)
+			return true;
+	}
+	return false;
+}
+
 static bool binder_proc_transaction(struct binder_transaction *t,
 				    struct binder_proc *proc,
 				    struct binder_thread *thread)
@@ -2664,8 +2789,10 @@ static bool binder_proc_transaction(struct binder_transaction *t,
 		binder_enqueue_thread_work_ilocked(thread, &t->work);
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 		if (sysctl_sched_assist_enabled) {
-			if (!oneway || proc->proc_type)
+			if (!oneway || proc->proc_type) {
 				binder_set_inherit_ux(thread->task, current);
+				binder_lat_mark_ux(t, current);
+			}
 		}
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 	} else if (!pending_async) {
@@ -2676,10 +2803,12 @@ static bool binder_proc_transaction(struct binder_transaction *t,
 		}
 #endif
 		binder_enqueue_work_ilocked(&t->work, &proc->todo);
+		binder_proc_sat_start_ilocked(proc);
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 		if (sysctl_sched_assist_enabled) {
 			if ((!oneway || proc->proc_type) && proc->max_threads == 0) {
 				binder_set_inherit_ux(proc->tsk, current);
+				binder_lat_mark_ux(t, current);
 			}
 		}
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
@@ -2775,6 +2904,7 @@ static void binder_transaction(struct binder_proc *proc,
 	int t_debug_id = atomic_inc_return(&binder_last_id);
 	char *secctx = NULL;
 	u32 secctx_sz = 0;
+	size_t shared = 0;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->debug_id = t_debug_id;
@@ -3054,9 +3184,16 @@ static void binder_transaction(struct binder_proc *proc,
 
 	trace_binder_transaction(reply, t, target_node);
 
-	t->buffer = binder_alloc_new_buf(&target_proc->alloc, tr->data_size,
-		tr->offsets_size, extra_buffers_size,
-		!reply && (t->flags & TF_ONE_WAY), current->tgid);
+	if (binder_can_share_data(tr, target_node, t->flags))
+		t->buffer = binder_alloc_new_buf_shared(&target_proc->alloc,
+			tr->data_size, tr->offsets_size, extra_buffers_size,
+			!reply && (t->flags & TF_ONE_WAY), current->tgid,
+			(const void __user *)(uintptr_t)tr->data.ptr.buffer,
+			&shared);
+	else
+		t->buffer = binder_alloc_new_buf(&target_proc->alloc,
+			tr->data_size, tr->offsets_size, extra_buffers_size,
+			!reply && (t->flags & TF_ONE_WAY), current->tgid);
 	if (IS_ERR(t->buffer)) {
 		/*
 		 * -ESRCH indicates VMA cleared. The target is dying.
@@ -3092,12 +3229,13 @@ static void binder_transaction(struct binder_proc *proc,
 	t->buffer->clear_on_free = !!(t->flags & TF_CLEAR_BUF);
 	trace_binder_transaction_alloc_buf(t->buffer);
 
+	/* the first shared bytes are the sender's own pages already */
 	if (binder_alloc_copy_user_to_buffer(
 				&target_proc->alloc,
-				t->buffer, 0,
+				t->buffer, shared,
 				(const void __user *)
-					(uintptr_t)tr->data.ptr.buffer,
-				tr->data_size)) {
+					(uintptr_t)tr->data.ptr.buffer + shared,
+				tr->data_size - shared)) {
 		binder_user_error("%d:%d got transaction with invalid data ptr\n",
 				proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
@@ -3351,8 +3489,13 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	t->work.type = BINDER_WORK_TRANSACTION;
+	binder_lat_start(t);
 
 	if (reply) {
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+		t->lat_ux = in_reply_to->lat_ux;
+#endif
+		binder_lat_account(proc, BINDER_LAT_HANDLE, in_reply_to);
 		binder_enqueue_thread_work(thread, tcomplete);
 		binder_inner_proc_lock(target_proc);
 		if (target_thread->is_dead) {
@@ -4030,6 +4173,8 @@ static int binder_wait_for_work(struct binder_thread *thread,
 		if (binder_has_work_ilocked(thread, do_proc_work))
 			break;
 
+		if (do_proc_work)
+			binder_proc_sat_end_ilocked(proc);
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 		if (do_proc_work) {
 			list_add(&thread->waiting_thread_node,
@@ -4428,12 +4573,15 @@ static int binder_thread_read(struct binder_proc *proc,
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 			if (sysctl_sched_assist_enabled) {
 				binder_set_inherit_ux(thread->task, t_from->task);
+				binder_lat_mark_ux(t, t_from->task);
 			}
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 
 		} else {
 			trd->sender_pid = 0;
 		}
+		binder_lat_account(proc, cmd == BR_REPLY ? BINDER_LAT_REPLY :
+				   BINDER_LAT_QUEUE, t);
 
 		ret = binder_apply_fd_fixups(proc, t);
 		if (ret) {
@@ -4534,12 +4682,17 @@ static int binder_thread_read(struct binder_proc *proc,
 
 	*consumed = ptr - buffer;
 	binder_inner_proc_lock(proc);
-	if (proc->requested_threads == 0 &&
+	if ((proc->requested_threads == 0 ||
+	     (proc->requested_threads < READ_ONCE(binder_spawn_burst) &&
+	      binder_proc_backlogged_ilocked(proc))) &&
 	    list_empty(&thread->proc->waiting_threads) &&
-	    proc->requested_threads_started < proc->max_threads &&
+	    proc->requested_threads + proc->requested_threads_started <
+	    proc->max_threads &&
 	    (thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 	     BINDER_LOOPER_STATE_ENTERED)) /* the user-space code fails to */
 	     /*spawn a new thread if we leave this out */) {
+		if (proc->requested_threads)
+			proc->spawn_ahead++;
 		proc->requested_threads++;
 		binder_inner_proc_unlock(proc);
 		binder_debug(BINDER_DEBUG_THREADS,
@@ -5881,6 +6034,7 @@ static void print_binder_proc_stats(struct seq_file *m,
 	struct binder_thread *thread;
 	struct rb_node *n;
 	int count, strong, weak, ready_threads;
+	u64 sat_ns;
 	size_t free_async_space =
 		binder_alloc_get_free_async_space(&proc->alloc);
 
@@ -5902,6 +6056,12 @@ static void print_binder_proc_stats(struct seq_file *m,
 			proc->requested_threads_started, proc->max_threads,
 			ready_threads,
 			free_async_space);
+	sat_ns = proc->sat_ns;
+	if (proc->sat_start)
+		sat_ns += ktime_to_ns(ktime_sub(ktime_get(), proc->sat_start));
+	seq_printf(m, "  saturated %llu ms in %u episodes%s, early spawns %u\n",
+		   div_u64(sat_ns, NSEC_PER_MSEC), proc->sat_count,
+		   proc->sat_start ? " (now)" : "", proc->spawn_ahead);
 	count = 0;
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n))
 		count++;
@@ -6007,6 +6167,66 @@ int binder_transactions_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+static const char * const binder_lat_strings[] = {
+	"queue",
+	"handle",
+	"reply",
+};
+
+static void print_binder_proc_latency(struct seq_file *m,
+				      struct binder_proc *proc)
+{
+	struct binder_lat_stats *lat = &proc->lat;
+	bool header = false;
+	int type, ux, i;
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_lat_strings) != BINDER_LAT_NR);
+	for (type = 0; type < BINDER_LAT_NR; type++) {
+		for (ux = 0; ux < 2; ux++) {
+			unsigned int count[BINDER_LAT_BUCKETS];
+			unsigned int total = 0;
+
+			for (i = 0; i < BINDER_LAT_BUCKETS; i++) {
+				count[i] = atomic_read(&lat->hist[type][ux][i]);
+				total += count[i];
+			}
+			if (!total)
+				continue;
+
+			if (!header) {
+				seq_printf(m, "proc %d\n", proc->pid);
+				header = true;
+			}
+			seq_printf(m, "  %-6s %-2s:", binder_lat_strings[type],
+				   ux ? "ux" : "");
+			for (i = 0; i < BINDER_LAT_BUCKETS; i++)
+				seq_printf(m, " %u", count[i]);
+			seq_puts(m, "\n");
+		}
+	}
+}
+
+int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	int i;
+
+	seq_puts(m, "binder latency:\n");
+	seq_puts(m, "  us       :");
+	for (i = 0; i < BINDER_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " <%u", 2U << i);
+	seq_printf(m, " >=%u\n", 1U << i);
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, &binder_procs, proc_node)
+		print_binder_proc_latency(m, proc);
+	mutex_unlock(&binder_procs_lock);
+
+	return 0;
+}
+#endif
+
 static int proc_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *itr;
@@ -6157,6 +6377,13 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+		debugfs_create_file("latency",
+				    0444,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
+#endif
 	}
 
 	if (!IS_ENABLED(CONFIG_ANDROID_BINDERFS) &&
@@ -23,6 +23,8 @@
 #include <linux/uaccess.h>
 #include <linux/highmem.h>
 #include <linux/sizes.h>
+#include <linux/shmem_fs.h>
+#include <linux/fcntl.h>
 #include "binder_alloc.h"
 #include "binder_trace.h"
 #if defined(OPLUS_FEATURE_HANS_FREEZE) && defined(CONFIG_OPLUS_FEATURE_HANS)
@@ -45,6 +47,11 @@ static uint32_t binder_alloc_debug_mask = BINDER_DEBUG_USER_ERROR;
 module_param_named(debug_mask, binder_alloc_debug_mask,
 		   uint, 0644);
 
+static bool binder_alloc_cache_enabled = true;
+
+module_param_named(buffer_cache, binder_alloc_cache_enabled,
+		   bool, 0644);
+
 #define binder_alloc_debug(mask, x...) \
 	do { \
 		if (binder_alloc_debug_mask & mask) \
@@ -182,6 +189,50 @@ struct binder_buffer *binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 	return buffer;
 }
 
+static inline struct vm_area_struct *binder_alloc_get_vma(
+		struct binder_alloc *alloc);
+
+/*
+ * Give back the pages a TF_ZERO_COPY sender lent to this range before it
+ * goes on the lru: unmap them from the target and drop the reference taken
+ * when they were shared in. Once the vma is gone only the reference is left.
+ */
+static void binder_alloc_unshare_range(struct binder_alloc *alloc,
+				       void __user *start, void __user *end)
+{
+	struct vm_area_struct *vma = NULL;
+	struct binder_lru_page *page;
+	struct mm_struct *mm = NULL;
+	void __user *page_addr;
+	bool need_mm = true;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &alloc->pages[(page_addr - alloc->buffer) / PAGE_SIZE];
+		if (!page->borrowed)
+			continue;
+
+		if (need_mm) {
+			need_mm = false;
+			if (mmget_not_zero(alloc->vma_vm_mm)) {
+				mm = alloc->vma_vm_mm;
+				down_read(&mm->mmap_sem);
+				vma = binder_alloc_get_vma(alloc);
+			}
+		}
+		if (vma)
+			zap_page_range(vma, (uintptr_t)page_addr, PAGE_SIZE);
+
+		put_page(page->page_ptr);
+		page->page_ptr = NULL;
+		page->borrowed = false;
+	}
+
+	if (mm) {
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+}
+
 static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 				    void __user *start, void __user *end)
 {
@@ -281,6 +332,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 	return 0;
 
 free_range:
+	binder_alloc_unshare_range(alloc, start, end);
 	for (page_addr = end - PAGE_SIZE; 1; page_addr -= PAGE_SIZE) {
 		bool ret;
 		size_t index;
@@ -290,8 +342,11 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 
 		trace_binder_free_lru_start(alloc, index);
 
-		ret = list_lru_add(&binder_alloc_lru, &page->lru);
-		WARN_ON(!ret);
+		/* lent pages were already given back above */
+		if (page->page_ptr) {
+			ret = list_lru_add(&binder_alloc_lru, &page->lru);
+			WARN_ON(!ret);
+		}
 
 		trace_binder_free_lru_end(alloc, index);
 		if (page_addr == start)
@@ -380,20 +435,280 @@ static void debug_low_async_space_locked(struct binder_alloc *alloc, int pid)
 	}
 }
 
+static void binder_return_buf_locked(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer);
+
+/*
+ * Small transactions come and go in the same few sizes. Rather than merge
+ * a freed buffer back into free_buffers and split it off again for the
+ * next transaction, keep a handful of them aside exactly as they are:
+ * pages still mapped and off the lru, out of both rb trees, with free = 0
+ * so neighbours never merge into them. Their size cannot change while
+ * cached since only a free buffer's successor is ever deleted.
+ */
+static struct binder_buffer *binder_alloc_cache_get(struct binder_alloc *alloc,
+						    size_t size)
+{
+	struct binder_buffer *buffer;
+	size_t buffer_size, best_size = SIZE_MAX;
+	int i, best = -1;
+
+	if (size > BINDER_ALLOC_CACHE_MAX_SIZE)
+		return NULL;
+
+	for (i = 0; i < alloc->cache_nr; i++) {
+		buffer_size = binder_alloc_buffer_size(alloc, alloc->cache[i]);
+		if (buffer_size >= size && buffer_size < best_size) {
+			best = i;
+			best_size = buffer_size;
+		}
+	}
+
+	if (best < 0) {
+		alloc->cache_misses++;
+		return NULL;
+	}
+
+	buffer = alloc->cache[best];
+	alloc->cache[best] = alloc->cache[--alloc->cache_nr];
+	alloc->cache_hits++;
+	return buffer;
+}
+
+static bool binder_alloc_cache_put(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer,
+				   size_t buffer_size)
+{
+	if (!READ_ONCE(binder_alloc_cache_enabled) ||
+	    buffer_size > BINDER_ALLOC_CACHE_MAX_SIZE ||
+	    alloc->cache_nr == BINDER_ALLOC_CACHE_SIZE)
+		return false;
+
+	alloc->cache[alloc->cache_nr++] = buffer;
+	return true;
+}
+
+static void binder_alloc_cache_flush_locked(struct binder_alloc *alloc)
+{
+	while (alloc->cache_nr)
+		binder_return_buf_locked(alloc, alloc->cache[--alloc->cache_nr]);
+}
+
+/**
+ * binder_alloc_cache_drain() - give cached buffers back to the free tree
+ * @alloc:	binder_alloc for this proc
+ *
+ * Only needed by callers that inspect the page lru state directly.
+ */
+void binder_alloc_cache_drain(struct binder_alloc *alloc)
+{
+	mutex_lock(&alloc->mutex);
+	binder_alloc_cache_flush_locked(alloc);
+	mutex_unlock(&alloc->mutex);
+}
+
+/*
+ * Smallest free buffer that holds at least @size bytes, or NULL.
+ */
+static struct binder_buffer *
+binder_alloc_best_fit_locked(struct binder_alloc *alloc, size_t size)
+{
+	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct binder_buffer *buffer, *best = NULL;
+	size_t buffer_size;
+
+	while (n) {
+		buffer = rb_entry(n, struct binder_buffer, rb_node);
+		BUG_ON(!buffer->free);
+		buffer_size = binder_alloc_buffer_size(alloc, buffer);
+
+		if (size < buffer_size) {
+			best = buffer;
+			n = n->rb_left;
+		} else if (size > buffer_size) {
+			n = n->rb_right;
+		} else {
+			return buffer;
+		}
+	}
+	return best;
+}
+
+static bool binder_alloc_fits_aligned(struct binder_alloc *alloc,
+				      struct binder_buffer *buffer,
+				      size_t size)
+{
+	uintptr_t start = (uintptr_t)buffer->user_data;
+
+	return PAGE_ALIGN(start) + size <=
+		start + binder_alloc_buffer_size(alloc, buffer);
+}
+
+/*
+ * Free buffer that can hold @size bytes from a page boundary on. The best
+ * fit is tried first; if its head is in the way, the best fit for @size
+ * plus the worst-case head is taken instead. An unaligned head is split
+ * off and stays free. Both are rbtree lookups in @alloc->free_buffers.
+ */
+static struct binder_buffer *
+binder_alloc_find_aligned_locked(struct binder_alloc *alloc, size_t size)
+{
+	struct binder_buffer *buffer, *new_buffer;
+	uintptr_t start, aligned;
+
+	buffer = binder_alloc_best_fit_locked(alloc, size);
+	if (buffer && !binder_alloc_fits_aligned(alloc, buffer, size)) {
+		if (size + PAGE_SIZE - 1 < size)
+			return NULL;
+		buffer = binder_alloc_best_fit_locked(alloc,
+						      size + PAGE_SIZE - 1);
+	}
+	if (!buffer)
+		return NULL;
+
+	start = (uintptr_t)buffer->user_data;
+	aligned = PAGE_ALIGN(start);
+	if (aligned == start)
+		return buffer;
+
+	new_buffer = kzalloc(sizeof(*new_buffer), GFP_KERNEL);
+	if (!new_buffer)
+		return NULL;
+	rb_erase(&buffer->rb_node, &alloc->free_buffers);
+	new_buffer->user_data = (void __user *)aligned;
+	new_buffer->free = 1;
+	list_add(&new_buffer->entry, &buffer->entry);
+	binder_insert_free_buffer(alloc, buffer);
+	binder_insert_free_buffer(alloc, new_buffer);
+	return new_buffer;
+}
+
+/*
+ * A sender page may only be lent to the target when its contents can no
+ * longer change under the target and the page cannot go away: a memfd
+ * sealed against shrinking and against writes. F_SEAL_FUTURE_WRITE still
+ * lets mappings made before the seal write, so it only counts once none
+ * of those are left.
+ */
+static bool binder_alloc_page_sealed(struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	unsigned int seals;
+
+	if (PageAnon(page) || !mapping || !shmem_mapping(mapping))
+		return false;
+
+	seals = READ_ONCE(SHMEM_I(mapping->host)->seals);
+	if (!(seals & F_SEAL_SHRINK))
+		return false;
+	if (seals & F_SEAL_WRITE)
+		return true;
+	return (seals & F_SEAL_FUTURE_WRITE) &&
+		!mapping_writably_mapped(mapping);
+}
+
+/*
+ * Map the sender's pages behind @from straight into the first @bytes of
+ * a page-aligned @buffer, in place of pages of our own. Only pages of a
+ * sealed memfd qualify, see binder_alloc_page_sealed(). On failure
+ * nothing is left mapped in the range.
+ */
+static int binder_alloc_share_pages_locked(struct binder_alloc *alloc,
+					   struct binder_buffer *buffer,
+					   const void __user *from,
+					   size_t bytes)
+{
+	size_t index = (buffer->user_data - alloc->buffer) / PAGE_SIZE;
+	uintptr_t addr = (uintptr_t)buffer->user_data;
+	int nr = bytes >> PAGE_SHIFT;
+	struct binder_lru_page *lru_page;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	struct page **pages;
+	int i, pinned, ret = -EFAULT;
+
+	pages = kvmalloc_array(nr, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	pinned = get_user_pages_fast((uintptr_t)from, nr, 0, pages);
+	if (pinned != nr)
+		goto out_put;
+
+	for (i = 0; i < nr; i++)
+		if (!binder_alloc_page_sealed(pages[i]))
+			goto out_put;
+
+	ret = -ESRCH;
+	mm = alloc->vma_vm_mm;
+	if (!mmget_not_zero(mm))
+		goto out_put;
+	down_read(&mm->mmap_sem);
+	vma = binder_alloc_get_vma(alloc);
+	if (!vma)
+		goto out_unlock;
+
+	for (i = 0; i < nr; i++) {
+		lru_page = &alloc->pages[index + i];
+
+		/* still mapped from an earlier buffer, give that page up */
+		if (lru_page->page_ptr) {
+			list_lru_del(&binder_alloc_lru, &lru_page->lru);
+			zap_page_range(vma, addr + i * PAGE_SIZE, PAGE_SIZE);
+			__free_page(lru_page->page_ptr);
+			lru_page->page_ptr = NULL;
+		}
+
+		ret = vm_insert_page(vma, addr + i * PAGE_SIZE, pages[i]);
+		if (ret)
+			goto out_undo;
+
+		lru_page->page_ptr = pages[i];
+		lru_page->alloc = alloc;
+		lru_page->borrowed = true;
+		INIT_LIST_HEAD(&lru_page->lru);
+		if (index + i + 1 > alloc->pages_high)
+			alloc->pages_high = index + i + 1;
+	}
+
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+	kvfree(pages);
+	return 0;
+
+out_undo:
+	zap_page_range(vma, addr, i * PAGE_SIZE);
+	while (i--) {
+		lru_page = &alloc->pages[index + i];
+		lru_page->page_ptr = NULL;
+		lru_page->borrowed = false;
+	}
+out_unlock:
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+out_put:
+	for (i = 0; i < pinned; i++)
+		put_page(pages[i]);
+	kvfree(pages);
+	return ret;
+}
+
 static struct binder_buffer *binder_alloc_new_buf_locked(
 				struct binder_alloc *alloc,
 				size_t data_size,
 				size_t offsets_size,
 				size_t extra_buffers_size,
 				int is_async,
-				int pid)
+				int pid,
+				size_t *share)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
 	struct rb_node *best_fit = NULL;
 	void __user *has_page_addr;
 	void __user *end_page_addr;
+	void __user *map_start;
 	size_t size, data_offsets_size;
 	int ret;
 
@@ -437,6 +752,23 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
+	buffer = binder_alloc_cache_get(alloc, size);
+	if (buffer)
+		goto cache_hit;
+
+	if (share && *share) {
+		buffer = binder_alloc_find_aligned_locked(alloc, size);
+		if (buffer) {
+			best_fit = &buffer->rb_node;
+			n = NULL;
+			goto found;
+		}
+		/* no aligned room, the caller copies everything */
+		*share = 0;
+	}
+
+search:
+	n = alloc->free_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -452,6 +784,11 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			break;
 		}
 	}
+	if (best_fit == NULL && alloc->cache_nr) {
+		/* the cache may be holding the space we need */
+		binder_alloc_cache_flush_locked(alloc);
+		goto search;
+	}
 	if (best_fit == NULL) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
@@ -488,6 +825,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				   free_buffers, largest_free_size);
 		return ERR_PTR(-ENOSPC);
 	}
+found:
 	if (n == NULL) {
 		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
 		buffer_size = binder_alloc_buffer_size(alloc, buffer);
@@ -504,8 +842,11 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		(void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data + size);
 	if (end_page_addr > has_page_addr)
 		end_page_addr = has_page_addr;
-	ret = binder_update_page_range(alloc, 1, (void __user *)
-		PAGE_ALIGN((uintptr_t)buffer->user_data), end_page_addr);
+	/* pages a zero-copy sender is about to lend are not ours to map */
+	map_start = (void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data);
+	if (share)
+		map_start += *share;
+	ret = binder_update_page_range(alloc, 1, map_start, end_page_addr);
 	if (ret)
 		return ERR_PTR(ret);
 
@@ -525,6 +866,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	}
 
 	rb_erase(best_fit, &alloc->free_buffers);
+cache_hit:
 	buffer->free = 0;
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
@@ -553,9 +895,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	return buffer;
 
 err_alloc_buf_struct_failed:
-	binder_update_page_range(alloc, 0, (void __user *)
-				 PAGE_ALIGN((uintptr_t)buffer->user_data),
-				 end_page_addr);
+	binder_update_page_range(alloc, 0, map_start, end_page_addr);
 	return ERR_PTR(-ENOMEM);
 }
 
@@ -586,8 +926,63 @@ struct binder_buffer *binder_alloc_new_buf(struct binder_alloc *alloc,
 
 	mutex_lock(&alloc->mutex);
 	buffer = binder_alloc_new_buf_locked(alloc, data_size, offsets_size,
-					     extra_buffers_size, is_async, pid);
+					     extra_buffers_size, is_async, pid,
+					     NULL);
+	mutex_unlock(&alloc->mutex);
+	return buffer;
+}
+
+static void binder_free_buf_locked(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer);
+
+/**
+ * binder_alloc_new_buf_shared() - Allocate a buffer backed by sender pages
+ * @alloc:              binder_alloc for this proc
+ * @data_size:          size of user data buffer
+ * @offsets_size:       user specified buffer offset
+ * @extra_buffers_size: size of extra space for meta-data (eg, security context)
+ * @is_async:           buffer for async transaction
+ * @pid:                pid to attribute allocation to (used for debugging)
+ * @from:               page-aligned user address of the sender's data
+ * @shared:             set to the number of leading data bytes now backed
+ *                      by the sender's own pages
+ *
+ * Like binder_alloc_new_buf(), but the whole pages of the data area are
+ * the pages behind @from rather than copies of them, when they can be
+ * shared. Whatever could not be shared must still be copied by the caller
+ * from offset *@shared on.
+ *
+ * Return:	The allocated buffer or %ERR_PTR if error
+ */
+struct binder_buffer *binder_alloc_new_buf_shared(struct binder_alloc *alloc,
+						  size_t data_size,
+						  size_t offsets_size,
+						  size_t extra_buffers_size,
+						  int is_async,
+						  int pid,
+						  const void __user *from,
+						  size_t *shared)
+{
+	struct binder_buffer *buffer;
+	size_t share = data_size & PAGE_MASK;
+
+	mutex_lock(&alloc->mutex);
+	buffer = binder_alloc_new_buf_locked(alloc, data_size, offsets_size,
+					     extra_buffers_size, is_async, pid,
+					     &share);
+	if (!IS_ERR(buffer) && share &&
+	    binder_alloc_share_pages_locked(alloc, buffer, from, share)) {
+		/* fall back to pages of our own and a plain copy */
+		if (binder_update_page_range(alloc, 1, buffer->user_data,
+					     buffer->user_data + share)) {
+			binder_free_buf_locked(alloc, buffer);
+			buffer = ERR_PTR(-ENOMEM);
+		}
+		share = 0;
+	}
 	mutex_unlock(&alloc->mutex);
+
+	*shared = IS_ERR(buffer) ? 0 : share;
 	return buffer;
 }
 
@@ -679,12 +1074,24 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 			      alloc->pid, size, alloc->free_async_space);
 	}
 
+	rb_erase(&buffer->rb_node, &alloc->allocated_buffers);
+	if (binder_alloc_cache_put(alloc, buffer, buffer_size))
+		return;
+
+	binder_return_buf_locked(alloc, buffer);
+}
+
+/* hand a buffer that is in neither rb tree back to free_buffers */
+static void binder_return_buf_locked(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_alloc_buffer_size(alloc, buffer);
+
 	binder_update_page_range(alloc, 0,
 		(void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data),
 		(void __user *)(((uintptr_t)
 			  buffer->user_data + buffer_size) & PAGE_MASK));
 
-	rb_erase(&buffer->rb_node, &alloc->allocated_buffers);
 	buffer->free = 1;
 	if (!list_is_last(&buffer->entry, &alloc->buffers)) {
 		struct binder_buffer *next = binder_buffer_next(buffer);
@@ -833,6 +1240,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 		binder_free_buf_locked(alloc, buffer);
 		buffers++;
 	}
+	binder_alloc_cache_flush_locked(alloc);
 
 	while (!list_empty(&alloc->buffers)) {
 		buffer = list_first_entry(&alloc->buffers,
@@ -939,6 +1347,8 @@ void binder_alloc_print_pages(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
+	seq_printf(m, "  buffer cache: %d hits: %lu misses: %lu\n",
+		   alloc->cache_nr, alloc->cache_hits, alloc->cache_misses);
 }
 
 /**
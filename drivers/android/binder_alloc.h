@@ -18,6 +18,10 @@
 extern struct list_lru binder_alloc_lru;
 struct binder_transaction;
 
+/* freed buffers kept per proc, and the largest size worth keeping */
+#define BINDER_ALLOC_CACHE_SIZE		4
+#define BINDER_ALLOC_CACHE_MAX_SIZE	PAGE_SIZE
+
 /**
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
@@ -62,11 +66,15 @@ struct binder_buffer {
  * @page_ptr: pointer to physical page in mmap'd space
  * @lru:      entry in binder_alloc_lru
  * @alloc:    binder_alloc for a proc
+ * @borrowed: @page_ptr is a sender's page shared in by a TF_ZERO_COPY
+ *            transaction; it is never on binder_alloc_lru and is
+ *            unmapped and released as soon as its buffer is freed
  */
 struct binder_lru_page {
 	struct list_head lru;
 	struct page *page_ptr;
 	struct binder_alloc *alloc;
+	bool borrowed;
 };
 
 /**
@@ -87,6 +95,11 @@ struct binder_lru_page {
  * @buffer_size:        size of address space specified via mmap
  * @pid:                pid for associated binder_proc (invariant after init)
  * @pages_high:         high watermark of offset in @pages
+ * @cache:              recently freed small buffers, kept mapped and out of
+ *                      both rb trees so they can be handed out again as-is
+ * @cache_nr:           number of valid entries in @cache
+ * @cache_hits:         allocations served from @cache
+ * @cache_misses:       small allocations that had to search @free_buffers
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -107,6 +120,10 @@ struct binder_alloc {
 	uint32_t buffer_free;
 	int pid;
 	size_t pages_high;
+	struct binder_buffer *cache[BINDER_ALLOC_CACHE_SIZE];
+	int cache_nr;
+	unsigned long cache_hits;
+	unsigned long cache_misses;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -123,6 +140,15 @@ extern struct binder_buffer *binder_alloc_new_buf(struct binder_alloc *alloc,
 						  size_t extra_buffers_size,
 						  int is_async,
 						  int pid);
+extern struct binder_buffer *
+binder_alloc_new_buf_shared(struct binder_alloc *alloc,
+			    size_t data_size,
+			    size_t offsets_size,
+			    size_t extra_buffers_size,
+			    int is_async,
+			    int pid,
+			    const void __user *from,
+			    size_t *shared);
 extern void binder_alloc_init(struct binder_alloc *alloc);
 extern int binder_alloc_shrinker_init(void);
 extern void binder_alloc_vma_close(struct binder_alloc *alloc);
@@ -134,6 +160,7 @@ extern void binder_alloc_free_buf(struct binder_alloc *alloc,
 extern int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 				     struct vm_area_struct *vma);
 extern void binder_alloc_deferred_release(struct binder_alloc *alloc);
+extern void binder_alloc_cache_drain(struct binder_alloc *alloc);
 extern int binder_alloc_get_allocated_count(struct binder_alloc *alloc);
 extern void binder_alloc_print_allocated(struct seq_file *m,
 					 struct binder_alloc *alloc);
@@ -137,6 +137,7 @@ static void binder_selftest_free_buf(struct binder_alloc *alloc,
 
 	for (i = 0; i < BUFFER_NUM; i++)
 		binder_alloc_free_buf(alloc, buffers[seq[i]]);
+	binder_alloc_cache_drain(alloc);
 
 	for (i = 0; i < end / PAGE_SIZE; i++) {
 		/**
@@ -5,6 +5,7 @@
 
 #include <linux/export.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mutex.h>
@@ -123,6 +124,29 @@ DEFINE_SHOW_ATTRIBUTE(binder_transactions);
 int binder_transaction_log_show(struct seq_file *m, void *unused);
 DEFINE_SHOW_ATTRIBUTE(binder_transaction_log);
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+int binder_latency_show(struct seq_file *m, void *unused);
+DEFINE_SHOW_ATTRIBUTE(binder_latency);
+#endif
+
+/*
+ * Latency histograms use log2 buckets of microseconds: the first bucket
+ * counts everything under 2us, the last everything from 32ms up.
+ */
+#define BINDER_LAT_BUCKETS	16
+
+enum binder_lat_type {
+	BINDER_LAT_QUEUE,	/* queued until a binder thread picks it up */
+	BINDER_LAT_HANDLE,	/* picked up until BC_REPLY */
+	BINDER_LAT_REPLY,	/* BC_REPLY until the caller picks it up */
+	BINDER_LAT_NR,
+};
+
+/* second index is 1 when the caller's UX state was inherited */
+struct binder_lat_stats {
+	atomic_t hist[BINDER_LAT_NR][2][BINDER_LAT_BUCKETS];
+};
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int debug_id_done;
@@ -249,6 +273,8 @@ struct binder_error {
  * @inherit_rt:           inherit RT scheduling policy from caller
  * @txn_security_ctx:     require sender's security context
  *                        (invariant after initialized)
+ * @accept_zero_copy:     accept sender pages for TF_ZERO_COPY data
+ *                        (invariant after initialized)
  * @async_todo:           list of async work items
  *                        (protected by @proc->inner_lock)
  *
@@ -288,6 +314,7 @@ struct binder_node {
 		u8 inherit_rt:1;
 		u8 accept_fds:1;
 		u8 txn_security_ctx:1;
+		u8 accept_zero_copy:1;
 		u8 min_priority;
 	};
 	bool has_async_transaction;
@@ -427,6 +454,18 @@ struct binder_priority {
  * @outer_lock:           no nesting under innor or node lock
  *                        Lock order: 1) outer, 2) node, 3) inner
  * @binderfs_entry:       process-specific binderfs log file
+ * @lat:                  transaction latency histograms
+ *                        (atomics, no lock needed)
+ * @sat_start:            when the pool last ran out of idle threads with
+ *                        work queued, 0 while it has idle threads
+ *                        (protected by @inner_lock)
+ * @sat_ns:               total time spent without an idle thread
+ *                        (protected by @inner_lock)
+ * @sat_count:            number of such episodes
+ *                        (protected by @inner_lock)
+ * @spawn_ahead:          BR_SPAWN_LOOPER requests sent while another one
+ *                        was still outstanding, because @todo backed up
+ *                        (protected by @inner_lock)
  *
  * Bookkeeping structure for binder processes
  */
@@ -461,6 +500,13 @@ struct binder_proc {
 	spinlock_t inner_lock;
 	spinlock_t outer_lock;
 	struct dentry *binderfs_entry;
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	struct binder_lat_stats lat;
+#endif
+	ktime_t sat_start;
+	u64 sat_ns;
+	unsigned int sat_count;
+	unsigned int spawn_ahead;
 };
 
 /**
@@ -563,6 +609,11 @@ struct binder_transaction {
 	 * during thread teardown
 	 */
 	spinlock_t lock;
+	/* when queued, then when picked up; see binder_lat_account() */
+	ktime_t lat_ts;
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	bool lat_ux;
+#endif
 	ANDROID_VENDOR_DATA(1);
 };
 
@@ -641,6 +641,15 @@ static int init_binder_logs(struct super_block *sb)
 		goto out;
 	}
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	dentry = binderfs_create_file(binder_logs_root_dir, "latency",
+				      &binder_latency_fops, NULL);
+	if (IS_ERR(dentry)) {
+		ret = PTR_ERR(dentry);
+		goto out;
+	}
+#endif
+
 	proc_log_dir = binderfs_create_dir(binder_logs_root_dir, "proc");
 	if (IS_ERR(proc_log_dir)) {
 		ret = PTR_ERR(proc_log_dir);
@@ -77,6 +77,7 @@ EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_secureguard_send_to_user);
 EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_set_swappiness);
 EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_set_inactive_ratio);
 EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_check_throttle);
+EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_swap_slot_obj_size);
 EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_ufs_gen_proc_devinfo);
 EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_ufs_latency_hist);
 EXPORT_TRACEPOINT_SYMBOL_GPL(android_vh_check_dhcp_pkt);
@@ -0,0 +1,472 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * DCVS co-governor.
+ *
+ * schedutil, mem_latency and bw_hwmon each vote on their own sampling
+ * clock, so when a cluster ramps up its DDR vote follows one memlat
+ * window later. A mem_latency device that opts in through its "cogov"
+ * attribute is coupled with the cpufreq policy of the cores it monitors.
+ *
+ * schedutil reports the demand of that policy on every update. At most
+ * once per tick_ms, or at once when the CPU request moves by more than
+ * an eighth, a single snapshot is taken of that demand, the latest stall
+ * and ratio seen by memlat and the peak bandwidth seen since the last
+ * snapshot by the bw_hwmon device the node is linked to through the
+ * memlat "cogov_bw" attribute. Without a link the bandwidth input is 0. The
+ * energy model in dcvs_cogov_model.c then picks the cheapest CPU
+ * frequency and memory vote that keep the window under target_load. The
+ * memory vote becomes a floor for the memlat device and is applied right
+ * away. When the cluster is memory bound the CPU frequency becomes a
+ * FREQ_QOS_MAX cap, so the clock is not raised where only the memory
+ * vote helps.
+ */
+
+#define pr_fmt(fmt) "dcvs_cogov: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/mutex.h>
+#include <linux/rculist.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <linux/cpufreq.h>
+#include <linux/pm_qos.h>
+#include <linux/devfreq.h>
+#include <linux/energy_model.h>
+#include <linux/dcvs_cogov.h>
+#include "governor.h"
+#include "governor_memlat.h"
+#include "dcvs_cogov_model.h"
+
+struct cogov_node {
+	struct list_head	list;
+	struct cogov_domain	model;
+	struct cpufreq_policy	*policy;
+	struct devfreq		*df;
+	struct freq_qos_request	qos_req;
+	struct irq_work		irq_work;
+	struct work_struct	work;
+
+	/* inputs, written by the three governors */
+	raw_spinlock_t		lock;
+	struct cogov_sample	in;
+	u64			last_run;
+	unsigned int		last_req;
+	const char __rcu	*bw_dev;	/* bw_hwmon device feeding us */
+	unsigned long		bw_peak;	/* mbps since the last run */
+
+	/* outputs */
+	unsigned long		mem_floor;
+	unsigned int		cpu_cap;
+	struct cogov_decision	out;
+	unsigned long		runs;
+	unsigned long		caps;
+};
+
+static LIST_HEAD(cogov_list);
+static DEFINE_MUTEX(cogov_lock);
+static DEFINE_PER_CPU(struct cogov_node __rcu *, cogov_nodes);
+
+static bool enable = true;
+module_param(enable, bool, 0644);
+
+static unsigned int tick_ms = 10;
+module_param(tick_ms, uint, 0644);
+
+static unsigned int target_load = 80;
+module_param(target_load, uint, 0644);
+
+/* mW per GBps of memory vote */
+static unsigned int mem_cost = 60;
+module_param(mem_cost, uint, 0644);
+
+static struct cogov_node *cogov_find_node(struct devfreq *df)
+{
+	struct cogov_node *node;
+
+	list_for_each_entry_rcu(node, &cogov_list, list)
+		if (node->df == df)
+			return node;
+	return NULL;
+}
+
+void dcvs_cogov_update_cpu(struct cpufreq_policy *policy, u64 time,
+			   unsigned long util, unsigned long max,
+			   unsigned int next_freq)
+{
+	struct cogov_node *node;
+	unsigned int last;
+	bool kick;
+
+	if (!enable || !max)
+		return;
+
+	node = rcu_dereference_sched(per_cpu(cogov_nodes, policy->cpu));
+	if (!node)
+		return;
+
+	raw_spin_lock(&node->lock);
+	node->in.util = min(util * 1000 / max, 1000UL);
+	last = node->last_req;
+	kick = time - node->last_run >= (u64)tick_ms * NSEC_PER_MSEC ||
+	       next_freq > last + last / 8 || next_freq < last - last / 8;
+	if (kick) {
+		node->last_run = time;
+		node->last_req = next_freq;
+	}
+	raw_spin_unlock(&node->lock);
+
+	if (kick)
+		irq_work_queue(&node->irq_work);
+}
+
+void dcvs_cogov_update_mem(struct devfreq *df, unsigned long cpu_mhz,
+			   unsigned int stall_pct, unsigned int ratio,
+			   unsigned int stall_floor, unsigned int ratio_ceil)
+{
+	struct cogov_node *node;
+	unsigned long flags;
+
+	rcu_read_lock();
+	node = cogov_find_node(df);
+	if (node) {
+		raw_spin_lock_irqsave(&node->lock, flags);
+		node->in.cpu_freq = cpu_mhz * 1000;
+		node->in.stall_pct = stall_pct;
+		node->in.ratio = ratio;
+		node->model.stall_floor = stall_floor;
+		node->model.ratio_ceil = ratio_ceil;
+		raw_spin_unlock_irqrestore(&node->lock, flags);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(dcvs_cogov_update_mem);
+
+/* Keep the peak of @mbps since the last snapshot of @node */
+static void cogov_node_bw(struct cogov_node *node, unsigned long mbps)
+{
+	unsigned long old = READ_ONCE(node->bw_peak);
+
+	while (mbps > old) {
+		unsigned long prev = cmpxchg(&node->bw_peak, old, mbps);
+
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
+/*
+ * Bandwidth measured by the bw_hwmon device @df, for every node linked
+ * to it. May be called with irqs off.
+ */
+void dcvs_cogov_update_bw(struct devfreq *df, unsigned long mbps)
+{
+	const char *name = dev_name(df->dev.parent);
+	struct cogov_node *node;
+	const char *bw_dev;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(node, &cogov_list, list) {
+		bw_dev = rcu_dereference(node->bw_dev);
+		if (bw_dev && !strcmp(bw_dev, name))
+			cogov_node_bw(node, mbps);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(dcvs_cogov_update_bw);
+
+/*
+ * Take the bandwidth input of the node of @df from the bw_hwmon device
+ * named @bw_dev, or from none when @bw_dev is empty.
+ */
+int dcvs_cogov_link_bw(struct devfreq *df, const char *bw_dev)
+{
+	struct cogov_node *node;
+	const char *new = NULL, *old;
+
+	if (bw_dev && *bw_dev) {
+		new = kstrdup(bw_dev, GFP_KERNEL);
+		if (!new)
+			return -ENOMEM;
+	}
+
+	mutex_lock(&cogov_lock);
+	node = cogov_find_node(df);
+	if (!node) {
+		mutex_unlock(&cogov_lock);
+		kfree(new);
+		return -ENODEV;
+	}
+	old = rcu_dereference_protected(node->bw_dev,
+					lockdep_is_held(&cogov_lock));
+	rcu_assign_pointer(node->bw_dev, new);
+	WRITE_ONCE(node->bw_peak, 0);
+	mutex_unlock(&cogov_lock);
+
+	synchronize_rcu();
+	kfree(old);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dcvs_cogov_link_bw);
+
+unsigned long dcvs_cogov_mem_floor(struct devfreq *df)
+{
+	struct cogov_node *node;
+	unsigned long floor = 0;
+
+	if (!enable)
+		return 0;
+
+	rcu_read_lock();
+	node = cogov_find_node(df);
+	if (node)
+		floor = READ_ONCE(node->mem_floor);
+	rcu_read_unlock();
+
+	return floor;
+}
+EXPORT_SYMBOL_GPL(dcvs_cogov_mem_floor);
+
+static void cogov_irq_work(struct irq_work *irq_work)
+{
+	struct cogov_node *node = container_of(irq_work, struct cogov_node,
+					       irq_work);
+
+	queue_work(system_highpri_wq, &node->work);
+}
+
+static void cogov_work(struct work_struct *work)
+{
+	struct cogov_node *node = container_of(work, struct cogov_node, work);
+	struct cogov_decision d;
+	struct cogov_sample s;
+	unsigned long bw;
+	unsigned int cap;
+
+	bw = xchg(&node->bw_peak, 0);
+
+	raw_spin_lock_irq(&node->lock);
+	if (bw)
+		node->in.bw_mbps = bw;
+	s = node->in;
+	raw_spin_unlock_irq(&node->lock);
+
+	s.mem_freq = READ_ONCE(node->df->previous_freq);
+	node->model.target_load = clamp(target_load, 1U, 100U);
+	node->model.mem_cost = mem_cost;
+	cogov_decide(&node->model, &s, &d);
+	node->out = d;
+	node->runs++;
+
+	cap = d.mem_bound && !d.saturated ? d.cpu_freq :
+					    FREQ_QOS_MAX_DEFAULT_VALUE;
+	if (cap != node->cpu_cap) {
+		node->cpu_cap = cap;
+		if (cap != FREQ_QOS_MAX_DEFAULT_VALUE)
+			node->caps++;
+		if (freq_qos_update_request(&node->qos_req, cap) < 0)
+			pr_err("cpu%d: failed to update cap %u\n",
+			       node->policy->cpu, cap);
+	}
+
+	if (d.mem_freq != node->mem_floor) {
+		WRITE_ONCE(node->mem_floor, d.mem_freq);
+		mutex_lock(&node->df->lock);
+		update_devfreq(node->df);
+		mutex_unlock(&node->df->lock);
+	}
+}
+
+static int cmp_opp(const void *a, const void *b)
+{
+	const struct cogov_opp *x = a, *y = b;
+
+	return x->freq < y->freq ? -1 : x->freq > y->freq;
+}
+
+/* ascending, without duplicates */
+static int cogov_sort_opps(struct cogov_opp *opp, int nr)
+{
+	int i, n = 0;
+
+	sort(opp, nr, sizeof(*opp), cmp_opp, NULL);
+	for (i = 0; i < nr; i++)
+		if (!n || opp[i].freq != opp[n - 1].freq)
+			opp[n++] = opp[i];
+	return n;
+}
+
+/*
+ * CPU power from the energy model. Without one, power is taken as
+ * proportional to f^3, which keeps the ordering of the OPPs right.
+ */
+static void cogov_init_cpu_opps(struct cogov_node *node,
+				struct cpufreq_policy *policy)
+{
+	struct em_perf_domain *pd = em_cpu_get(policy->cpu);
+	struct cpufreq_frequency_table *pos;
+	struct cogov_domain *d = &node->model;
+	u64 mhz;
+	int i;
+
+	if (pd) {
+		for (i = 0; i < pd->nr_cap_states && i < COGOV_MAX_OPP; i++) {
+			d->cpu[i].freq = pd->table[i].frequency;
+			d->cpu[i].power = pd->table[i].power;
+		}
+		d->nr_cpu = cogov_sort_opps(d->cpu, i);
+		return;
+	}
+
+	i = 0;
+	cpufreq_for_each_valid_entry(pos, policy->freq_table) {
+		if (i == COGOV_MAX_OPP)
+			break;
+		mhz = pos->frequency / 1000;
+		d->cpu[i].freq = pos->frequency;
+		d->cpu[i].power = div64_u64(mhz * mhz * mhz, 10000000);
+		i++;
+	}
+	d->nr_cpu = cogov_sort_opps(d->cpu, i);
+}
+
+static void cogov_init_mem_opps(struct cogov_node *node,
+				const struct core_dev_map *map)
+{
+	struct cogov_domain *d = &node->model;
+	int i;
+
+	for (i = 0; map->core_mhz && i < COGOV_MAX_OPP; map++, i++)
+		d->mem[i].freq = map->target_freq;
+	d->nr_mem = cogov_sort_opps(d->mem, i);
+}
+
+int dcvs_cogov_attach(struct devfreq *df, const struct core_dev_map *map,
+		      const struct cpumask *cpus)
+{
+	struct cpufreq_policy *policy;
+	struct cogov_node *node;
+	int cpu, ret;
+
+	if (!map || cpumask_empty(cpus))
+		return -EINVAL;
+
+	policy = cpufreq_cpu_get(cpumask_first(cpus));
+	if (!policy)
+		return -ENODEV;
+
+	node = kzalloc(sizeof(*node), GFP_KERNEL);
+	if (!node) {
+		ret = -ENOMEM;
+		goto put;
+	}
+
+	node->df = df;
+	node->policy = policy;
+	node->cpu_cap = FREQ_QOS_MAX_DEFAULT_VALUE;
+	raw_spin_lock_init(&node->lock);
+	init_irq_work(&node->irq_work, cogov_irq_work);
+	INIT_WORK(&node->work, cogov_work);
+	cogov_init_cpu_opps(node, policy);
+	cogov_init_mem_opps(node, map);
+	if (!node->model.nr_cpu) {
+		ret = -EINVAL;
+		goto free;
+	}
+
+	mutex_lock(&cogov_lock);
+	for_each_cpu(cpu, policy->related_cpus) {
+		if (rcu_access_pointer(per_cpu(cogov_nodes, cpu))) {
+			ret = -EBUSY;
+			goto unlock;
+		}
+	}
+
+	ret = freq_qos_add_request(&policy->constraints, &node->qos_req,
+				   FREQ_QOS_MAX, FREQ_QOS_MAX_DEFAULT_VALUE);
+	if (ret < 0)
+		goto unlock;
+
+	list_add_tail_rcu(&node->list, &cogov_list);
+	for_each_cpu(cpu, policy->related_cpus)
+		rcu_assign_pointer(per_cpu(cogov_nodes, cpu), node);
+	mutex_unlock(&cogov_lock);
+
+	pr_info("%s coupled with cpu%d, %d cpu / %d mem levels\n",
+		dev_name(df->dev.parent), policy->cpu, node->model.nr_cpu,
+		node->model.nr_mem);
+	return 0;
+
+unlock:
+	mutex_unlock(&cogov_lock);
+free:
+	kfree(node);
+put:
+	cpufreq_cpu_put(policy);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dcvs_cogov_attach);
+
+void dcvs_cogov_detach(struct devfreq *df)
+{
+	struct cogov_node *node;
+	int cpu;
+
+	mutex_lock(&cogov_lock);
+	node = cogov_find_node(df);
+	if (!node) {
+		mutex_unlock(&cogov_lock);
+		return;
+	}
+
+	for_each_cpu(cpu, node->policy->related_cpus)
+		RCU_INIT_POINTER(per_cpu(cogov_nodes, cpu), NULL);
+	list_del_rcu(&node->list);
+	mutex_unlock(&cogov_lock);
+
+	synchronize_rcu();
+	irq_work_sync(&node->irq_work);
+	cancel_work_sync(&node->work);
+	freq_qos_remove_request(&node->qos_req);
+	cpufreq_cpu_put(node->policy);
+	kfree(rcu_access_pointer(node->bw_dev));
+	kfree(node);
+}
+EXPORT_SYMBOL_GPL(dcvs_cogov_detach);
+
+static int state_show(char *buf, const struct kernel_param *kp)
+{
+	struct cogov_node *node;
+	int cnt = 0;
+
+	mutex_lock(&cogov_lock);
+	list_for_each_entry(node, &cogov_list, list) {
+		struct cogov_sample *s = &node->in;
+		struct cogov_decision *d = &node->out;
+
+		const char *bw_dev = rcu_dereference_protected(node->bw_dev,
+					lockdep_is_held(&cogov_lock));
+
+		cnt += scnprintf(buf + cnt, PAGE_SIZE - cnt,
+				 "%s cpu%d: util %u stall %u ratio %u bw %u (%s) -> cpu %u mem %u busy %u energy %u%s%s cap %u runs %lu caps %lu\n",
+				 dev_name(node->df->dev.parent),
+				 node->policy->cpu, s->util, s->stall_pct,
+				 s->ratio, s->bw_mbps, bw_dev ? bw_dev : "none",
+				 d->cpu_freq,
+				 d->mem_freq, d->busy, d->energy,
+				 d->mem_bound ? " mem_bound" : "",
+				 d->saturated ? " saturated" : "",
+				 node->cpu_cap, node->runs, node->caps);
+	}
+	mutex_unlock(&cogov_lock);
+
+	return cnt;
+}
+
+static const struct kernel_param_ops state_ops = {
+	.get = state_show,
+};
+module_param_cb(state, &state_ops, NULL, 0444);
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Energy model of the DCVS co-governor.
+ *
+ * A window of work is split into a compute part, which shrinks as the
+ * CPU clock goes up, and a stall part, which shrinks as the memory vote
+ * goes up. Both are taken from one snapshot measured at (f0, m0):
+ *
+ *   busy(f, m) = u * fmax / f0 * ((1 - s) * f0 / f + s * m0 / m)
+ *
+ * where u is the demand at fmax and s the stall fraction. Energy over the
+ * window is the CPU OPP power for the busy time plus the memory power for
+ * the whole window. Every (f, m) pair that keeps busy under target_load
+ * and m above the measured bandwidth with the same headroom is costed,
+ * and the cheapest one wins.
+ */
+
+#include "dcvs_cogov_model.h"
+
+int cogov_find(const struct cogov_opp *opp, int nr, unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < nr - 1; i++)
+		if (opp[i].freq >= freq)
+			break;
+	return i;
+}
+
+unsigned int cogov_eval(const struct cogov_domain *d,
+			const struct cogov_sample *s, int ci, int mi,
+			unsigned int *busy)
+{
+	unsigned int fmax = d->cpu[d->nr_cpu - 1].freq;
+	unsigned int f = d->cpu[ci].freq;
+	unsigned int f0 = s->cpu_freq ? s->cpu_freq : fmax;
+	unsigned int m = d->nr_mem ? d->mem[mi].freq : 0;
+	unsigned int stall = s->stall_pct > 100 ? 100 : s->stall_pct;
+	u64 at_f0, compute, wait, energy;
+
+	/* busy permille at f0 */
+	at_f0 = div64_u64((u64)s->util * fmax, f0);
+
+	compute = div64_u64(at_f0 * (100 - stall) * f0, 100ULL * f);
+	if (s->mem_freq && m)
+		wait = div64_u64(at_f0 * stall * s->mem_freq, 100ULL * m);
+	else
+		wait = div64_u64(at_f0 * stall, 100);
+
+	*busy = compute + wait;
+	energy = div64_u64((u64)d->cpu[ci].power * *busy, 1000);
+	energy += div64_u64((u64)d->mem_cost * m, 1000);
+
+	return energy;
+}
+
+void cogov_decide(const struct cogov_domain *d, const struct cogov_sample *s,
+		  struct cogov_decision *out)
+{
+	unsigned int limit = d->target_load * 10;
+	unsigned int bw_floor, busy, energy;
+	int nr_mem = d->nr_mem ? d->nr_mem : 1;
+	int ci, mi, best_ci = -1, best_mi = 0;
+	unsigned int best_energy = ~0U, best_busy = 0;
+
+	bw_floor = div64_u64((u64)s->bw_mbps * 100,
+			     d->target_load ? d->target_load : 100);
+
+	out->mem_bound = s->stall_pct >= d->stall_floor &&
+			 s->ratio <= d->ratio_ceil;
+
+	for (mi = 0; mi < nr_mem; mi++) {
+		if (d->nr_mem && d->mem[mi].freq < bw_floor &&
+		    mi != d->nr_mem - 1)
+			continue;
+
+		for (ci = 0; ci < d->nr_cpu; ci++) {
+			energy = cogov_eval(d, s, ci, mi, &busy);
+			if (busy > limit)
+				continue;
+			if (energy < best_energy) {
+				best_energy = energy;
+				best_busy = busy;
+				best_ci = ci;
+				best_mi = mi;
+			}
+		}
+	}
+
+	out->saturated = best_ci < 0;
+	if (out->saturated) {
+		best_ci = d->nr_cpu - 1;
+		best_mi = nr_mem - 1;
+		best_energy = cogov_eval(d, s, best_ci, best_mi, &best_busy);
+	}
+
+	out->cpu_freq = d->cpu[best_ci].freq;
+	out->mem_freq = d->nr_mem ? d->mem[best_mi].freq : 0;
+	out->busy = best_busy;
+	out->energy = best_energy;
+}
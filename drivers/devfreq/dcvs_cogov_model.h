@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Energy model of the DCVS co-governor. This file and dcvs_cogov_model.c
+ * build both in the kernel and on the host, for tools/power/dcvs_replay.
+ */
+
+#ifndef _DCVS_COGOV_MODEL_H
+#define _DCVS_COGOV_MODEL_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/math64.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+#define COGOV_MAX_OPP	32
+
+/**
+ * struct cogov_opp - One operating point
+ * @freq:	CPU frequency in kHz, or memory vote in MBps.
+ * @power:	Active power at @freq in mW. Unused for memory levels, whose
+ *		power is modelled as mem_cost mW per GBps.
+ */
+struct cogov_opp {
+	unsigned int	freq;
+	unsigned int	power;
+};
+
+/**
+ * struct cogov_domain - Static description of one CPU cluster and the
+ *			 memory device it is coupled with
+ * @cpu:		CPU OPPs, ascending.
+ * @mem:		Memory votes, ascending.
+ * @target_load:	Busy percentage a window may reach at the chosen
+ *			frequencies, and the headroom kept over the
+ *			measured bandwidth.
+ * @stall_floor:	Stall percentage above which the cluster counts as
+ *			memory bound, as in the memlat governor.
+ * @ratio_ceil:		Instructions per memory access below which the
+ *			cluster counts as memory bound, as in memlat.
+ * @mem_cost:		Memory power in mW per GBps of vote.
+ */
+struct cogov_domain {
+	struct cogov_opp	cpu[COGOV_MAX_OPP];
+	struct cogov_opp	mem[COGOV_MAX_OPP];
+	int			nr_cpu;
+	int			nr_mem;
+	unsigned int		target_load;
+	unsigned int		stall_floor;
+	unsigned int		ratio_ceil;
+	unsigned int		mem_cost;
+};
+
+/**
+ * struct cogov_sample - Inputs taken in one snapshot
+ * @util:	CPU demand in permille of the capacity at the highest OPP.
+ * @cpu_freq:	CPU frequency the demand was measured at, in kHz.
+ * @stall_pct:	Percentage of cycles stalled on memory at @cpu_freq.
+ * @ratio:	Instructions per memory access.
+ * @mem_freq:	Memory vote in place while @stall_pct was measured.
+ * @bw_mbps:	Measured bandwidth.
+ */
+struct cogov_sample {
+	unsigned int	util;
+	unsigned int	cpu_freq;
+	unsigned int	stall_pct;
+	unsigned int	ratio;
+	unsigned int	mem_freq;
+	unsigned int	bw_mbps;
+};
+
+/**
+ * struct cogov_decision - Joint request chosen for one sample
+ * @cpu_freq:	CPU frequency in kHz.
+ * @mem_freq:	Memory vote in MBps.
+ * @busy:	Projected busy time in permille of the window.
+ * @energy:	Projected energy over the window, mW on average.
+ * @mem_bound:	The sample passed the stall_floor/ratio_ceil test.
+ * @saturated:	No pair met target_load; the highest pair was chosen.
+ */
+struct cogov_decision {
+	unsigned int	cpu_freq;
+	unsigned int	mem_freq;
+	unsigned int	busy;
+	unsigned int	energy;
+	bool		mem_bound;
+	bool		saturated;
+};
+
+int cogov_find(const struct cogov_opp *opp, int nr, unsigned int freq);
+unsigned int cogov_eval(const struct cogov_domain *d,
+			const struct cogov_sample *s, int ci, int mi,
+			unsigned int *busy);
+void cogov_decide(const struct cogov_domain *d, const struct cogov_sample *s,
+		  struct cogov_decision *out);
+
+#endif /* _DCVS_COGOV_MODEL_H */
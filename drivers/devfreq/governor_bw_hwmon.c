@@ -21,6 +21,7 @@
 #include <linux/platform_device.h>
 #include <linux/of.h>
 #include <linux/devfreq.h>
+#include <linux/dcvs_cogov.h>
 #include <trace/events/power.h>
 #include "governor.h"
 #include "governor_bw_hwmon.h"
@@ -317,6 +318,7 @@ static unsigned long get_bw_and_set_irq(struct hwmon_node *node,
 
 	req_mbps = meas_mbps = node->max_mbps;
 	node->max_mbps = 0;
+	dcvs_cogov_update_bw(hw->df, meas_mbps);
 
 	hist_lo_tol = (node->hist_max_mbps * HIST_PEAK_TOL) / 100;
 	/* Remember historic peak in the past hist_mem decision windows. */
@@ -21,16 +21,21 @@
 #include <linux/device.h>
 #include <linux/of.h>
 #include <linux/devfreq.h>
+#include <linux/dcvs_cogov.h>
 #include "governor.h"
 #include "governor_memlat.h"
 
 #include <trace/events/power.h>
 
+#define COGOV_BW_NAME_LEN	64
+
 struct memlat_node {
 	unsigned int		ratio_ceil;
 	unsigned int		stall_floor;
 	unsigned int		wb_pct_thres;
 	unsigned int		wb_filter_ratio;
+	unsigned int		cogov;
+	char			cogov_bw[COGOV_BW_NAME_LEN];
 	bool			mon_started;
 	bool			already_zero;
 	struct list_head	list;
@@ -254,6 +259,10 @@ static void gov_stop(struct devfreq *df)
 	struct memlat_node *node = df->data;
 	struct memlat_hwmon *hw = node->hw;
 
+	if (node->cogov) {
+		dcvs_cogov_detach(df);
+		node->cogov = 0;
+	}
 	sysfs_remove_group(&df->dev.kobj, node->attr_grp);
 	stop_monitor(df);
 	df->data = node->orig_data;
@@ -264,11 +273,11 @@ static void gov_stop(struct devfreq *df)
 static int devfreq_memlat_get_freq(struct devfreq *df,
 					unsigned long *freq)
 {
-	int i, lat_dev = 0;
+	int i, lat_dev = 0, stall_dev = -1;
 	struct memlat_node *node = df->data;
 	struct memlat_hwmon *hw = node->hw;
 	unsigned long max_freq = 0;
-	unsigned int ratio;
+	unsigned int ratio, stall_ratio = 0;
 
 	/*
 	 * node->resume_freq is set to 0 at the end of resume (after the update)
@@ -309,11 +318,27 @@ static int devfreq_memlat_get_freq(struct devfreq *df,
 			lat_dev = i;
 			max_freq = hw->core_stats[i].freq;
 		}
+
+		if (stall_dev < 0 || hw->core_stats[i].stall_pct >
+				     hw->core_stats[stall_dev].stall_pct) {
+			stall_dev = i;
+			stall_ratio = ratio;
+		}
 	}
 
 	if (max_freq)
 		max_freq = core_to_dev_freq(node, max_freq);
 
+	if (node->cogov) {
+		if (stall_dev >= 0)
+			dcvs_cogov_update_mem(df,
+					hw->core_stats[stall_dev].freq,
+					hw->core_stats[stall_dev].stall_pct,
+					stall_ratio, node->stall_floor,
+					node->ratio_ceil);
+		max_freq = max(max_freq, dcvs_cogov_mem_floor(df));
+	}
+
 	if (max_freq || !node->already_zero) {
 		trace_memlat_dev_update(dev_name(df->dev.parent),
 					hw->core_stats[lat_dev].id,
@@ -341,6 +366,77 @@ static DEVICE_ATTR_RW(wb_pct_thres);
 show_attr(wb_filter_ratio);
 store_attr(wb_filter_ratio, 0U, 50000U);
 static DEVICE_ATTR_RW(wb_filter_ratio);
+show_attr(cogov);
+
+static ssize_t cogov_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct devfreq *df = to_devfreq(dev);
+	struct memlat_node *node = df->data;
+	struct memlat_hwmon *hw = node->hw;
+	cpumask_t cpus;
+	unsigned int val;
+	int i, ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+	val = !!val;
+	if (val == node->cogov)
+		return count;
+
+	if (val) {
+		cpumask_clear(&cpus);
+		for (i = 0; i < hw->num_cores; i++)
+			cpumask_set_cpu(hw->core_stats[i].id, &cpus);
+		ret = dcvs_cogov_attach(df, hw->freq_map, &cpus);
+		if (ret < 0)
+			return ret;
+		ret = dcvs_cogov_link_bw(df, node->cogov_bw);
+		if (ret < 0) {
+			dcvs_cogov_detach(df);
+			return ret;
+		}
+	} else {
+		dcvs_cogov_detach(df);
+	}
+	node->cogov = val;
+
+	return count;
+}
+static DEVICE_ATTR_RW(cogov);
+
+static ssize_t cogov_bw_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct devfreq *df = to_devfreq(dev);
+	struct memlat_node *node = df->data;
+
+	return scnprintf(buf, PAGE_SIZE, "%s\n", node->cogov_bw);
+}
+
+/* Name of the bw_hwmon device whose bandwidth feeds the co-governor */
+static ssize_t cogov_bw_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct devfreq *df = to_devfreq(dev);
+	struct memlat_node *node = df->data;
+	char name[COGOV_BW_NAME_LEN], *bw_dev;
+	int ret;
+
+	strlcpy(name, buf, sizeof(name));
+	bw_dev = strim(name);
+	if (node->cogov) {
+		ret = dcvs_cogov_link_bw(df, bw_dev);
+		if (ret < 0)
+			return ret;
+	}
+	strlcpy(node->cogov_bw, bw_dev, sizeof(node->cogov_bw));
+
+	return count;
+}
+static DEVICE_ATTR_RW(cogov_bw);
 
 static struct attribute *memlat_dev_attr[] = {
 	&dev_attr_ratio_ceil.attr,
@@ -348,6 +444,8 @@ static struct attribute *memlat_dev_attr[] = {
 	&dev_attr_freq_map.attr,
 	&dev_attr_wb_pct_thres.attr,
 	&dev_attr_wb_filter_ratio.attr,
+	&dev_attr_cogov.attr,
+	&dev_attr_cogov_bw.attr,
 	NULL,
 };
 
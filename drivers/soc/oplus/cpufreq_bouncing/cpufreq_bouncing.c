@@ -12,6 +12,7 @@
 #include <linux/version.h>
 #include <linux/freezer.h>
 #include <linux/workqueue.h>
+#include <linux/healthinfo/fg.h>
 
 #define NSEC_TO_MSEC(val) (val / NSEC_PER_MSEC)
 #define MSEC_TO_NSEC(val) (val * NSEC_PER_MSEC)
@@ -19,6 +20,19 @@
 #define NR_FREQ 32
 #define NR_CLUS_MAX 3
 #define NR_CORE_MAX 8
+#define NR_PROFILES 16
+#define CB_LOG_SIZE 256
+#define CB_LOG_SHOW 64
+#define CB_WINDOW_NS NSEC_PER_SEC
+
+/* learning targets per window, perf in permille of time not capped */
+#define CB_FLIPS_HI 4
+#define CB_FLIPS_LO 1
+#define CB_PERF_LO 700
+#define CB_PERF_HI 950
+#define CB_DECAY_MAX 95
+
+struct cb_profile;
 
 /* cluster based */
 struct cpufreq_bouncing {
@@ -42,6 +56,14 @@ struct cpufreq_bouncing {
 	/* trace info */
 	long long freqs_resident[NR_FREQ]; // for record how long freqs stay
 
+	/* learning window */
+	struct cb_profile *win_prof;
+	u64 win_start;
+	u64 win_throttled;
+	u64 win_freq; // kHz * ms
+	int win_flips;
+	int last_dir;
+
 	/* config */
 	bool enable;
 	int cur_level;
@@ -244,6 +266,276 @@ static int cb_pol_idx = 0;
 
 static bool cb_switch = false;
 
+/*
+ * per foreground app profiles
+ *
+ * the active profile follows get_fg_uid(), checked on every update.
+ * Each app keeps its own decay and limit_thres per cluster, seeded from
+ * the global config and tuned once per CB_WINDOW_NS from what the cap did:
+ * a cap that keeps flipping up and down gets more decay (acc is held
+ * longer, so the cap releases later), a cap that clips the cluster for
+ * much of the window gets a longer limit_thres, and a cap that hardly
+ * ever clips gets a shorter one. limit_thres stays within [1/2, 4] of
+ * the configured value.
+ */
+struct cb_clus_profile {
+	unsigned int decay;
+	u64 limit_thres;
+
+	/* scores, EWMA over windows */
+	unsigned int energy; // avg freq, permille of max freq
+	unsigned int perf; // time not clipped by cap, permille
+	unsigned int flips; // cap direction changes per window
+	unsigned int windows;
+};
+
+struct cb_profile {
+	int uid;
+	u64 last_used;
+	struct cb_clus_profile clus[NR_CLUS_MAX];
+};
+
+static struct cb_profile cb_profiles[NR_PROFILES] = {
+	[0 ... NR_PROFILES - 1] = { .uid = -1 },
+};
+static struct cb_profile *cb_active;
+/* taken from cb_update() with irqs off, so always irqsave */
+static DEFINE_SPINLOCK(cb_profile_lock);
+
+static bool learn = true;
+module_param_named(learn, learn, bool, 0664);
+
+/* ring buffer of cap decisions */
+struct cb_log_entry {
+	u64 ts;
+	int uid;
+	u32 acc_ms;
+	u8 clus;
+	u8 from;
+	u8 to;
+};
+
+static struct cb_log_entry cb_log[CB_LOG_SIZE];
+static unsigned int cb_log_head;
+static DEFINE_SPINLOCK(cb_log_lock);
+
+static void cb_profile_seed(struct cb_profile *prof, int clus)
+{
+	struct cb_clus_profile *cp = &prof->clus[clus];
+
+	memset(cp, 0, sizeof(*cp));
+	cp->decay = decay;
+	cp->limit_thres = cb_stuff[clus].limit_thres;
+}
+
+/* called with cb_profile_lock held */
+static struct cb_profile *cb_profile_get(int uid)
+{
+	struct cb_profile *prof, *victim = &cb_profiles[0];
+	int i;
+
+	for (prof = cb_profiles; prof < cb_profiles + NR_PROFILES; ++prof) {
+		if (prof->uid == uid)
+			return prof;
+		if (victim->uid != -1 &&
+		    (prof->uid == -1 || prof->last_used < victim->last_used))
+			victim = prof;
+	}
+
+	victim->uid = uid;
+	for (i = 0; i < NR_CLUS_MAX; ++i)
+		cb_profile_seed(victim, i);
+	return victim;
+}
+
+static void cb_profiles_reseed(int clus)
+{
+	struct cb_profile *prof;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cb_profile_lock, flags);
+	for (prof = cb_profiles; prof < cb_profiles + NR_PROFILES; ++prof)
+		if (prof->uid != -1)
+			cb_profile_seed(prof, clus);
+	spin_unlock_irqrestore(&cb_profile_lock, flags);
+}
+
+static void cb_log_cap(struct cpufreq_bouncing *cb, int uid, u64 time,
+		       int from, int to)
+{
+	struct cb_log_entry *e;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cb_log_lock, flags);
+	e = &cb_log[cb_log_head++ % CB_LOG_SIZE];
+	e->ts = time;
+	e->uid = uid;
+	e->acc_ms = NSEC_TO_MSEC(cb->acc);
+	e->clus = cb - cb_stuff;
+	e->from = from;
+	e->to = to;
+	spin_unlock_irqrestore(&cb_log_lock, flags);
+}
+
+static inline void cb_window_reset(struct cpufreq_bouncing *cb, u64 time)
+{
+	cb->win_start = time;
+	cb->win_throttled = 0;
+	cb->win_freq = 0;
+	cb->win_flips = 0;
+}
+
+/* account one update into the learning window, tune at window end */
+static void cb_learn(struct cpufreq_bouncing *cb, struct cb_profile *prof,
+		     struct cpufreq_policy *pol, u64 time, u64 span)
+{
+	struct cb_clus_profile *cp = &prof->clus[cb - cb_stuff];
+	unsigned int energy, perf;
+	unsigned long flags;
+	u64 win;
+
+	/* a window must not mix two apps */
+	if (!cb->win_start || cb->win_prof != prof) {
+		cb->win_prof = prof;
+		cb_window_reset(cb, time);
+		return;
+	}
+
+	span = min_t(u64, span, CB_WINDOW_NS);
+	cb->win_freq += (u64)pol->cur * NSEC_TO_MSEC(span);
+	if (cb->cur_level != cb->max_level &&
+	    pol->cur >= cb->freqs[cb->cur_level])
+		cb->win_throttled += span;
+
+	win = time - cb->win_start;
+	if (win < CB_WINDOW_NS)
+		return;
+
+	energy = div64_u64(cb->win_freq * 1000,
+			   (u64)cb->max_freq * NSEC_TO_MSEC(win) ?: 1);
+	perf = 1000 - min_t(u64, div64_u64(cb->win_throttled * 1000, win), 1000);
+
+	/* profiles_show and reseed look at the same fields */
+	spin_lock_irqsave(&cb_profile_lock, flags);
+	if (!cp->windows++) {
+		cp->energy = energy;
+		cp->perf = perf;
+		cp->flips = cb->win_flips;
+	} else {
+		cp->energy = (cp->energy * 7 + energy) / 8;
+		cp->perf = (cp->perf * 7 + perf) / 8;
+		cp->flips = (cp->flips * 7 + cb->win_flips) / 8;
+	}
+
+	/* cb_update() of other clusters reads these without the lock */
+	if (learn) {
+		if (cb->win_flips > CB_FLIPS_HI)
+			WRITE_ONCE(cp->decay, min(cp->decay + 5,
+						  (unsigned int)CB_DECAY_MAX));
+		else if (cb->win_flips <= CB_FLIPS_LO && cp->decay > decay)
+			WRITE_ONCE(cp->decay, cp->decay - 1);
+
+		if (perf < CB_PERF_LO)
+			WRITE_ONCE(cp->limit_thres,
+				   min(cp->limit_thres + cp->limit_thres / 8,
+				       cb->limit_thres * 4));
+		else if (perf > CB_PERF_HI)
+			WRITE_ONCE(cp->limit_thres,
+				   max(cp->limit_thres - cp->limit_thres / 16,
+				       cb->limit_thres / 2));
+	}
+	spin_unlock_irqrestore(&cb_profile_lock, flags);
+
+	if (debug)
+		pr_info("learn uid %d clus %ld: flips %d energy %u perf %u decay %u thres %llu ms\n",
+			prof->uid, (long)(cb - cb_stuff), cb->win_flips, energy,
+			perf, cp->decay, NSEC_TO_MSEC(cp->limit_thres));
+
+	cb_window_reset(cb, time);
+}
+
+/* switch the active profile when the foreground uid changed */
+static struct cb_profile *cb_profile_select(u64 time)
+{
+	struct cb_profile *prof = READ_ONCE(cb_active);
+	int uid = get_fg_uid();
+	unsigned long flags;
+
+	if (prof ? READ_ONCE(prof->uid) == uid : uid < 0)
+		return prof;
+
+	spin_lock_irqsave(&cb_profile_lock, flags);
+	prof = NULL;
+	if (uid >= 0) {
+		prof = cb_profile_get(uid);
+		prof->last_used = time;
+	}
+	WRITE_ONCE(cb_active, prof);
+	spin_unlock_irqrestore(&cb_profile_lock, flags);
+
+	return prof;
+}
+
+static int cb_profiles_show(char *buf, const struct kernel_param *kp)
+{
+	struct cb_profile *prof;
+	struct cb_clus_profile *cp;
+	unsigned long flags;
+	int i, cnt = 0;
+
+	spin_lock_irqsave(&cb_profile_lock, flags);
+	for (prof = cb_profiles; prof < cb_profiles + NR_PROFILES; ++prof) {
+		if (prof->uid == -1)
+			continue;
+
+		cnt += snprintf(buf + cnt, PAGE_SIZE - cnt, "uid %d%s\n",
+				prof->uid, prof == cb_active ? " (fg)" : "");
+		for (i = 0; i < min(NR_CLUS_MAX, cb_pol_idx); ++i) {
+			cp = &prof->clus[i];
+			cnt += snprintf(buf + cnt, PAGE_SIZE - cnt,
+					"  clus %d: decay %u thres %llu ms flips %u energy %u perf %u windows %u\n",
+					i, cp->decay, NSEC_TO_MSEC(cp->limit_thres),
+					cp->flips, cp->energy, cp->perf, cp->windows);
+		}
+	}
+	spin_unlock_irqrestore(&cb_profile_lock, flags);
+
+	return cnt;
+}
+
+static struct kernel_param_ops cb_profiles_ops = {
+	.get = cb_profiles_show,
+};
+module_param_cb(profiles, &cb_profiles_ops, NULL, 0444);
+
+/* latest cap decisions, format: ts_ms clus uid from_freq to_freq acc_ms */
+static int cb_cap_log_show(char *buf, const struct kernel_param *kp)
+{
+	struct cb_log_entry *e;
+	unsigned long flags;
+	unsigned int head, i;
+	int cnt = 0;
+
+	spin_lock_irqsave(&cb_log_lock, flags);
+	head = cb_log_head;
+	i = head > CB_LOG_SHOW ? head - CB_LOG_SHOW : 0;
+	for (; i < head; ++i) {
+		e = &cb_log[i % CB_LOG_SIZE];
+		cnt += snprintf(buf + cnt, PAGE_SIZE - cnt, "%llu %u %d %u %u %u\n",
+				NSEC_TO_MSEC(e->ts), e->clus, e->uid,
+				cb_stuff[e->clus].freqs[e->from],
+				cb_stuff[e->clus].freqs[e->to], e->acc_ms);
+	}
+	spin_unlock_irqrestore(&cb_log_lock, flags);
+
+	return cnt;
+}
+
+static struct kernel_param_ops cb_cap_log_ops = {
+	.get = cb_cap_log_show,
+};
+module_param_cb(cap_log, &cb_cap_log_ops, NULL, 0444);
+
 static inline struct cpufreq_bouncing* cb_get(int cpu)
 {
 	if (cpu < 0 || cpu >= NR_CORE_MAX)
@@ -335,6 +627,7 @@ static int cb_config_store(const char *buf, const struct kernel_param *kp)
 	cb->up_speed = v.up_speed;
 	cb->up_limit_ns = MSEC_TO_NSEC(v.up_limit_ms);
 	cb->enable = v.enable;
+	cb_profiles_reseed(v.clus);
 
 	return 0;
 out:
@@ -561,7 +854,9 @@ static void cb_core_boost(u64 time)
 void cb_update(struct cpufreq_policy *pol, u64 time)
 {
 	struct cpufreq_bouncing *cb;
-	u64 delta, update_delta;
+	struct cb_profile *prof;
+	u64 delta, update_delta, limit_thres;
+	unsigned int cb_decay;
 	int cpu, prev_level;
 	bool min_over_target_freq, isolated;
 
@@ -589,6 +884,16 @@ void cb_update(struct cpufreq_policy *pol, u64 time)
 	if (unlikely(!cb->last_ts))
 		cb->last_ts = cb->last_freq_update_ts = time;
 
+	/* foreground app profile, if any, overrides decay and limit_thres */
+	prof = cb_profile_select(time);
+	if (prof) {
+		cb_decay = READ_ONCE(prof->clus[cb - cb_stuff].decay);
+		limit_thres = READ_ONCE(prof->clus[cb - cb_stuff].limit_thres);
+	} else {
+		cb_decay = decay;
+		limit_thres = cb->limit_thres;
+	}
+
 	/*
 	 * not count flag only affects to delta.
 	 * keep update_delta to let limit_freq has time to restore
@@ -602,12 +907,12 @@ void cb_update(struct cpufreq_policy *pol, u64 time)
 		cb->acc += delta;
 	} else {
 		/* decay accumulate time */
-		cb->acc = cb->acc * decay / 100;
+		cb->acc = cb->acc * cb_decay / 100;
 	}
 
 	/* check if need to update limitation */
 	prev_level = cb->cur_level;
-	if (cb->acc >= cb->limit_thres) {
+	if (cb->acc >= limit_thres) {
 		/* check last update */
 		if (update_delta >= cb->down_limit_ns) {
 			cb->cur_level = max(prev_level - cb->down_speed, cb->limit_level);
@@ -627,6 +932,19 @@ void cb_update(struct cpufreq_policy *pol, u64 time)
 	if (min_over_target_freq || isolated)
 		cb->cur_level = cb->max_level;
 
+	if (cb->cur_level != prev_level) {
+		int dir = cb->cur_level > prev_level ? 1 : -1;
+
+		if (cb->last_dir && dir != cb->last_dir)
+			++cb->win_flips;
+		cb->last_dir = dir;
+		cb_log_cap(cb, prof ? prof->uid : -1, time, prev_level,
+			   cb->cur_level);
+	}
+
+	if (prof)
+		cb_learn(cb, prof, pol, time, time - cb->last_ts);
+
 	/* update core_ctl boost status */
 	cb_core_boost(time);
 
@@ -7,6 +7,7 @@
 #define _NAND_SWAP_H
 
 #include <linux/sched.h>
+#include <linux/mm_types.h>
 
 /* must check if this flag is repeat in <include/linux/mm.h> */
 #define VM_NANDSWAP	0x8000000000UL	/* swapin mark */
@@ -32,8 +33,16 @@ enum {
 };
 
 extern struct task_struct *nswapoutd;
+extern struct task_struct *nswaptierd;	/* zram tiering writer */
+extern void nandswap_record_fault(struct vm_area_struct *vma,
+				  unsigned long address, swp_entry_t entry);
+extern bool nandswap_writable(void);
+extern void nandswap_account_write(unsigned long nr_pages);
+
+/* tasks allowed to allocate slots on the nandswap device */
 static inline bool current_is_nswapoutd()
 {
-	return current == nswapoutd;
+	return current == nswapoutd ||
+	       (nswaptierd && current == nswaptierd);
 }
 #endif /* _NAND_SWAP_H */
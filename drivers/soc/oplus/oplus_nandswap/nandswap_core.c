@@ -57,6 +57,8 @@
 #include <linux/notifier.h>
 #include <linux/profile.h>
 #include <linux/version.h>
+#include <linux/sort.h>
+#include <linux/xarray.h>
 #include "nandswap.h"
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,4,0)
@@ -85,6 +87,7 @@
 
 
 #define RD_SIZE 128
+#define NS_BATCH 16
 #define DEBUG_TIME_INFO 0
 
 #define NS_QUOTA_DAY_64G	5242880		/* 5G kB */
@@ -99,6 +102,18 @@
 #define NS_CHECK_INTERVAL	3600		/* 1 hour */
 #define NS_CHECK_COUNT		12		/* at least half day */
 
+/*
+ * Swap-in prefetch: faults a task takes on nandswap entries between being
+ * swapped out and being swapped back in are logged as runs of virtual page
+ * numbers (vpn << NS_PF_RUN_BITS | extra pages in the run), so the log for
+ * a typical resume fits in a few kB.
+ */
+#define NS_PF_RUN_BITS		12
+#define NS_PF_RUN_MAX		((1ULL << NS_PF_RUN_BITS) - 1)
+#define NS_PF_LOG_MAX		2040		/* runs, keeps the log in kmalloc-16k */
+#define NS_PF_MAX_STREAMS	8
+#define NS_PF_BATCH_MAX		64
+
 enum {
 	NS_NORMAL	= 0,			/* function is normal */
 	NS_CAPACITY	= (1 << 0),		/* data capacity is not enough */
@@ -169,6 +184,31 @@ struct ns_stat_info {
 	pid_t pid;
 	unsigned long swap_ratio;
 	unsigned long nand_type;
+	unsigned long pf_logged;	/* fault pages recorded for replay */
+	unsigned long pf_replay_cnt;
+	unsigned long pf_pages;		/* pages issued by replay */
+	unsigned long pf_time_ms;
+};
+
+struct ns_fault_log {
+	unsigned int nr;		/* runs used */
+	unsigned int size;		/* runs allocated */
+	unsigned int pages;		/* pages covered by all runs */
+	u64 run[];
+};
+
+struct ns_pf_walk {
+	swp_entry_t *ents;
+	int nr;
+	int size;
+	unsigned long type;
+};
+
+struct ns_pf_stream {
+	struct task_struct *thread;
+	wait_queue_head_t wait;
+	swp_entry_t *ents;
+	int nr;
 };
 
 struct ns_task_struct {
@@ -179,10 +219,19 @@ struct ns_task_struct {
 	spinlock_t lock;
 	unsigned long timeout;
 	struct kref kref;
+	struct rcu_head rcu;
+	struct ns_fault_log *flog;	/* faults since the last swap out */
+	struct ns_fault_log *replay;	/* log replayed on the next swap in */
 };
 
-static RADIX_TREE(ns_tree, GFP_ATOMIC);
-static DEFINE_SPINLOCK(ns_tree_lock);
+/*
+ * Tracked tasks indexed by pid. Lookups only take rcu_read_lock, updates
+ * serialize on the xa_lock. Tasks waiting for nswapoutd/nswapdropd carry a
+ * mark, so the daemons pick them up in batches rather than one by one.
+ */
+static DEFINE_XARRAY(ns_tasks);
+#define NS_MARK_OUT	XA_MARK_0
+#define NS_MARK_DROP	XA_MARK_1
 static struct ns_stat_info nsi;
 static struct proc_dir_entry *ns_proc_root = NULL;
 static struct proc_dir_entry *ns_proc_root_vnd = NULL;
@@ -190,12 +239,44 @@ static struct proc_dir_entry *ns_proc_root_vnd = NULL;
 struct task_struct *nswapoutd = NULL;
 struct task_struct *nswapdropd = NULL;
 struct task_struct *nswapind = NULL;
-static struct reclaim_info out_info = { {{0}}, 0, 0, 0 };
-static struct reclaim_info drop_info = { {{0}}, 0, 0, 0 };
+struct task_struct *nswaptierd = NULL;
 static struct reclaim_info in_info = { {{0}}, 0, 0, 0 };
 static DEFINE_SPINLOCK(rd_lock);
 
 bool nandswap_enable __read_mostly = false;
+
+/* helpers in addition to nswapind, fixed at boot */
+static int prefetch_streams = 3;
+module_param(prefetch_streams, int, 0444);
+/* pages of swap-in reads in flight across all streams */
+static int prefetch_inflight = 256;
+module_param(prefetch_inflight, int, 0644);
+/* pages issued under one plug */
+static int prefetch_batch = 32;
+module_param(prefetch_batch, int, 0644);
+/* pages collected from the log, sorted and issued together */
+static int prefetch_wave = 512;
+module_param(prefetch_wave, int, 0644);
+/* runs kept in a per-task fault log */
+static int prefetch_log_runs = 1000;
+module_param(prefetch_log_runs, int, 0644);
+/* MB of contiguous swap reserved per task on swap out, 0 disables */
+static int extent_max_mb = 32;
+module_param(extent_max_mb, int, 0644);
+/* frag_score from which extents start shrinking, and where they stop */
+static int extent_frag_low = 20;
+module_param(extent_frag_low, int, 0644);
+static int extent_frag_high = 80;
+module_param(extent_frag_high, int, 0644);
+
+static struct ns_pf_stream ns_pf_streams[NS_PF_MAX_STREAMS];
+static int ns_pf_nr_streams;
+static atomic_t ns_pf_pending = ATOMIC_INIT(0);
+static DECLARE_COMPLETION(ns_pf_done);
+static atomic_t ns_pf_inflight = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(ns_pf_wait);
+
+static inline unsigned long nandswap_type(void);
 extern int swapin_walk_pmd_entry(pmd_t *pmd, unsigned long start,
 				 unsigned long end, struct mm_walk *walk);
 extern unsigned long nswap_reclaim_page_list(struct list_head *page_list,
@@ -206,7 +287,9 @@ static void ns_free_task(struct kref *kref)
 	struct ns_task_struct *ntask;
 
 	ntask = container_of(kref, struct ns_task_struct, kref);
-	kfree(ntask);
+	kfree(ntask->flog);
+	kfree(ntask->replay);
+	kfree_rcu(ntask, rcu);
 }
 
 static inline void ns_get_task(struct ns_task_struct *ntask)
@@ -219,6 +302,51 @@ static inline void ns_put_task(struct ns_task_struct *ntask)
 	kref_put(&ntask->kref, ns_free_task);
 }
 
+static struct ns_task_struct *ns_task_lookup(pid_t pid)
+{
+	struct ns_task_struct *ntask;
+
+	rcu_read_lock();
+	ntask = xa_load(&ns_tasks, pid);
+	if (ntask && !kref_get_unless_zero(&ntask->kref))
+		ntask = NULL;
+	rcu_read_unlock();
+
+	return ntask;
+}
+
+static void ns_task_queue(struct ns_task_struct *ntask, xa_mark_t mark)
+{
+	struct task_struct *waken_task;
+
+	xa_set_mark(&ns_tasks, ntask->pid, mark);
+
+	waken_task = (mark == NS_MARK_OUT ? nswapoutd : nswapdropd);
+	if (waken_task && waken_task->state == TASK_INTERRUPTIBLE)
+		wake_up_process(waken_task);
+}
+
+/* take up to NS_BATCH tasks carrying @mark, clearing it as we go */
+static int ns_task_batch(xa_mark_t mark, struct ns_task_struct **batch)
+{
+	struct ns_task_struct *ntask;
+	unsigned long index;
+	int nr = 0;
+
+	rcu_read_lock();
+	xa_for_each_marked(&ns_tasks, index, ntask, mark) {
+		xa_clear_mark(&ns_tasks, index, mark);
+		if (!kref_get_unless_zero(&ntask->kref))
+			continue;
+		batch[nr++] = ntask;
+		if (nr == NS_BATCH)
+			break;
+	}
+	rcu_read_unlock();
+
+	return nr;
+}
+
 static int process_notifier(struct notifier_block *self,
 			unsigned long cmd, void *v)
 {
@@ -228,13 +356,13 @@ static int process_notifier(struct notifier_block *self,
 	if (!task)
 		return NOTIFY_OK;
 
-	spin_lock(&ns_tree_lock);
-	ntask = radix_tree_lookup(&ns_tree, task->pid);
-	if (ntask) {
-		radix_tree_delete(&ns_tree, task->pid);
+	/* most exiting tasks were never tracked, keep them off the xa_lock */
+	if (!xa_load(&ns_tasks, task->pid))
+		return NOTIFY_OK;
+
+	ntask = xa_erase(&ns_tasks, task->pid);
+	if (ntask)
 		ns_put_task(ntask);
-	}
-	spin_unlock(&ns_tree_lock);
 
 	return NOTIFY_OK;
 }
@@ -259,15 +387,14 @@ static inline struct ns_task_struct *ns_task_insert(pid_t pid, int type)
 	ntask->timeout = jiffies;
 	ntask->retry = 0;
 	kref_init(&ntask->kref);
+	/* the reference we return, taken before the entry is visible */
+	ns_get_task(ntask);
 
-	spin_lock(&ns_tree_lock);
-	if (radix_tree_insert(&ns_tree, pid, ntask)) {
-		ns_put_task(ntask);
-		ntask = NULL;
+	if (xa_insert(&ns_tasks, pid, ntask, GFP_KERNEL)) {
+		kfree(ntask);
+		/* lost a race with another writer for the same pid */
+		ntask = ns_task_lookup(pid);
 	}
-	if (ntask)
-		ns_get_task(ntask);
-	spin_unlock(&ns_tree_lock);
 
 out:
 	return ntask;
@@ -448,7 +575,6 @@ static inline void ns_life_ctrl_init(void)
 static void enqueue_reclaim_data(pid_t nr, struct reclaim_info *info)
 {
 	int idx;
-	struct task_struct *waken_task;
 
 	spin_lock(&rd_lock);
 	if (info->count < RD_SIZE) {
@@ -459,13 +585,8 @@ static void enqueue_reclaim_data(pid_t nr, struct reclaim_info *info)
 	spin_unlock(&rd_lock);
 	WARN_ON(info->count > RD_SIZE || info->count < 0);
 
-	waken_task = (info == &out_info? nswapoutd : nswapind);
-	if (!waken_task)
-		return;
-	if (waken_task->state == TASK_INTERRUPTIBLE)
-		wake_up_process(waken_task);
-	if (nswapdropd->state == TASK_INTERRUPTIBLE)
-		wake_up_process(nswapdropd);
+	if (nswapind && nswapind->state == TASK_INTERRUPTIBLE)
+		wake_up_process(nswapind);
 }
 
 static bool dequeue_reclaim_data(struct reclaim_data *data, struct reclaim_info *info)
@@ -486,6 +607,18 @@ static bool dequeue_reclaim_data(struct reclaim_data *data, struct reclaim_info
 	return has_data;
 }
 
+/* other writers to nandswap honor the same life protection */
+bool nandswap_writable(void)
+{
+	return nandswap_enable && !nsi.life_protect && !in_info.count;
+}
+
+void nandswap_account_write(unsigned long nr_pages)
+{
+	nsi.swap_out += nr_pages * 4;
+	ns_life_protect_update();
+}
+
 static void ns_state_check(int cur_adj, struct task_struct* task, int type)
 {
 	int uid = task_uid(task).val;
@@ -497,11 +630,7 @@ static void ns_state_check(int cur_adj, struct task_struct* task, int type)
 	if (uid % AID_USER_OFFSET < AID_APP)
 		return;
 
-	spin_lock(&ns_tree_lock);
-	ntask = radix_tree_lookup(&ns_tree, task->pid);
-	if (ntask)
-		ns_get_task(ntask);
-	spin_unlock(&ns_tree_lock);
+	ntask = ns_task_lookup(task->pid);
 
 	if (cur_adj > 0) {
 		if (!ntask)
@@ -520,7 +649,7 @@ static void ns_state_check(int cur_adj, struct task_struct* task, int type)
 
 		if (ntask->state == NS_OUT_STANDBY) {
 			ntask->state = NS_OUT_QUEUE;
-			enqueue_reclaim_data(ntask->pid, &out_info);
+			ns_task_queue(ntask, NS_MARK_OUT);
 		}
 		spin_unlock(&ntask->lock);
 	} else if (cur_adj == 0 && ntask) {
@@ -544,6 +673,328 @@ static void ns_state_check(int cur_adj, struct task_struct* task, int type)
 	return;
 }
 
+static struct ns_fault_log *ns_fault_log_alloc(void)
+{
+	struct ns_fault_log *log;
+	unsigned int size = clamp(READ_ONCE(prefetch_log_runs), 16, NS_PF_LOG_MAX);
+
+	log = kmalloc(struct_size(log, run, size), GFP_KERNEL | __GFP_NOWARN);
+	if (!log)
+		return NULL;
+
+	log->nr = 0;
+	log->size = size;
+	log->pages = 0;
+	return log;
+}
+
+static void ns_fault_log_add(struct ns_fault_log *log, unsigned long vpn)
+{
+	u64 last;
+	unsigned long start, len;
+
+	if (log->nr) {
+		last = log->run[log->nr - 1];
+		start = last >> NS_PF_RUN_BITS;
+		len = (last & NS_PF_RUN_MAX) + 1;
+
+		/* already logged by the readahead of an earlier fault */
+		if (vpn >= start && vpn < start + len)
+			return;
+		if (vpn == start + len && len <= NS_PF_RUN_MAX) {
+			log->run[log->nr - 1]++;
+			log->pages++;
+			return;
+		}
+	}
+
+	if (log->nr >= log->size)
+		return;
+	log->run[log->nr++] = (u64)vpn << NS_PF_RUN_BITS;
+	log->pages++;
+}
+
+/*
+ * Called from do_swap_page() for every swap fault. Only faults of a tracked
+ * task on the nandswap device between swap out and the end of swap in are
+ * recorded, which is the order the app needs its pages back on resume.
+ */
+void nandswap_record_fault(struct vm_area_struct *vma,
+			   unsigned long address, swp_entry_t entry)
+{
+	struct swap_info_struct *si;
+	struct ns_task_struct *ntask = NULL;
+
+	if (!nandswap_enable)
+		return;
+
+	si = swp_swap_info(entry);
+	if (!si || !(si->flags & SWP_NANDSWAP))
+		return;
+
+	if (current->mm != vma->vm_mm || vma->vm_file)
+		return;
+
+	ntask = ns_task_lookup(current->tgid);
+	if (!ntask)
+		return;
+
+	spin_lock(&ntask->lock);
+	if (ntask->flog && ntask->state != NS_OUT_STANDBY &&
+	    ntask->state != NS_OUT_QUEUE)
+		ns_fault_log_add(ntask->flog, address >> PAGE_SHIFT);
+	spin_unlock(&ntask->lock);
+	ns_put_task(ntask);
+}
+
+/*
+ * Called when the task goes out: the faults recorded since the previous
+ * swap out become the replay log, unless nothing was recorded, in which
+ * case the old replay log is still the best guess.
+ */
+static void ns_fault_log_rotate(struct ns_task_struct *ntask)
+{
+	struct ns_fault_log *log = NULL;
+
+	if (!ntask->flog || !ntask->replay)
+		log = ns_fault_log_alloc();
+
+	spin_lock(&ntask->lock);
+	if (!ntask->flog) {
+		ntask->flog = log;
+		log = NULL;
+	} else if (ntask->flog->nr) {
+		nsi.pf_logged += ntask->flog->pages;
+		swap(ntask->flog, ntask->replay);
+		if (!ntask->flog) {
+			ntask->flog = log;
+			log = NULL;
+		}
+	}
+	if (ntask->flog) {
+		ntask->flog->nr = 0;
+		ntask->flog->pages = 0;
+	}
+	spin_unlock(&ntask->lock);
+
+	kfree(log);
+}
+
+static int ns_prefetch_pte(pmd_t *pmd, unsigned long start,
+			   unsigned long end, struct mm_walk *walk)
+{
+	struct ns_pf_walk *pw = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+	swp_entry_t entry;
+	unsigned long addr;
+
+	if (vma->vm_file || (vma->vm_flags & VM_LOCKED))
+		return 0;
+
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, start, &ptl);
+	for (addr = start; addr != end; pte++, addr += PAGE_SIZE) {
+		if (pte_present(*pte) || pte_none(*pte))
+			continue;
+
+		entry = pte_to_swp_entry(*pte);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		if (swp_type(entry) != pw->type)
+			continue;
+
+		pw->ents[pw->nr++] = entry;
+		if (pw->nr >= pw->size)
+			break;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	return pw->nr >= pw->size ? 1 : 0;
+}
+
+static bool ns_prefetch_reserve(int nr)
+{
+	int cur;
+
+	do {
+		cur = atomic_read(&ns_pf_inflight);
+		/* an idle budget always admits one batch */
+		if (cur && cur + nr > READ_ONCE(prefetch_inflight))
+			return false;
+	} while (atomic_cmpxchg(&ns_pf_inflight, cur, cur + nr) != cur);
+
+	return true;
+}
+
+/* ents are sorted by swap offset, so each plug turns into large requests */
+static void ns_prefetch_issue(swp_entry_t *ents, int nr)
+{
+	struct page *pages[NS_PF_BATCH_MAX];
+	struct blk_plug plug;
+	int batch = clamp(READ_ONCE(prefetch_batch), 1, NS_PF_BATCH_MAX);
+	int i, j, n, cnt;
+
+	for (i = 0; i < nr; i += n) {
+		n = min(batch, nr - i);
+		wait_event(ns_pf_wait, ns_prefetch_reserve(n));
+
+		cnt = 0;
+		blk_start_plug(&plug);
+		for (j = 0; j < n; j++) {
+			pages[cnt] = read_swap_cache_async(ents[i + j],
+					GFP_HIGHUSER_MOVABLE, NULL, 0, false);
+			if (pages[cnt])
+				cnt++;
+		}
+		blk_finish_plug(&plug);
+
+		for (j = 0; j < cnt; j++) {
+			wait_on_page_locked(pages[j]);
+			put_page(pages[j]);
+		}
+
+		atomic_sub(n, &ns_pf_inflight);
+		wake_up_all(&ns_pf_wait);
+	}
+}
+
+/* not freezable: nswapind waits for the streams it has kicked */
+static int ns_pf_stream_fn(void *p)
+{
+	struct ns_pf_stream *stream = p;
+
+	for ( ; ; ) {
+		wait_event_interruptible(stream->wait, READ_ONCE(stream->nr) ||
+					 kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+
+		if (!READ_ONCE(stream->nr))
+			continue;
+
+		ns_prefetch_issue(stream->ents, stream->nr);
+		WRITE_ONCE(stream->nr, 0);
+		if (atomic_dec_and_test(&ns_pf_pending))
+			complete(&ns_pf_done);
+	}
+
+	return 0;
+}
+
+/*
+ * Cut the sorted wave into contiguous slices, one per stream, so every
+ * stream still reads in offset order. nswapind takes the first slice.
+ */
+static void ns_prefetch_dispatch(swp_entry_t *ents, int nr)
+{
+	int batch = clamp(READ_ONCE(prefetch_batch), 1, NS_PF_BATCH_MAX);
+	int used, slice, off, i;
+
+	used = min(ns_pf_nr_streams + 1, DIV_ROUND_UP(nr, batch));
+	if (used <= 1) {
+		ns_prefetch_issue(ents, nr);
+		return;
+	}
+
+	slice = DIV_ROUND_UP(nr, used);
+	used = DIV_ROUND_UP(nr, slice);
+
+	reinit_completion(&ns_pf_done);
+	atomic_set(&ns_pf_pending, used - 1);
+	for (i = 1; i < used; i++) {
+		struct ns_pf_stream *stream = &ns_pf_streams[i - 1];
+
+		off = i * slice;
+		stream->ents = ents + off;
+		WRITE_ONCE(stream->nr, min(slice, nr - off));
+		wake_up(&stream->wait);
+	}
+
+	ns_prefetch_issue(ents, slice);
+	wait_for_completion(&ns_pf_done);
+}
+
+static int ns_swp_entry_cmp(const void *a, const void *b)
+{
+	const swp_entry_t *x = a, *y = b;
+
+	if (x->val == y->val)
+		return 0;
+	return x->val < y->val ? -1 : 1;
+}
+
+/*
+ * Replay a fault log in waves: each wave takes the next prefetch_wave
+ * nandswap entries in fault order, sorts them by offset and reads them
+ * through the streams. The address-order walk in swapin_anon() then only
+ * picks up what the log did not cover.
+ */
+static void ns_prefetch_replay(struct task_struct *task,
+			       struct ns_fault_log *log)
+{
+	struct mm_struct *mm;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,4,0)
+	struct mm_walk walk = {};
+#else
+	const struct mm_walk_ops walk = {
+		.pmd_entry = ns_prefetch_pte,
+	};
+#endif
+	struct ns_pf_walk pw;
+	unsigned long start, end;
+	unsigned int i = 0;
+	u64 begin = ktime_get_ns();
+
+	pw.type = nandswap_type();
+	if (pw.type >= MAX_SWAPFILES)
+		return;
+
+	pw.size = clamp(READ_ONCE(prefetch_wave), NS_PF_BATCH_MAX, 4096);
+	pw.ents = kmalloc_array(pw.size, sizeof(swp_entry_t),
+				GFP_KERNEL | __GFP_NOWARN);
+	if (!pw.ents)
+		return;
+
+	mm = get_task_mm(task);
+	if (!mm)
+		goto out;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,4,0)
+	walk.mm = mm;
+	walk.pmd_entry = ns_prefetch_pte;
+	walk.private = &pw;
+#endif
+
+	while (i < log->nr) {
+		pw.nr = 0;
+		down_read(&mm->mmap_sem);
+		for (; i < log->nr && pw.nr < pw.size; i++) {
+			start = (log->run[i] >> NS_PF_RUN_BITS) << PAGE_SHIFT;
+			end = start + (((log->run[i] & NS_PF_RUN_MAX) + 1)
+				       << PAGE_SHIFT);
+			walk_page_range_hook(mm, start, end, &walk, &pw);
+		}
+		up_read(&mm->mmap_sem);
+
+		if (!pw.nr)
+			continue;
+
+		sort(pw.ents, pw.nr, sizeof(swp_entry_t), ns_swp_entry_cmp, NULL);
+		ns_prefetch_dispatch(pw.ents, pw.nr);
+		nsi.pf_pages += pw.nr;
+	}
+
+	mmput(mm);
+	nsi.pf_replay_cnt++;
+	nsi.pf_time_ms += div_u64(ktime_get_ns() - begin, NSEC_PER_MSEC);
+out:
+	kfree(pw.ents);
+}
+
 static ssize_t swapin_anon(struct task_struct *task)
 {
 	struct mm_struct *mm;
@@ -556,8 +1007,31 @@ static ssize_t swapin_anon(struct task_struct *task)
 	};
 #endif
 	struct ns_task_struct *ntask = NULL;
+	struct ns_fault_log *log = NULL;
 	int task_anon = 0, task_swap = 0, err = 0;
 
+	ntask = ns_task_lookup(task->pid);
+
+	if (ntask) {
+		spin_lock(&ntask->lock);
+		log = ntask->replay;
+		ntask->replay = NULL;
+		spin_unlock(&ntask->lock);
+	}
+
+	if (log) {
+		ns_prefetch_replay(task, log);
+
+		/* keep it for the next resume unless a newer one showed up */
+		spin_lock(&ntask->lock);
+		if (!ntask->replay) {
+			ntask->replay = log;
+			log = NULL;
+		}
+		spin_unlock(&ntask->lock);
+		kfree(log);
+	}
+
 retry:
 	/* TODO: do we need to use p = find_lock_task_mm(task); in case main thread got killed */
 	mm = get_task_mm(task);
@@ -616,11 +1090,6 @@ static ssize_t swapin_anon(struct task_struct *task)
 		task->comm, task->pid, task_anon, task_swap);
 #endif
 
-	spin_lock(&ns_tree_lock);
-	ntask = radix_tree_lookup(&ns_tree, task->pid);
-	if (ntask)
-		ns_get_task(ntask);
-	spin_unlock(&ns_tree_lock);
 	if (!ntask)
 		return 0;
 
@@ -749,6 +1218,30 @@ static int ns_reclaim_pte(pmd_t *pmd, unsigned long addr,
 	return 0;
 }
 
+/*
+ * Size the swap extent for a task in pages: large enough for its anon
+ * footprint, shrinking linearly as /data fragments, and off past
+ * extent_frag_high where contiguous runs are unlikely to exist anyway.
+ */
+static unsigned long ns_extent_pages(struct mm_struct *mm)
+{
+	int mb = READ_ONCE(extent_max_mb);
+	int low = READ_ONCE(extent_frag_low);
+	int high = READ_ONCE(extent_frag_high);
+	int frag = nsi.frag_score;
+	unsigned long limit;
+
+	if (mb <= 0 || frag >= high)
+		return 0;
+
+	limit = (unsigned long)mb << (20 - PAGE_SHIFT);
+	if (frag > low && high > low)
+		limit = limit * (high - frag) / (high - low);
+
+	return clamp_t(unsigned long, get_mm_counter(mm, MM_ANONPAGES),
+		       1, max(limit, 1UL));
+}
+
 /* get_task_struct before using this function */
 static ssize_t reclaim_anon(struct task_struct *task)
 {
@@ -770,11 +1263,7 @@ static ssize_t reclaim_anon(struct task_struct *task)
 	int a_task_anon = 0, a_task_swap = 0;
 #endif
 
-	spin_lock(&ns_tree_lock);
-	ntask = radix_tree_lookup(&ns_tree, task->pid);
-	if (ntask)
-		ns_get_task(ntask);
-	spin_unlock(&ns_tree_lock);
+	ntask = ns_task_lookup(task->pid);
 	if (!ntask)
 		return 0;
 
@@ -789,6 +1278,8 @@ static ssize_t reclaim_anon(struct task_struct *task)
 	ntask->state = NS_OUT_CACHE;
 	spin_unlock(&ntask->lock);
 
+	ns_fault_log_rotate(ntask);
+
 	/* TODO: do we need to use p = find_lock_task_mm(task); in case main thread got killed */
 	mm = get_task_mm(task);
 	if (!mm)
@@ -812,6 +1303,7 @@ static ssize_t reclaim_anon(struct task_struct *task)
 	reclaim_walk.pmd_entry = ns_reclaim_pte;
 #endif
 
+	nandswap_extent_begin(ns_extent_pages(mm));
 	down_read(&mm->mmap_sem);
 	for (vma = mm->mmap; vma; vma = vma->vm_next) {
 		if (is_vm_hugetlb_page(vma))
@@ -837,6 +1329,7 @@ static ssize_t reclaim_anon(struct task_struct *task)
 
 	flush_tlb_mm(mm);
 	up_read(&mm->mmap_sem);
+	nandswap_extent_end();
 #ifdef CONFIG_NANDSWAP_DEBUG
 	a_task_anon = get_mm_counter(mm, MM_ANONPAGES);
 	a_task_swap = get_mm_counter(mm, MM_SWAPENTS);
@@ -861,44 +1354,54 @@ static ssize_t reclaim_anon(struct task_struct *task)
 	return 0;
 }
 
+static struct task_struct *ns_find_get_task(pid_t pid)
+{
+	struct task_struct *task;
+
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+
+	return task;
+}
+
 //TODO: should we mark swapoutd/swapind freezable?
 static int swapoutd_fn(void *p)
 {
-	struct reclaim_data data;
+	struct ns_task_struct *batch[NS_BATCH];
 	struct task_struct *task;
+	int i, nr;
 
 	set_freezable();
 	for ( ; ; ) {
-		while (!pm_freezing && dequeue_reclaim_data(&data, &out_info)) {
-			rcu_read_lock();
-			task = find_task_by_vpid(data.pid);
-
-			/* KTHREAD is almost impossible to hit this */
-			//if (task->flags & PF_KTHREAD) {
-			//	rcu_read_unlock();
-			//	continue;
-			//}
-
-			if (!task) {
-				rcu_read_unlock();
-				continue;
+		while (!pm_freezing &&
+		       (nr = ns_task_batch(NS_MARK_OUT, batch))) {
+			for (i = 0; i < nr; i++) {
+				task = ns_find_get_task(batch[i]->pid);
+				if (!task) {
+					ns_put_task(batch[i]);
+					continue;
+				}
+
+				do {
+					msleep(30);
+				} while (nswapind && (nswapind->state == TASK_RUNNING));
+
+				reclaim_anon(task);
+				ns_task_queue(batch[i], NS_MARK_DROP);
+				put_task_struct(task);
+				ns_put_task(batch[i]);
 			}
-
-			get_task_struct(task);
-			rcu_read_unlock();
-
-			do {
-				msleep(30);
-			} while (nswapind && (nswapind->state == TASK_RUNNING));
-
-			reclaim_anon(task);
-			enqueue_reclaim_data(task->pid, &drop_info);
-			put_task_struct(task);
 		}
 
 		ns_life_ctrl_update(false);
 		set_current_state(TASK_INTERRUPTIBLE);
-		freezable_schedule();
+		if (!pm_freezing && xa_marked(&ns_tasks, NS_MARK_OUT))
+			__set_current_state(TASK_RUNNING);
+		else
+			freezable_schedule();
 
 		if (kthread_should_stop())
 			break;
@@ -983,11 +1486,7 @@ static bool drop_swapcache_task(struct task_struct *task)
 	int a_task_anon = 0, a_task_swap = 0;
 #endif
 
-	spin_lock(&ns_tree_lock);
-	ntask = radix_tree_lookup(&ns_tree, task->pid);
-	if (ntask)
-		ns_get_task(ntask);
-	spin_unlock(&ns_tree_lock);
+	ntask = ns_task_lookup(task->pid);
 	if (!ntask)
 		return retry;
 
@@ -1072,45 +1571,42 @@ static bool drop_swapcache_task(struct task_struct *task)
 
 static int swapdropd_fn(void *p)
 {
-	struct reclaim_data data;
+	struct ns_task_struct *batch[NS_BATCH];
 	struct task_struct *task;
 	bool retry;
+	int i, nr;
 
 	set_freezable();
 	for ( ; ; ) {
-		while (!pm_freezing && dequeue_reclaim_data(&data, &drop_info)) {
-			rcu_read_lock();
-			task = find_task_by_vpid(data.pid);
-
-			/* KTHREAD is almost impossible to hit this */
-			//if (task->flags & PF_KTHREAD) {
-			//	rcu_read_unlock();
-			//	continue;
-			//}
-
-			if (!task) {
-				rcu_read_unlock();
-				continue;
-			}
-
-			get_task_struct(task);
-			rcu_read_unlock();
-
-			do {
-				msleep(30);
-			} while (nswapind && (nswapind->state == TASK_RUNNING));
-
-			retry = drop_swapcache_task(task);
-			put_task_struct(task);
-
-			if (retry) {
-				enqueue_reclaim_data(task->pid, &drop_info);
-				msleep_interruptible(1000);
+		while (!pm_freezing &&
+		       (nr = ns_task_batch(NS_MARK_DROP, batch))) {
+			for (i = 0; i < nr; i++) {
+				task = ns_find_get_task(batch[i]->pid);
+				if (!task) {
+					ns_put_task(batch[i]);
+					continue;
+				}
+
+				do {
+					msleep(30);
+				} while (nswapind && (nswapind->state == TASK_RUNNING));
+
+				retry = drop_swapcache_task(task);
+				put_task_struct(task);
+
+				if (retry) {
+					ns_task_queue(batch[i], NS_MARK_DROP);
+					msleep_interruptible(1000);
+				}
+				ns_put_task(batch[i]);
 			}
 		}
 
 		set_current_state(TASK_INTERRUPTIBLE);
-		freezable_schedule();
+		if (!pm_freezing && xa_marked(&ns_tasks, NS_MARK_DROP))
+			__set_current_state(TASK_RUNNING);
+		else
+			freezable_schedule();
 
 		if (kthread_should_stop())
 			break;
@@ -1451,7 +1947,15 @@ static int stat_info_seq_show(struct seq_file *seq, void *offset)
 			"ns_pg_out_inact: %lld\n"
 			"pswpout: %llu\n"
 			"pswpin: %llu\n"
-			"ns_dev_life_end: %u\n",
+			"ns_dev_life_end: %u\n"
+			"ns_pf_logged: %lu\n"
+			"ns_pf_replay: %lu\n"
+			"ns_pf_pages: %lu\n"
+			"ns_pf_time_ms: %lu\n"
+			"ns_ext_picked: %lu\n"
+			"ns_ext_short: %lu\n"
+			"ns_ext_clusters: %lu\n"
+			"ns_ext_fallback: %lu\n",
 			nandswap_enable,
 			nsi.fn_status,
 			nsi.life_protect,
@@ -1466,7 +1970,15 @@ static int stat_info_seq_show(struct seq_file *seq, void *offset)
 			nsi.swap_out_pg_inact,
 			events[PSWPOUT],
 			events[PSWPIN],
-			nsi.dev_life_end);
+			nsi.dev_life_end,
+			nsi.pf_logged,
+			nsi.pf_replay_cnt,
+			nsi.pf_pages,
+			nsi.pf_time_ms,
+			nandswap_extent_stat.picked,
+			nandswap_extent_stat.short_runs,
+			nandswap_extent_stat.clusters,
+			nandswap_extent_stat.fallback);
 	return 0;
 }
 
@@ -1531,6 +2043,14 @@ static inline void ns_remove_proc_dir(void)
 
 static void nandswap_stop(void)
 {
+	int i;
+
+	for (i = 0; i < ns_pf_nr_streams; i++) {
+		kthread_stop(ns_pf_streams[i].thread);
+		ns_pf_streams[i].thread = NULL;
+	}
+	ns_pf_nr_streams = 0;
+
 	if (nswapoutd) {
 		kthread_stop(nswapoutd);
 		nswapoutd = NULL;
@@ -1545,6 +2065,25 @@ static void nandswap_stop(void)
 	}
 }
 
+static void ns_prefetch_init(void)
+{
+	struct task_struct *thread;
+	int i, nr = clamp(prefetch_streams, 0, NS_PF_MAX_STREAMS);
+
+	for (i = 0; i < nr; i++) {
+		init_waitqueue_head(&ns_pf_streams[i].wait);
+		thread = kthread_run(ns_pf_stream_fn, &ns_pf_streams[i],
+				     "nswapind/%d", i);
+		if (IS_ERR(thread)) {
+			pr_err("NandSwap: [%s] Failed to start prefetch stream %d\n",
+			       __func__, i);
+			break;
+		}
+		ns_pf_streams[i].thread = thread;
+		ns_pf_nr_streams++;
+	}
+}
+
 static int __init nandswap_init(void)
 {
 	//TODO: priority tuning for nswapoutd/nswapind
@@ -1572,6 +2111,7 @@ static int __init nandswap_init(void)
 		//	pr_warn("%s: failed to set SCHED_FIFO\n", __func__);
 		//}
 		//set_task_ioprio(nswapind, IOPRIO_CLASS_RT);
+		ns_prefetch_init();
 	}
 
 	profile_event_register(PROFILE_TASK_EXIT, &process_notifier_block);
@@ -5,6 +5,8 @@
  * Copyright (C) 2011 Google, Inc.
  */
 
+#include <linux/highmem.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
@@ -13,12 +15,42 @@
 #include "msm_ion_priv.h"
 #include "ion_msm_page_pool.h"
 
+/*
+ * Account a trip to buddy made on behalf of @pool. The cost is kept per
+ * page so pools of different orders can be compared by the shrinker; a
+ * failed attempt doubles it, as that order may not come back for a while.
+ */
+static void ion_msm_page_pool_note_refill(struct ion_msm_page_pool *pool,
+					  u64 start_ns, struct page *page)
+{
+	unsigned long cost = READ_ONCE(pool->refill_cost);
+	unsigned long sample;
+
+	if (!page) {
+		cost = max(cost, ION_POOL_DEFAULT_COST_NS) * 2;
+		WRITE_ONCE(pool->refill_cost, min(cost, ION_POOL_MAX_COST_NS));
+		return;
+	}
+
+	sample = (ktime_get_ns() - start_ns) >> pool->order;
+	cost = cost ? (cost * 7 + sample) / 8 : sample;
+	WRITE_ONCE(pool->refill_cost, min(cost, ION_POOL_MAX_COST_NS));
+	atomic_long_add(1 << pool->order, &pool->nr_refilled);
+}
+
 inline struct page
 *ion_msm_page_pool_alloc_pages(struct ion_msm_page_pool *pool)
 {
+	struct page *page;
+	u64 start;
+
 	if (fatal_signal_pending(current))
 		return NULL;
-	return alloc_pages(pool->gfp_mask, pool->order);
+
+	start = ktime_get_ns();
+	page = alloc_pages(pool->gfp_mask, pool->order);
+	ion_msm_page_pool_note_refill(pool, start, page);
+	return page;
 }
 
 static void ion_msm_page_pool_free_pages(struct ion_msm_page_pool *pool,
@@ -51,7 +83,7 @@ static void ion_msm_page_pool_add(struct ion_msm_page_pool *pool,
 	mutex_unlock(&pool->mutex);
 }
 
-#ifdef CONFIG_ION_POOL_AUTO_REFILL
+#if defined(CONFIG_ION_POOL_AUTO_REFILL) || defined(CONFIG_ION_POOL_PREZERO)
 /* do a simple check to see if we are in any low memory situation */
 static bool pool_refill_ok(struct ion_msm_page_pool *pool)
 {
@@ -86,7 +118,9 @@ static bool pool_refill_ok(struct ion_msm_page_pool *pool)
 
 	return true;
 }
+#endif
 
+#ifdef CONFIG_ION_POOL_AUTO_REFILL
 void ion_msm_page_pool_refill(struct ion_msm_page_pool *pool)
 {
 	struct page *page;
@@ -98,7 +132,10 @@ void ion_msm_page_pool_refill(struct ion_msm_page_pool *pool)
 		return;
 
 	while (!pool_fillmark_reached(pool) && pool_refill_ok(pool)) {
+		u64 start = ktime_get_ns();
+
 		page = alloc_pages(gfp_refill, pool->order);
+		ion_msm_page_pool_note_refill(pool, start, page);
 		if (!page)
 			break;
 		if (!pool->cached)
@@ -110,6 +147,116 @@ void ion_msm_page_pool_refill(struct ion_msm_page_pool *pool)
 }
 #endif /* CONFIG_ION_PAGE_POOL_REFILL */
 
+#ifdef CONFIG_ION_POOL_PREZERO
+static struct page *
+ion_msm_page_pool_remove_zeroed(struct ion_msm_page_pool *pool)
+{
+	struct page *page;
+
+	if (!pool->zero_count)
+		return NULL;
+
+	page = list_first_entry(&pool->zero_items, struct page, lru);
+	list_del(&page->lru);
+	pool->zero_count--;
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    -(1 << pool->order));
+	return page;
+}
+
+static struct page *
+ion_msm_page_pool_take_zeroed(struct ion_msm_page_pool *pool)
+{
+	struct page *page;
+
+	if (!READ_ONCE(pool->zero_count))
+		return NULL;
+
+	mutex_lock(&pool->mutex);
+	page = ion_msm_page_pool_remove_zeroed(pool);
+	if (page)
+		pool->zero_hits++;
+	mutex_unlock(&pool->mutex);
+
+	return page;
+}
+
+static void ion_msm_page_pool_drain_zeroed(struct ion_msm_page_pool *pool,
+					   int keep)
+{
+	struct page *page;
+
+	for (;;) {
+		mutex_lock(&pool->mutex);
+		page = pool->zero_count > keep ?
+			ion_msm_page_pool_remove_zeroed(pool) : NULL;
+		mutex_unlock(&pool->mutex);
+		if (!page)
+			break;
+		ion_msm_page_pool_free_pages(pool, page);
+	}
+}
+
+/*
+ * Top the pre-zeroed stock up to @target items. The pages come from buddy
+ * without __GFP_ZERO or reclaim and are cleared here, from the idle worker,
+ * so that a pool miss on the allocation path costs a list removal instead
+ * of clearing up to 2MB inline. Returns -EAGAIN when the zones are too low
+ * to fill the stock right now.
+ */
+int ion_msm_page_pool_prezero(struct ion_msm_page_pool *pool, int target)
+{
+	gfp_t gfp = (pool->gfp_mask & ~(__GFP_ZERO | __GFP_RECLAIM)) |
+		    __GFP_NOWARN | __GFP_NORETRY;
+	struct page *page;
+	int i;
+
+	WRITE_ONCE(pool->zero_target, target);
+	ion_msm_page_pool_drain_zeroed(pool, target);
+
+	while (READ_ONCE(pool->zero_count) < target) {
+		if (kthread_should_stop())
+			break;
+		if (!pool_refill_ok(pool))
+			return -EAGAIN;
+		page = alloc_pages(gfp, pool->order);
+		if (!page)
+			return -EAGAIN;
+		/* the zeroing below is idle time, only count the page */
+		atomic_long_add(1 << pool->order, &pool->nr_refilled);
+
+		for (i = 0; i < (1 << pool->order); i++) {
+			clear_highpage(page + i);
+			cond_resched();
+		}
+		if (!pool->cached)
+			ion_pages_sync_for_device(pool->heap_dev, page,
+						  PAGE_SIZE << pool->order,
+						  DMA_BIDIRECTIONAL);
+
+		mutex_lock(&pool->mutex);
+		list_add_tail(&page->lru, &pool->zero_items);
+		pool->zero_count++;
+		mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+				    (1 << pool->order));
+		mutex_unlock(&pool->mutex);
+	}
+
+	return 0;
+}
+#else
+static inline struct page *
+ion_msm_page_pool_take_zeroed(struct ion_msm_page_pool *pool)
+{
+	return NULL;
+}
+
+static inline void ion_msm_page_pool_drain_zeroed(struct ion_msm_page_pool *pool,
+						  int keep)
+{
+}
+#endif /* CONFIG_ION_POOL_PREZERO */
+
 static struct page *ion_msm_page_pool_remove(struct ion_msm_page_pool *pool,
 					     bool high)
 {
@@ -149,6 +296,9 @@ struct page *ion_msm_page_pool_alloc(struct ion_msm_page_pool *pool,
 		return ERR_PTR(-EINTR);
 
 	if (*from_pool) {
+		/* a request the pool may serve keeps it young, hit or miss */
+		WRITE_ONCE(pool->last_used, jiffies);
+
 		if (pool->boost_flag) {
 			mutex_lock(&pool->mutex);
 			if (pool->high_count)
@@ -165,6 +315,9 @@ struct page *ion_msm_page_pool_alloc(struct ion_msm_page_pool *pool,
 		}
 	}
 
+	if (!page && *from_pool && !(pool->boost_flag))
+		page = ion_msm_page_pool_take_zeroed(pool);
+
 	if (!page && !(pool->boost_flag)) {
 		page = ion_msm_page_pool_alloc_pages(pool);
 		*from_pool = false;
@@ -185,6 +338,8 @@ struct page *ion_msm_page_pool_alloc_pool_only(struct ion_msm_page_pool *pool)
 	if (!pool)
 		return ERR_PTR(-EINVAL);
 
+	WRITE_ONCE(pool->last_used, jiffies);
+
 	if (mutex_trylock(&pool->mutex)) {
 		if (pool->high_count)
 			page = ion_msm_page_pool_remove(pool, true);
@@ -215,10 +370,36 @@ int ion_msm_page_pool_total(struct ion_msm_page_pool *pool, bool high)
 
 	if (high)
 		count += pool->high_count;
+	count += pool_zero_count(pool);
 
 	return count << pool->order;
 }
 
+/*
+ * What one page of this pool is worth keeping: the cost of getting it back
+ * from buddy, weighted up with the order since high-order blocks are the
+ * first to become unavailable once memory fragments, and halved for every
+ * @age_ms the pool went without being asked for a page.
+ */
+unsigned long ion_msm_page_pool_value(struct ion_msm_page_pool *pool,
+				      unsigned int age_ms)
+{
+	unsigned long cost = READ_ONCE(pool->refill_cost);
+	unsigned int idle_ms, halvings = 0;
+
+	if (!cost)
+		cost = ION_POOL_DEFAULT_COST_NS;
+	cost *= pool->order + 1;
+
+	if (age_ms) {
+		idle_ms = jiffies_to_msecs(jiffies - READ_ONCE(pool->last_used));
+		halvings = min_t(unsigned int, idle_ms / age_ms,
+				 BITS_PER_LONG - 1);
+	}
+
+	return cost >> halvings;
+}
+
 int ion_msm_page_pool_shrink(struct ion_msm_page_pool *pool, gfp_t gfp_mask,
 			     int nr_to_scan)
 {
@@ -233,6 +414,21 @@ int ion_msm_page_pool_shrink(struct ion_msm_page_pool *pool, gfp_t gfp_mask,
 	if (nr_to_scan == 0)
 		return ion_msm_page_pool_total(pool, high);
 
+#ifdef CONFIG_ION_POOL_PREZERO
+	/* the pre-zeroed stock has never been handed out, give it up first */
+	while (freed < nr_to_scan) {
+		struct page *page;
+
+		mutex_lock(&pool->mutex);
+		page = ion_msm_page_pool_remove_zeroed(pool);
+		mutex_unlock(&pool->mutex);
+		if (!page)
+			break;
+		ion_msm_page_pool_free_pages(pool, page);
+		freed += (1 << pool->order);
+	}
+#endif
+
 	while (freed < nr_to_scan) {
 		struct page *page;
 
@@ -250,6 +446,7 @@ int ion_msm_page_pool_shrink(struct ion_msm_page_pool *pool, gfp_t gfp_mask,
 		freed += (1 << pool->order);
 	}
 
+	atomic_long_add(freed, &pool->nr_reclaimed);
 	return freed;
 }
 
@@ -263,8 +460,12 @@ struct ion_msm_page_pool *ion_msm_page_pool_create(gfp_t gfp_mask,
 		return NULL;
 	INIT_LIST_HEAD(&pool->low_items);
 	INIT_LIST_HEAD(&pool->high_items);
+#ifdef CONFIG_ION_POOL_PREZERO
+	INIT_LIST_HEAD(&pool->zero_items);
+#endif
 	pool->gfp_mask = gfp_mask;
 	pool->order = order;
+	pool->last_used = jiffies;
 	mutex_init(&pool->mutex);
 	plist_node_init(&pool->list, order);
 	if (cached)
@@ -275,5 +476,6 @@ struct ion_msm_page_pool *ion_msm_page_pool_create(gfp_t gfp_mask,
 
 void ion_msm_page_pool_destroy(struct ion_msm_page_pool *pool)
 {
+	ion_msm_page_pool_drain_zeroed(pool, 0);
 	kfree(pool);
 }
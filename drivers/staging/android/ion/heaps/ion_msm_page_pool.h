@@ -26,6 +26,10 @@
 /* if low watermark of zones have reached, defer the refill in this window */
 #define ION_POOL_REFILL_DEFER_WINDOW_MS	10
 
+/* refill cost assumed for a pool before its first trip to buddy */
+#define ION_POOL_DEFAULT_COST_NS	1000UL
+#define ION_POOL_MAX_COST_NS		(1000UL * NSEC_PER_USEC)
+
 /**
  * functions for creating and destroying a heap pool -- allows you
  * to keep a pool of pre allocated memory to use from your heap.  Keeping
@@ -50,6 +54,15 @@
  * @list:		plist node for list of pools
  * @cached:		it's cached pool or not
  * @heap_dev:		device for the ion heap associated with this pool
+ * @last_used:		jiffies of the last allocation that asked this pool
+ * @refill_cost:	moving average of the ns per page it took to get pages
+ *			for this pool from buddy, doubled on every failure
+ * @nr_reclaimed:	pages given back to buddy by the shrinker
+ * @nr_refilled:	pages taken from buddy on behalf of this pool
+ * @zero_count:		number of items in the pre-zeroed stock
+ * @zero_target:	number of items the pre-zero worker keeps in the stock
+ * @zero_hits:		allocations served from the pre-zeroed stock
+ * @zero_items:		pages zeroed ahead of time by the pre-zero worker
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -70,6 +83,16 @@ struct ion_msm_page_pool {
 	struct plist_node list;
 	bool cached;
 	struct device *heap_dev;
+	unsigned long last_used;
+	unsigned long refill_cost;
+	atomic_long_t nr_reclaimed;
+	atomic_long_t nr_refilled;
+#ifdef CONFIG_ION_POOL_PREZERO
+	int zero_count;
+	int zero_target;
+	unsigned long zero_hits;
+	struct list_head zero_items;
+#endif
 };
 
 struct ion_msm_page_pool *ion_msm_page_pool_create(gfp_t gfp_mask,
@@ -87,6 +110,9 @@ size_t ion_system_heap_secure_page_pool_total(struct ion_heap *heap, int vmid);
 
 inline struct page *ion_msm_page_pool_alloc_pages(struct ion_msm_page_pool *pool);
 
+unsigned long ion_msm_page_pool_value(struct ion_msm_page_pool *pool,
+				      unsigned int age_ms);
+
 /** ion_msm_page_pool_shrink - shrinks the size of the memory cached in the pool
  * @pool:		the pool
  * @gfp_mask:		the memory type to reclaim
@@ -97,6 +123,38 @@ inline struct page *ion_msm_page_pool_alloc_pages(struct ion_msm_page_pool *pool
 int ion_msm_page_pool_shrink(struct ion_msm_page_pool *pool, gfp_t gfp_mask,
 			     int nr_to_scan);
 
+#ifdef CONFIG_ION_POOL_PREZERO
+int ion_msm_page_pool_prezero(struct ion_msm_page_pool *pool, int target);
+
+static __always_inline bool
+pool_zero_stock_low(struct ion_msm_page_pool *pool)
+{
+	return READ_ONCE(pool->zero_count) < READ_ONCE(pool->zero_target) / 2;
+}
+
+static __always_inline int pool_zero_count(struct ion_msm_page_pool *pool)
+{
+	return READ_ONCE(pool->zero_count);
+}
+#else
+static inline int ion_msm_page_pool_prezero(struct ion_msm_page_pool *pool,
+					    int target)
+{
+	return 0;
+}
+
+static __always_inline bool
+pool_zero_stock_low(struct ion_msm_page_pool *pool)
+{
+	return false;
+}
+
+static __always_inline int pool_zero_count(struct ion_msm_page_pool *pool)
+{
+	return 0;
+}
+#endif /* CONFIG_ION_POOL_PREZERO */
+
 #ifdef CONFIG_ION_POOL_AUTO_REFILL
 void ion_msm_page_pool_refill(struct ion_msm_page_pool *pool);
 
@@ -12,12 +12,16 @@
 #include <linux/err.h>
 #include <linux/highmem.h>
 #include <linux/ion.h>
+#include <linux/list_sort.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/sched.h>
+#include <linux/sched/topology.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/sched/types.h>
 #include <linux/seq_file.h>
 #include <soc/qcom/secure_buffer.h>
@@ -41,6 +45,51 @@ IS_ENABLED(CONFIG_ION_POOL_AUTO_REFILL);
 
 static bool valid_vmids[VMID_LAST];
 
+/* a pool loses half its value for every pool_age_ms it goes unused */
+static unsigned int pool_age_ms __read_mostly = ION_POOL_AGE_DEFAULT_MS;
+module_param(pool_age_ms, uint, 0644);
+MODULE_PARM_DESC(pool_age_ms, "Idle time in ms that halves the value of a pool to the shrinker, 0 to ignore age");
+
+#ifdef CONFIG_ION_POOL_PREZERO
+static struct task_struct *prezero_task;
+
+static bool prezero_enable __read_mostly = true;
+static unsigned int prezero_mb __read_mostly = ION_PREZERO_DEFAULT_MB;
+
+static int prezero_param_set(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (!ret && prezero_task)
+		wake_up_process(prezero_task);
+	return ret;
+}
+
+static int prezero_enable_set(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (!ret && prezero_task)
+		wake_up_process(prezero_task);
+	return ret;
+}
+
+static const struct kernel_param_ops prezero_mb_ops = {
+	.set = prezero_param_set,
+	.get = param_get_uint,
+};
+
+static const struct kernel_param_ops prezero_enable_ops = {
+	.set = prezero_enable_set,
+	.get = param_get_bool,
+};
+
+module_param_cb(prezero_enable, &prezero_enable_ops, &prezero_enable, 0644);
+MODULE_PARM_DESC(prezero_enable, "Keep a background-zeroed page stock in the system heap pools");
+module_param_cb(prezero_mb, &prezero_mb_ops, &prezero_mb, 0644);
+MODULE_PARM_DESC(prezero_mb, "Size of the pre-zeroed stock in MB, split across the cached and uncached pools");
+#endif /* CONFIG_ION_POOL_PREZERO */
+
 int order_to_index(unsigned int order)
 {
 	int i;
@@ -148,6 +197,11 @@ static struct page *alloc_buffer_page(struct ion_msm_system_heap *sys_heap,
 	    pool_count_below_lowmark(pool) && vmid <= 0)
 		wake_up_process(sys_heap->kworker[cached]);
 
+#ifdef CONFIG_ION_POOL_PREZERO
+	if (prezero_task && vmid <= 0 && pool_zero_stock_low(pool))
+		wake_up_process(prezero_task);
+#endif
+
 	if (IS_ERR(page))
 		return page;
 
@@ -292,6 +346,160 @@ alloc_from_pool_preferred(struct ion_msm_system_heap *heap,
 	return alloc_largest_available(heap, buffer, size, max_order);
 }
 
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+static unsigned int parallel_alloc_mb __read_mostly =
+	ION_PARALLEL_ALLOC_DEFAULT_MB;
+module_param(parallel_alloc_mb, uint, 0644);
+MODULE_PARM_DESC(parallel_alloc_mb, "Split system heap allocations of at least this many MB across clusters, 0 to disable");
+
+struct ion_alloc_chunk {
+	struct work_struct work;
+	struct ion_msm_system_heap *sys_heap;
+	struct ion_buffer *buffer;
+	unsigned long size;
+	unsigned long filled;
+	struct list_head pages;
+	struct list_head pages_from_pool;
+	int nents;
+	unsigned int nents_sync;
+};
+
+/*
+ * Same walk as the serial loop in ion_msm_system_heap_allocate(), over a
+ * slice of the buffer. A chunk that runs out of memory simply stops; the
+ * caller fills whatever is left serially or unwinds the whole buffer.
+ */
+static void ion_alloc_chunk_fill(struct ion_alloc_chunk *chunk)
+{
+	unsigned long remaining = chunk->size;
+	unsigned int max_order = orders[0];
+	struct page_info *info;
+
+	while (remaining > 0) {
+		info = alloc_largest_available(chunk->sys_heap, chunk->buffer,
+					       remaining, max_order);
+		if (IS_ERR(info))
+			break;
+
+#ifdef CONFIG_MM_STAT_UNRECLAIMABLE_PAGES
+		mod_node_page_state(page_pgdat(info->page),
+				    NR_UNRECLAIMABLE_PAGES,
+				    (1 << (info->order)));
+#endif
+
+		if (info->from_pool) {
+			list_add_tail(&info->list, &chunk->pages_from_pool);
+		} else {
+			list_add_tail(&info->list, &chunk->pages);
+			chunk->nents_sync++;
+		}
+		remaining -= order_to_size(info->order);
+		max_order = info->order;
+		chunk->nents++;
+	}
+
+	chunk->filled = chunk->size - remaining;
+}
+
+static void ion_alloc_chunk_work(struct work_struct *work)
+{
+	ion_alloc_chunk_fill(container_of(work, struct ion_alloc_chunk, work));
+}
+
+/*
+ * Fill up to @size bytes of a large buffer from several clusters at once.
+ * The calling thread takes the first chunk on its own cluster and the
+ * first online CPU of every other cluster takes one more. All workers draw
+ * from the heap's shared pools, so the win comes from zeroing the pages
+ * that miss them on several CPUs. Returns the number of bytes allocated;
+ * the pages are appended to @pages and @pages_from_pool.
+ */
+static unsigned long
+ion_msm_system_heap_alloc_parallel(struct ion_msm_system_heap *sys_heap,
+				   struct ion_buffer *buffer,
+				   unsigned long size,
+				   struct list_head *pages,
+				   struct list_head *pages_from_pool,
+				   int *nents, unsigned int *nents_sync)
+{
+	struct ion_alloc_chunk *chunks, *chunk;
+	int cpus[ION_MAX_ALLOC_CHUNKS];
+	unsigned long chunk_size, assigned = 0, filled = 0;
+	int this_cpu = raw_smp_processor_id();
+	int nr = 0, cpu, i;
+
+	cpus[nr++] = this_cpu;
+	for_each_online_cpu(cpu) {
+		const struct cpumask *cluster = topology_core_cpumask(cpu);
+
+		if (nr == ION_MAX_ALLOC_CHUNKS)
+			break;
+		if (cpumask_test_cpu(this_cpu, cluster))
+			continue;
+		if (cpumask_first_and(cluster, cpu_online_mask) != cpu)
+			continue;
+		cpus[nr++] = cpu;
+	}
+	if (nr == 1)
+		return 0;
+
+	chunks = kcalloc(nr, sizeof(*chunks), GFP_KERNEL);
+	if (!chunks)
+		return 0;
+
+	/* whole largest-order blocks per chunk keep the order preference */
+	chunk_size = ALIGN(DIV_ROUND_UP(size, nr), order_to_size(orders[0]));
+	for (i = 0; i < nr; i++) {
+		chunk = &chunks[i];
+		chunk->sys_heap = sys_heap;
+		chunk->buffer = buffer;
+		chunk->size = min(chunk_size, size - assigned);
+		assigned += chunk->size;
+		INIT_LIST_HEAD(&chunk->pages);
+		INIT_LIST_HEAD(&chunk->pages_from_pool);
+		INIT_WORK(&chunk->work, ion_alloc_chunk_work);
+		if (i && chunk->size)
+			queue_work_on(cpus[i], sys_heap->alloc_wq, &chunk->work);
+	}
+
+	ion_alloc_chunk_fill(&chunks[0]);
+
+	for (i = 0; i < nr; i++) {
+		chunk = &chunks[i];
+		if (i && chunk->size)
+			flush_work(&chunk->work);
+		list_splice_tail(&chunk->pages, pages);
+		list_splice_tail(&chunk->pages_from_pool, pages_from_pool);
+		*nents += chunk->nents;
+		*nents_sync += chunk->nents_sync;
+		filled += chunk->filled;
+	}
+
+	kfree(chunks);
+	return filled;
+}
+
+static bool ion_parallel_alloc_ok(struct ion_msm_system_heap *sys_heap,
+				  unsigned long size, int vmid)
+{
+	unsigned int mb = READ_ONCE(parallel_alloc_mb);
+
+	/* secure buffers go through alloc_from_pool_preferred() instead */
+	return sys_heap->alloc_wq && mb && vmid <= 0 &&
+		size >= ((unsigned long)mb << 20);
+}
+
+/* highest order first, as the serial loop leaves the lists */
+static int page_info_order_cmp(void *priv, struct list_head *a,
+			       struct list_head *b)
+{
+	struct page_info *ia = list_entry(a, struct page_info, list);
+	struct page_info *ib = list_entry(b, struct page_info, list);
+
+	return (int)ib->order - (int)ia->order;
+}
+#endif /* CONFIG_ION_PARALLEL_ALLOC */
+
 static void process_info(struct page_info *info,
 			 struct scatterlist *sg,
 			 struct scatterlist *sg_sync)
@@ -372,6 +580,9 @@ static int ion_msm_system_heap_allocate(struct ion_heap *heap,
 	unsigned int max_order = orders[0];
 	unsigned int sz;
 	int vmid = get_secure_vmid(buffer->flags);
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+	bool parallel = false;
+#endif
 
 #ifdef CONFIG_OPLUS_ION_BOOSTPOOL
 	unsigned int alloc_sz = 0;
@@ -438,6 +649,8 @@ static int ion_msm_system_heap_allocate(struct ion_heap *heap,
 		}
 		max_order = orders[0];
 		boost_pool_dec_high(boost_pool, alloc_sz >> PAGE_SHIFT);
+		boost_pool_account(boost_pool, alloc_sz >> PAGE_SHIFT,
+				   size_remaining >> PAGE_SHIFT);
 #ifdef BOOSTPOOL_DEBUG
 		if (size_remaining != 0) {
 			pr_info("boostpool %s alloc failed. alloc_sz: %d size: %d orders(%d, %d, %d) %d ms\n",
@@ -450,6 +663,18 @@ static int ion_msm_system_heap_allocate(struct ion_heap *heap,
 	}
 #endif /* CONFIG_OPLUS_ION_BOOSTPOOL */
 
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+	if (ion_parallel_alloc_ok(sys_heap, size_remaining, vmid)) {
+		size_remaining -=
+			ion_msm_system_heap_alloc_parallel(sys_heap, buffer,
+							   size_remaining,
+							   &pages,
+							   &pages_from_pool,
+							   &i, &nents_sync);
+		parallel = true;
+	}
+#endif
+
 	while (size_remaining > 0) {
 		if (is_secure_vmid_valid(vmid))
 			info = alloc_from_pool_preferred(sys_heap, buffer,
@@ -484,6 +709,14 @@ static int ion_msm_system_heap_allocate(struct ion_heap *heap,
 		i++;
 	}
 
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+	/* chunks and the serial tail each run high to low, merge them */
+	if (parallel) {
+		list_sort(NULL, &pages, page_info_order_cmp);
+		list_sort(NULL, &pages_from_pool, page_info_order_cmp);
+	}
+#endif
+
 	table = kzalloc(sizeof(*table), GFP_KERNEL);
 	if (!table) {
 		ret = -ENOMEM;
@@ -622,13 +855,65 @@ static void ion_msm_system_heap_free(struct ion_buffer *buffer)
 	kfree(buffer->priv_virt);
 }
 
+/* the most valuable of the pools kept for one order */
+static unsigned long ion_order_value(struct ion_msm_system_heap *sys_heap,
+				     int i)
+{
+	unsigned int age_ms = READ_ONCE(pool_age_ms);
+	unsigned long value;
+
+	value = max(ion_msm_page_pool_value(sys_heap->uncached_pools[i],
+					    age_ms),
+		    ion_msm_page_pool_value(sys_heap->cached_pools[i],
+					    age_ms));
+#ifdef CONFIG_OPLUS_ION_BOOSTPOOL
+	if (sys_heap->gr_pool)
+		value = max(value,
+			    ion_msm_page_pool_value(sys_heap->gr_pool->pools[i],
+						    age_ms));
+	if (sys_heap->cam_pool)
+		value = max(value,
+			    ion_msm_page_pool_value(sys_heap->cam_pool->pools[i],
+						    age_ms));
+#endif /* CONFIG_OPLUS_ION_BOOSTPOOL */
+
+	return value;
+}
+
+/*
+ * Order the pool orders by ascending value, so the shrinker gives up cold
+ * and cheap-to-rebuild pages first and reaches hot high-order pools last.
+ * With no history this is lowest order first, as it always was.
+ */
+static void ion_shrink_order(struct ion_msm_system_heap *sys_heap,
+			     int *idx)
+{
+	unsigned long value[NUM_ORDERS];
+	int i, j, tmp;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		value[i] = ion_order_value(sys_heap, i);
+		idx[i] = i;
+	}
+
+	for (i = 1; i < NUM_ORDERS; i++) {
+		tmp = idx[i];
+		for (j = i; j > 0 && (value[idx[j - 1]] > value[tmp] ||
+				      (value[idx[j - 1]] == value[tmp] &&
+				       idx[j - 1] < tmp)); j--)
+			idx[j] = idx[j - 1];
+		idx[j] = tmp;
+	}
+}
+
 static int ion_msm_system_heap_shrink(struct ion_heap *heap, gfp_t gfp_mask,
 				      int nr_to_scan)
 {
 	struct ion_msm_system_heap *sys_heap;
 	int nr_total = 0;
-	int i, j, nr_freed = 0;
+	int i, j, k, nr_freed = 0;
 	int only_scan = 0;
+	int idx[NUM_ORDERS];
 	struct ion_msm_page_pool *pool;
 #ifdef CONFIG_OPLUS_ION_BOOSTPOOL
 	struct ion_boost_pool *boost_pool;
@@ -639,8 +924,11 @@ static int ion_msm_system_heap_shrink(struct ion_heap *heap, gfp_t gfp_mask,
 	if (!nr_to_scan)
 		only_scan = 1;
 
-	/* shrink the pools starting from lower order ones */
-	for (i = NUM_ORDERS - 1; i >= 0; i--) {
+	ion_shrink_order(sys_heap, idx);
+
+	/* shrink the pools starting from the least valuable order */
+	for (k = 0; k < NUM_ORDERS; k++) {
+		i = idx[k];
 		nr_freed = 0;
 
 #ifdef CONFIG_OPLUS_ION_BOOSTPOOL
@@ -702,6 +990,8 @@ static long ion_msm_system_heap_get_pool_size(struct ion_heap *heap)
 				pool->high_count;
 		total_size += (1 << pool->order) *
 				pool->low_count;
+		total_size += (1 << pool->order) *
+				pool_zero_count(pool);
 	}
 
 	for (i = 0; i < NUM_ORDERS; i++) {
@@ -710,6 +1000,8 @@ static long ion_msm_system_heap_get_pool_size(struct ion_heap *heap)
 				pool->high_count;
 		total_size += (1 << pool->order) *
 				pool->low_count;
+		total_size += (1 << pool->order) *
+				pool_zero_count(pool);
 	}
 
 	for (i = 0; i < NUM_ORDERS; i++) {
@@ -759,12 +1051,29 @@ static int ion_msm_system_heap_debug_show(struct ion_heap *heap,
 				   pool->low_count, pool->order,
 				   (1 << pool->order) * PAGE_SIZE *
 					pool->low_count);
+#ifdef CONFIG_ION_POOL_PREZERO
+			seq_printf(s,
+				   "%d order %u pre-zeroed pages in uncached pool = %lu total, %lu hits\n",
+				   pool_zero_count(pool), pool->order,
+				   (1 << pool->order) * PAGE_SIZE *
+					pool_zero_count(pool),
+				   pool->zero_hits);
+#endif
+			seq_printf(s,
+				   "order %u uncached pool: reclaimed %ld refilled %ld pages, refill cost %lu ns/page, idle %u ms\n",
+				   pool->order,
+				   atomic_long_read(&pool->nr_reclaimed),
+				   atomic_long_read(&pool->nr_refilled),
+				   READ_ONCE(pool->refill_cost),
+				   jiffies_to_msecs(jiffies - pool->last_used));
 		}
 
 		uncached_total += (1 << pool->order) * PAGE_SIZE *
 			pool->high_count;
 		uncached_total += (1 << pool->order) * PAGE_SIZE *
 			pool->low_count;
+		uncached_total += (1 << pool->order) * PAGE_SIZE *
+			pool_zero_count(pool);
 	}
 
 	for (i = 0; i < NUM_ORDERS; i++) {
@@ -780,12 +1089,29 @@ static int ion_msm_system_heap_debug_show(struct ion_heap *heap,
 				   pool->low_count, pool->order,
 				   (1 << pool->order) * PAGE_SIZE *
 					pool->low_count);
+#ifdef CONFIG_ION_POOL_PREZERO
+			seq_printf(s,
+				   "%d order %u pre-zeroed pages in cached pool = %lu total, %lu hits\n",
+				   pool_zero_count(pool), pool->order,
+				   (1 << pool->order) * PAGE_SIZE *
+					pool_zero_count(pool),
+				   pool->zero_hits);
+#endif
+			seq_printf(s,
+				   "order %u cached pool: reclaimed %ld refilled %ld pages, refill cost %lu ns/page, idle %u ms\n",
+				   pool->order,
+				   atomic_long_read(&pool->nr_reclaimed),
+				   atomic_long_read(&pool->nr_refilled),
+				   READ_ONCE(pool->refill_cost),
+				   jiffies_to_msecs(jiffies - pool->last_used));
 		}
 
 		cached_total += (1 << pool->order) * PAGE_SIZE *
 			pool->high_count;
 		cached_total += (1 << pool->order) * PAGE_SIZE *
 			pool->low_count;
+		cached_total += (1 << pool->order) * PAGE_SIZE *
+			pool_zero_count(pool);
 	}
 
 	for (i = 0; i < NUM_ORDERS; i++) {
@@ -937,6 +1263,120 @@ static struct task_struct *ion_create_kworker(struct ion_msm_page_pool **pools,
 	return thread;
 }
 
+#ifdef CONFIG_ION_POOL_PREZERO
+static int prezero_target(unsigned int order)
+{
+	unsigned long bytes;
+
+	if (!READ_ONCE(prezero_enable))
+		return 0;
+
+	/* never hold more than 1/16th of RAM idle, whatever was asked for */
+	bytes = min((unsigned long)READ_ONCE(prezero_mb) << 20,
+		    (totalram_pages() << PAGE_SHIFT) / 16);
+	/* split evenly between the cached and uncached pools of each order */
+	bytes /= 2 * NUM_ORDERS;
+	return bytes / order_to_size(order);
+}
+
+static bool prezero_stock_low(struct ion_msm_system_heap *sys_heap)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (pool_zero_count(sys_heap->uncached_pools[i]) !=
+		    prezero_target(orders[i]) ||
+		    pool_zero_count(sys_heap->cached_pools[i]) !=
+		    prezero_target(orders[i]))
+			return true;
+	}
+
+	return false;
+}
+
+static int ion_msm_prezero_worker(void *data)
+{
+	struct ion_msm_system_heap *sys_heap = data;
+	long timeout;
+	int i, target;
+
+	for (;;) {
+		timeout = MAX_SCHEDULE_TIMEOUT;
+		/* the largest orders save the most zeroing, fill them first */
+		for (i = 0; i < NUM_ORDERS; i++) {
+			target = prezero_target(orders[i]);
+			if (ion_msm_page_pool_prezero(sys_heap->uncached_pools[i],
+						      target) ||
+			    ion_msm_page_pool_prezero(sys_heap->cached_pools[i],
+						      target))
+				timeout = msecs_to_jiffies(ION_PREZERO_RETRY_MS);
+		}
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (unlikely(kthread_should_stop())) {
+			set_current_state(TASK_RUNNING);
+			break;
+		}
+		/* an allocation may have drained the stock while we filled */
+		if (timeout == MAX_SCHEDULE_TIMEOUT &&
+		    prezero_stock_low(sys_heap)) {
+			set_current_state(TASK_RUNNING);
+			continue;
+		}
+		schedule_timeout(timeout);
+
+		set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+/*
+ * Zeroing is pure CPU work that nobody waits on, so keep it on the
+ * lowest-capacity CPUs and only let it run when they are otherwise idle.
+ */
+static struct task_struct *
+ion_create_prezero_worker(struct ion_msm_system_heap *sys_heap)
+{
+	struct sched_attr attr = { .sched_policy = SCHED_IDLE };
+	unsigned long cap, min_cap = ULONG_MAX;
+	struct task_struct *thread;
+	cpumask_var_t mask;
+	int cpu, ret;
+
+	thread = kthread_create(ion_msm_prezero_worker, sys_heap,
+				"ion-prezero");
+	if (IS_ERR(thread)) {
+		pr_err("%s: failed to create prezero thread: %ld\n",
+		       __func__, PTR_ERR(thread));
+		return thread;
+	}
+
+	ret = sched_setattr(thread, &attr);
+	if (ret) {
+		kthread_stop(thread);
+		pr_warn("%s: failed to set SCHED_IDLE for prezero thread: ret = %d\n",
+			__func__, ret);
+		return ERR_PTR(ret);
+	}
+
+	if (zalloc_cpumask_var(&mask, GFP_KERNEL)) {
+		for_each_possible_cpu(cpu)
+			min_cap = min(min_cap, arch_scale_cpu_capacity(cpu));
+		for_each_possible_cpu(cpu) {
+			cap = arch_scale_cpu_capacity(cpu);
+			if (cap == min_cap)
+				cpumask_set_cpu(cpu, mask);
+		}
+		set_cpus_allowed_ptr(thread, mask);
+		free_cpumask_var(mask);
+	}
+
+	wake_up_process(thread);
+	return thread;
+}
+#endif /* CONFIG_ION_POOL_PREZERO */
+
 struct ion_heap *ion_msm_system_heap_create(struct ion_platform_heap *data)
 {
 	struct ion_msm_system_heap *heap;
@@ -986,6 +1426,24 @@ struct ion_heap *ion_msm_system_heap_create(struct ion_platform_heap *data)
 		}
 	}
 
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+	/* without the workqueue every allocation just stays serial */
+	heap->alloc_wq = alloc_workqueue("ion_parallel_alloc",
+					 WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!heap->alloc_wq)
+		pr_warn("%s: parallel allocation disabled\n", __func__);
+#endif
+
+#ifdef CONFIG_ION_POOL_PREZERO
+	/* the stock is an optimisation, the heap works fine without it */
+	if (!prezero_task) {
+		struct task_struct *thread = ion_create_prezero_worker(heap);
+
+		if (!IS_ERR(thread))
+			prezero_task = thread;
+	}
+#endif
+
 #ifdef CONFIG_OPLUS_ION_BOOSTPOOL
 	if (kcrit_scene_init()) {
 		boost_root_dir = proc_mkdir("boost_pool", NULL);
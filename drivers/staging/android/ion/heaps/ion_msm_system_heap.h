@@ -22,6 +22,20 @@ static const unsigned int orders[] = {0};
 
 #define ION_KTHREAD_NICE_VAL 10
 
+#define ION_POOL_AGE_DEFAULT_MS	1000
+
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+/* one chunk for the caller's cluster plus one per other cluster */
+#define ION_MAX_ALLOC_CHUNKS	4
+#define ION_PARALLEL_ALLOC_DEFAULT_MB	64
+#endif
+
+#ifdef CONFIG_ION_POOL_PREZERO
+#define ION_PREZERO_DEFAULT_MB	64
+/* how long to back off when the zones are too low to fill the stock */
+#define ION_PREZERO_RETRY_MS	1000
+#endif
+
 #define to_msm_system_heap(_heap) \
 	container_of(to_msm_ion_heap(_heap), struct ion_msm_system_heap, heap)
 
@@ -43,6 +57,10 @@ struct ion_msm_system_heap {
 #ifdef CONFIG_OPLUS_ION_BOOSTPOOL
 	struct ion_boost_pool *gr_pool, *cam_pool;
 #endif /* CONFIG_OPLUS_ION_BOOSTPOOL */
+#ifdef CONFIG_ION_PARALLEL_ALLOC
+	/* per-cpu workers that fill chunks of large allocations */
+	struct workqueue_struct *alloc_wq;
+#endif
 };
 
 struct page_info {
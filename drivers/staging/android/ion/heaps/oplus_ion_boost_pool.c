@@ -21,6 +21,8 @@
 #include <linux/mm.h>
 #include <linux/ion.h>
 #include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/healthinfo/fg.h>
 #include <uapi/linux/sched/types.h>
 #include <../../../../../kernel/sched/sched.h>
 
@@ -35,6 +37,7 @@
 #define M(x) (K(x) >> 10)
 
 static bool boost_pool_enable = true;
+static bool boost_pool_predict = true;
 static void kcrit_scene_wakeup_lmkd(void);
 
 static inline unsigned int order_to_size(int order)
@@ -110,11 +113,174 @@ void boost_pool_dump(struct ion_boost_pool *pool)
 	}
 }
 
+/*
+ * Scene predictor. A scene lasts while one uid stays in the foreground,
+ * or from a high watermark write to its reset. For each uid we learn how
+ * many pages its scenes take from the pool, weighted to recent scenes,
+ * and when the uid comes back the pool is sized and filled for it before
+ * the first allocation. When the scene ends the pages filled for it are
+ * given back.
+ */
+static struct boost_pool_scene *boost_pool_scene_find(struct ion_boost_pool *pool,
+						      int uid, bool create)
+{
+	struct boost_pool_scene *scene, *victim = NULL;
+	int i;
+
+	for (i = 0; i < BOOST_POOL_SCENES; i++) {
+		scene = &pool->scenes[i];
+		if (scene->nr && scene->uid == uid)
+			return scene;
+		if (!victim || !scene->nr ||
+		    (victim->nr && time_before(scene->last, victim->last)))
+			victim = scene;
+	}
+
+	if (!create)
+		return NULL;
+
+	memset(victim, 0, sizeof(*victim));
+	victim->uid = uid;
+	return victim;
+}
+
+/* called with scene_lock held */
+static void boost_pool_scene_begin(struct ion_boost_pool *pool, int uid,
+				   int nr_pages)
+{
+	struct boost_pool_scene *scene = boost_pool_scene_find(pool, uid, false);
+	int target = nr_pages;
+
+	pool->scene_active = true;
+	pool->scene_uid = uid;
+	pool->scene_demand = 0;
+	pool->stat.scenes++;
+
+	if (boost_pool_predict && scene && scene->demand) {
+		target = max_t(int, target, min_t(int, scene->demand,
+						  MAX_BOOST_POOL_HIGH - 1));
+		pool->stat.predicted++;
+	}
+
+	if (nr_pages || target > pool->high) {
+		pool->release = false;
+		pool->force_stop = 0;
+		pool->high = max(target, pool->low);
+		boost_pool_wakeup_process(pool);
+	}
+}
+
+/* called with scene_lock held */
+static void boost_pool_scene_end(struct ion_boost_pool *pool)
+{
+	struct boost_pool_scene *scene;
+	unsigned int demand = pool->scene_demand;
+
+	if (!pool->scene_active)
+		return;
+	pool->scene_active = false;
+
+	/* don't let uids that never use the pool evict learned ones */
+	scene = boost_pool_scene_find(pool, pool->scene_uid, demand != 0);
+	if (scene) {
+		scene->demand = scene->nr ?
+			(scene->demand * 3 + demand) / 4 : demand;
+		scene->nr++;
+		scene->last = jiffies;
+	}
+
+	if (pool->high > pool->low) {
+		pool->high = pool->low;
+		pool->release = true;
+		pool->wait_flag = 1;
+		wake_up_interruptible(&pool->waitq);
+	}
+}
+
+static void boost_pool_scene_switch(struct ion_boost_pool *pool, int uid)
+{
+	if (uid == READ_ONCE(pool->fg_uid))
+		return;
+
+	spin_lock(&pool->scene_lock);
+	if (uid != pool->fg_uid) {
+		pool->fg_uid = uid;
+		boost_pool_scene_end(pool);
+		boost_pool_scene_begin(pool, uid, 0);
+	}
+	spin_unlock(&pool->scene_lock);
+}
+
+static void boost_pool_scene_check(struct ion_boost_pool *pool)
+{
+	boost_pool_scene_switch(pool, get_fg_uid());
+}
+
+/* scenes follow foreground uid changes, nothing polls for them */
+static int boost_pool_fg_notify(struct notifier_block *nb,
+				unsigned long uid, void *data)
+{
+	struct ion_boost_pool *pool = container_of(nb, struct ion_boost_pool,
+						   fg_nb);
+
+	boost_pool_scene_switch(pool, (int)uid);
+	return NOTIFY_OK;
+}
+
+/* free what was filled beyond high, largest pages first */
+static void boost_pool_release(struct ion_boost_pool *pool)
+{
+	int i, freed, nr, total = 0;
+
+	pool->release = false;
+	nr = boost_pool_nr_pages(pool) - pool->high;
+	for (i = 0; i < NUM_ORDERS && nr > 0; i++) {
+		freed = ion_msm_page_pool_shrink(pool->pools[i],
+						 __GFP_HIGHMEM, nr);
+		total += freed;
+		nr -= freed;
+	}
+
+	spin_lock(&pool->scene_lock);
+	pool->stat.released += total;
+	spin_unlock(&pool->scene_lock);
+}
+
+static void boost_pool_fill_done(struct ion_boost_pool *pool, ktime_t start)
+{
+	struct boost_pool_stat *stat = &pool->stat;
+	unsigned int ms = ktime_ms_delta(ktime_get(), start);
+
+	spin_lock(&pool->scene_lock);
+	stat->fills++;
+	stat->fill_last_ms = ms;
+	stat->fill_max_ms = max(stat->fill_max_ms, ms);
+	stat->fill_total_ms += ms;
+	spin_unlock(&pool->scene_lock);
+}
+
+void boost_pool_account(struct ion_boost_pool *pool, int hit, int miss)
+{
+	if (NULL == pool)
+		return;
+
+	boost_pool_scene_check(pool);
+
+	spin_lock(&pool->scene_lock);
+	pool->stat.hit += hit;
+	pool->stat.miss += miss;
+	if (pool->scene_active)
+		pool->scene_demand += hit + miss;
+	spin_unlock(&pool->scene_lock);
+}
+
 static int boost_pool_kworkthread(void *p)
 {
 	int i;
 	struct ion_boost_pool *pool;
 	int ret;
+	bool filling;
+	ktime_t start;
 
 	if (NULL == p) {
 		pr_err("%s: p is NULL!\n", __func__);
@@ -129,12 +295,19 @@ static int boost_pool_kworkthread(void *p)
 			continue;
 
 		pool->wait_flag = 0;
+		if (pool->release)
+			boost_pool_release(pool);
+
+		start = ktime_get();
+		filling = boost_pool_nr_pages(pool) < pool->high;
 		for (i = 0; i < NUM_ORDERS; i++) {
 			while (boost_pool_nr_pages(pool) < pool->high) {
 				if (fill_boost_page_pool(pool->pools[i]) < 0)
 					break;
 			}
 		}
+		if (filling)
+			boost_pool_fill_done(pool, start);
 
 		for (i = 1; i < NUM_ORDERS; i++) {
 			while (page_pool_nr_pages(pool->pools[i]) <
@@ -289,6 +462,9 @@ void boost_pool_dec_high(struct ion_boost_pool *pool, int nr_pages)
 static int boost_pool_proc_show(struct seq_file *s, void *v)
 {
 	struct ion_boost_pool *boost_pool = s->private;
+	struct boost_pool_scene scenes[BOOST_POOL_SCENES];
+	struct boost_pool_stat stat;
+	unsigned long total;
 	int i;
 
 	seq_printf(s, "Name:%s: %dMib, low: %dMib high: %dMib\n",
@@ -306,6 +482,31 @@ static int boost_pool_proc_show(struct seq_file *s, void *v)
 		seq_printf(s, "%d order %u lowmem pages in boost pool = %lu total\n",
 			   pool->low_count, pool->order,
 			   (PAGE_SIZE << pool->order) * pool->low_count);
+		seq_printf(s, "order %u reclaimed: %ld refilled: %ld pages\n",
+			   pool->order,
+			   atomic_long_read(&pool->nr_reclaimed),
+			   atomic_long_read(&pool->nr_refilled));
+	}
+
+	spin_lock(&boost_pool->scene_lock);
+	stat = boost_pool->stat;
+	memcpy(scenes, boost_pool->scenes, sizeof(scenes));
+	spin_unlock(&boost_pool->scene_lock);
+
+	total = stat.hit + stat.miss;
+	seq_printf(s, "hit: %luMib miss: %luMib hit ratio: %lu%%\n",
+		   M(stat.hit), M(stat.miss),
+		   total ? stat.hit * 100 / total : 0);
+	seq_printf(s, "fill: %u last: %ums max: %ums avg: %lums\n",
+		   stat.fills, stat.fill_last_ms, stat.fill_max_ms,
+		   stat.fills ? stat.fill_total_ms / stat.fills : 0);
+	seq_printf(s, "scenes: %lu predicted: %lu released: %luMib\n",
+		   stat.scenes, stat.predicted, M(stat.released));
+	for (i = 0; i < BOOST_POOL_SCENES; i++) {
+		if (!scenes[i].nr)
+			continue;
+		seq_printf(s, "uid %d: demand %uMib scenes %u\n",
+			   scenes[i].uid, M(scenes[i].demand), scenes[i].nr);
 	}
 	return 0;
 }
@@ -341,8 +542,11 @@ static ssize_t boost_pool_proc_write(struct file *file,
 
 	if (nr_pages == 0) {
 		pr_info("reset high wm.\n");
+		spin_lock(&boost_pool->scene_lock);
+		boost_pool_scene_end(boost_pool);
 		boost_pool->high = boost_pool->low;
 		boost_pool->force_stop = 0;
+		spin_unlock(&boost_pool->scene_lock);
 		return count;
 	}
 
@@ -363,9 +567,19 @@ static ssize_t boost_pool_proc_write(struct file *file,
 			current->comm, M(nr_pages), M(mem_avail));
 		kcrit_scene_wakeup_lmkd();
 		/* trigger lmkiller */
-		boost_pool->force_stop = 0;
-		boost_pool->high = nr_pages;
-		boost_pool_wakeup_process(boost_pool);
+		boost_pool_scene_check(boost_pool);
+		spin_lock(&boost_pool->scene_lock);
+		if (!boost_pool->scene_active ||
+		    boost_pool->scene_uid != boost_pool->fg_uid) {
+			boost_pool_scene_end(boost_pool);
+			boost_pool_scene_begin(boost_pool, boost_pool->fg_uid,
+					       nr_pages);
+		} else {
+			boost_pool->force_stop = 0;
+			boost_pool->high = max(nr_pages, boost_pool->high);
+			boost_pool_wakeup_process(boost_pool);
+		}
+		spin_unlock(&boost_pool->scene_lock);
 	}
 
 	return count;
@@ -411,6 +625,9 @@ struct ion_boost_pool *boost_pool_create(struct ion_msm_system_heap *heap,
 	boost_pool->high = boost_pool->low = nr_pages;
 	boost_pool->name = name;
 	boost_pool->usage = ion_flag;
+	spin_lock_init(&boost_pool->scene_lock);
+	boost_pool->fg_uid = get_fg_uid();
+	boost_pool->fg_nb.notifier_call = boost_pool_fg_notify;
 
 	boost_pool->proc_info = proc_create_data(name, 0666,
 						 root_dir,
@@ -433,6 +650,7 @@ struct ion_boost_pool *boost_pool_create(struct ion_msm_system_heap *heap,
 		goto destroy_proc_info;
 	}
 	boost_pool->tsk = tsk;
+	register_fg_uid_notifier(&boost_pool->fg_nb);
 	/* set_task_affinity(tsk,end_cpu); */
 	wake_up_process(tsk);
 	/* pr_info("bind %s on cpu[0-%d].\n", tsk->comm, end_cpu - 1); */
@@ -495,3 +713,4 @@ static void kcrit_scene_wakeup_lmkd(void)
 	wake_up_interruptible(&kcrit_scene_wait);
 }
 module_param_named(debug_boost_pool_enable, boost_pool_enable, bool, 0644);
+module_param_named(predict_enable, boost_pool_predict, bool, 0644);
@@ -2,6 +2,7 @@
 #define _ION_BOOST_POOL_H
 
 #include <linux/kthread.h>
+#include <linux/notifier.h>
 #include <linux/types.h>
 
 #include <linux/msm_ion.h>
@@ -9,6 +10,27 @@
 
 #define LOWORDER_WATER_MASK (64*4)
 #define MAX_POOL_SIZE (128*64*4)
+#define BOOST_POOL_SCENES 16
+
+/* pool demand learned for one foreground uid */
+struct boost_pool_scene {
+	int uid;
+	unsigned int demand;	/* pages, weighted to recent scenes */
+	unsigned int nr;	/* scenes seen, 0 if slot unused */
+	unsigned long last;	/* jiffies */
+};
+
+struct boost_pool_stat {
+	unsigned long hit;	/* pages served from the pool */
+	unsigned long miss;	/* pages that fell back to the buddy */
+	unsigned long scenes;
+	unsigned long predicted;
+	unsigned long released;
+	unsigned int fills;
+	unsigned int fill_last_ms;
+	unsigned int fill_max_ms;
+	unsigned long fill_total_ms;
+};
 
 struct ion_boost_pool {
 	char *name;
@@ -19,6 +41,13 @@ struct ion_boost_pool {
 	unsigned int wait_flag;
 	wait_queue_head_t waitq;
 	struct proc_dir_entry *proc_info;
+	spinlock_t scene_lock;
+	bool scene_active, release;
+	int fg_uid, scene_uid;
+	unsigned int scene_demand;
+	struct notifier_block fg_nb;
+	struct boost_pool_scene scenes[BOOST_POOL_SCENES];
+	struct boost_pool_stat stat;
 	struct ion_msm_page_pool *pools[0];
 };
 
@@ -37,6 +66,7 @@ struct ion_boost_pool *boost_pool_create(struct ion_msm_system_heap *heap,
 					 char *name);
 void boost_pool_wakeup_process(struct ion_boost_pool *pool);
 void boost_pool_dec_high(struct ion_boost_pool *pool, int nr_pages);
+void boost_pool_account(struct ion_boost_pool *pool, int hit, int miss);
 void boost_pool_dump(struct ion_boost_pool *pool);
 bool kcrit_scene_init(void);
 #endif /* _ION_SMART_POOL_H */
@@ -11,6 +11,7 @@
 #include <linux/proc_fs.h>
 #include <linux/fs.h>
 #include <linux/seq_file.h>
+#include <linux/notifier.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
 #include <../fs/proc/internal.h>
@@ -22,8 +23,23 @@ struct fg_info fginfo = {
     .fg_num = 0,
     .fg_uids = -555,
 };
+EXPORT_SYMBOL_GPL(fginfo);
 
 static struct proc_dir_entry *fg_dir;
+/* called with the new uid whenever the foreground uid changes */
+static BLOCKING_NOTIFIER_HEAD(fg_uid_chain);
+
+int register_fg_uid_notifier(struct notifier_block *nb)
+{
+    return blocking_notifier_chain_register(&fg_uid_chain, nb);
+}
+EXPORT_SYMBOL_GPL(register_fg_uid_notifier);
+
+int unregister_fg_uid_notifier(struct notifier_block *nb)
+{
+    return blocking_notifier_chain_unregister(&fg_uid_chain, nb);
+}
+EXPORT_SYMBOL_GPL(unregister_fg_uid_notifier);
 
 bool is_fg(int uid)
 {
@@ -49,6 +65,7 @@ static ssize_t fg_uids_write(struct file *file, const char __user *buf,
 {
     char buffer[MAX_ARRAY_LENGTH];
     int err = 0;
+    int uid;
 
     memset(buffer, 0, sizeof(buffer));
     if (count > sizeof(buffer) - 1)
@@ -58,8 +75,12 @@ static ssize_t fg_uids_write(struct file *file, const char __user *buf,
         goto out;
     }
 
-    fginfo.fg_uids = simple_strtol(buffer, NULL, 0);
+    uid = simple_strtol(buffer, NULL, 0);
     fginfo.fg_num = 1;
+    if (uid != fginfo.fg_uids) {
+        WRITE_ONCE(fginfo.fg_uids, uid);
+        blocking_notifier_call_chain(&fg_uid_chain, uid, NULL);
+    }
 out:
     return err < 0 ? err : count;
 }
@@ -17,5 +17,7 @@ struct fg_info {
     int fg_uids;
 };
 
+extern struct fg_info fginfo;
+
 #endif /*_FG_UID_H*/
 
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * DCVS co-governor: couples the schedutil CPU request with the memlat and
+ * bw_hwmon memory votes so that both move in the same sampling tick.
+ */
+
+#ifndef _LINUX_DCVS_COGOV_H
+#define _LINUX_DCVS_COGOV_H
+
+#include <linux/cpufreq.h>
+#include <linux/devfreq.h>
+
+struct core_dev_map;
+
+#ifdef CONFIG_DEVFREQ_DCVS_COGOV
+void dcvs_cogov_update_cpu(struct cpufreq_policy *policy, u64 time,
+			   unsigned long util, unsigned long max,
+			   unsigned int next_freq);
+void dcvs_cogov_update_mem(struct devfreq *df, unsigned long cpu_mhz,
+			   unsigned int stall_pct, unsigned int ratio,
+			   unsigned int stall_floor, unsigned int ratio_ceil);
+void dcvs_cogov_update_bw(struct devfreq *df, unsigned long mbps);
+int dcvs_cogov_link_bw(struct devfreq *df, const char *bw_dev);
+unsigned long dcvs_cogov_mem_floor(struct devfreq *df);
+int dcvs_cogov_attach(struct devfreq *df, const struct core_dev_map *map,
+		      const struct cpumask *cpus);
+void dcvs_cogov_detach(struct devfreq *df);
+#else
+static inline void dcvs_cogov_update_cpu(struct cpufreq_policy *policy,
+					 u64 time, unsigned long util,
+					 unsigned long max,
+					 unsigned int next_freq)
+{
+}
+static inline void dcvs_cogov_update_mem(struct devfreq *df,
+					 unsigned long cpu_mhz,
+					 unsigned int stall_pct,
+					 unsigned int ratio,
+					 unsigned int stall_floor,
+					 unsigned int ratio_ceil)
+{
+}
+static inline void dcvs_cogov_update_bw(struct devfreq *df,
+					unsigned long mbps)
+{
+}
+static inline int dcvs_cogov_link_bw(struct devfreq *df, const char *bw_dev)
+{
+	return -ENODEV;
+}
+static inline unsigned long dcvs_cogov_mem_floor(struct devfreq *df)
+{
+	return 0;
+}
+static inline int dcvs_cogov_attach(struct devfreq *df,
+				    const struct core_dev_map *map,
+				    const struct cpumask *cpus)
+{
+	return -ENODEV;
+}
+static inline void dcvs_cogov_detach(struct devfreq *df)
+{
+}
+#endif
+
+#endif /* _LINUX_DCVS_COGOV_H */
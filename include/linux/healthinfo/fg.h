@@ -2,6 +2,7 @@
 #define _FG_H_
 
 #include <linux/cred.h>
+#include <linux/notifier.h>
 #include "../../../fs/proc/healthinfo/fg_uid/fg_uid.h"
 
 #ifdef CONFIG_FG_TASK_UID
@@ -22,6 +23,14 @@ static inline int task_is_fg(struct task_struct *tsk)
 		return 1;
 	return 0;
 }
+
+static inline int get_fg_uid(void)
+{
+	return READ_ONCE(fginfo.fg_uids);
+}
+
+extern int register_fg_uid_notifier(struct notifier_block *nb);
+extern int unregister_fg_uid_notifier(struct notifier_block *nb);
 #else
 static inline int current_is_fg(void)
 {
@@ -37,5 +46,20 @@ static inline bool is_fg(int uid)
 {
 	return false;
 }
+
+static inline int get_fg_uid(void)
+{
+	return -1;
+}
+
+static inline int register_fg_uid_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+
+static inline int unregister_fg_uid_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
 #endif
 #endif /*_FG_H_*/
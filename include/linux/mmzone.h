@@ -373,8 +373,35 @@ struct per_cpu_pages {
 	struct list_head lists[MIGRATE_PCPTYPES];
 };
 
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+/*
+ * Per-cpu cache of low-order (but not order-0, which the regular pcp lists
+ * already cover) pages taken from the multi free_area lists. Each list is
+ * kept so that pages from the flc preferred by ajust_flc() sit at the head.
+ */
+#define FLC_PCP_MIN_ORDER	1
+#define FLC_PCP_MAX_ORDER	3
+#define FLC_PCP_ORDERS		(FLC_PCP_MAX_ORDER - FLC_PCP_MIN_ORDER + 1)
+
+struct flc_pcp {
+	int count;		/* number of base pages in the lists */
+	int high;		/* high watermark, emptying needed */
+	int batch;		/* chunk size in base pages for buddy add/remove */
+
+	struct list_head lists[FLC_PCP_ORDERS][MIGRATE_PCPTYPES];
+
+	unsigned long hit[FLC_PCP_ORDERS];
+	unsigned long miss[FLC_PCP_ORDERS];
+	unsigned long refill[FLC_PCP_ORDERS];
+	unsigned long drain[FLC_PCP_ORDERS];
+};
+#endif
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	struct flc_pcp flc_pcp;
+#endif
 #ifdef CONFIG_NUMA
 	s8 expire;
 	u16 vm_numa_stat_diff[NR_VM_NUMA_STAT_ITEMS];
@@ -65,6 +65,10 @@ struct mutex {
 #endif
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 	struct task_struct *ux_dep_task;
+#ifdef CONFIG_MUTEX_UX_HANDOFF
+	/* handoffs in a row that went past the head waiter */
+	unsigned int ux_bypass;
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 };
 
@@ -79,6 +83,10 @@ struct mutex_waiter {
 #ifdef CONFIG_DEBUG_MUTEXES
 	void			*magic;
 #endif
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+	unsigned long		ux_since;
+	bool			ux;
+#endif
 };
 
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
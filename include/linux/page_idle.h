@@ -8,6 +8,8 @@
 
 #ifdef CONFIG_IDLE_PAGE_TRACKING
 
+extern void page_idle_clear_pte_refs(struct page *page);
+
 #ifdef CONFIG_64BIT
 static inline bool page_is_young(struct page *page)
 {
@@ -135,6 +137,10 @@ static inline void clear_page_idle(struct page *page)
 {
 }
 
+static inline void page_idle_clear_pte_refs(struct page *page)
+{
+}
+
 #endif /* CONFIG_IDLE_PAGE_TRACKING */
 
 #endif /* _LINUX_MM_PAGE_IDLE_H */
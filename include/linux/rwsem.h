@@ -55,6 +55,9 @@ struct rw_semaphore {
 	ANDROID_VENDOR_DATA(1);
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 	struct task_struct *ux_dep_task;
+#ifdef CONFIG_RWSEM_UX_CHAIN
+	struct rwsem_ux_class *ux_class;
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 };
 
@@ -222,4 +225,12 @@ extern void up_read_non_owner(struct rw_semaphore *sem);
 # define up_read_non_owner(sem)			up_read(sem)
 #endif
 
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+struct task_struct;
+/* drop the reader slots @p still has recorded, called from do_exit() */
+extern void rwsem_ux_task_exit(struct task_struct *p);
+#else
+static inline void rwsem_ux_task_exit(struct task_struct *p) {}
+#endif
+
 #endif /* _LINUX_RWSEM_H */
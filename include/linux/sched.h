@@ -230,6 +230,12 @@ extern int sysctl_sched_assist_scene;
 
 extern int sysctl_slide_boost_enabled;
 extern int sysctl_boost_task_threshold;
+
+#ifdef CONFIG_MUTEX_UX_HANDOFF
+extern int sysctl_mutex_ux_handoff;
+extern int sysctl_mutex_ux_bypass_max;
+extern int sysctl_mutex_ux_starve_ms;
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 
 #ifdef CONFIG_KSWAPD_UNBIND_MAX_CPU
@@ -1485,6 +1491,12 @@ struct task_struct {
 	int ux_depth;
 	u64 enqueue_time;
 	u64 inherit_ux_start;
+#ifdef CONFIG_RWSEM_UX_CHAIN
+	/* rwsem this task sleeps on, read held rwsems and holder entry */
+	struct rw_semaphore *ux_rwsem_wait;
+	unsigned long ux_rd_slot[4];
+	struct task_struct **ux_rd_holder;
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 //#ifdef CONFIG_UXCHAIN_V2
@@ -1507,6 +1519,10 @@ struct task_struct {
 #ifdef CONFIG_OPLUS_FEATURE_IM
 	int im_flag;
 #endif
+#if IS_ENABLED(CONFIG_OPLUS_FEATURE_UIFRIST_HEAVYLOAD)
+	/* cached is_heavy_load_task(), refreshed at PELT updates */
+	int heavy_load;
+#endif
 #ifdef CONFIG_GCC_PLUGIN_STACKLEAK
 	unsigned long			lowest_stack;
 	unsigned long			prev_lowest_stack;
@@ -265,6 +265,9 @@ struct swap_info_struct {
 #ifdef CONFIG_FRONTSWAP
 	unsigned long *frontswap_map;	/* frontswap in-use, one bit per page */
 	atomic_t frontswap_pages;	/* frontswap pages in-use counter */
+#endif
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	unsigned short *tier_map;	/* compressed size and age per slot */
 #endif
 	spinlock_t lock;		/*
 					 * protect map scan related fields like
@@ -457,6 +460,26 @@ extern atomic_t nr_rotate_swap;
 extern bool has_usable_swap(void);
 #if defined(CONFIG_NANDSWAP)
 extern struct swap_info_struct *nandswap_si;
+
+struct nandswap_extent_stat {
+	unsigned long picked;		/* extents started */
+	unsigned long short_runs;	/* extents shorter than wanted */
+	unsigned long clusters;		/* clusters filled through extents */
+	unsigned long fallback;		/* no free cluster run was left */
+};
+extern struct nandswap_extent_stat nandswap_extent_stat;
+extern void nandswap_extent_begin(unsigned long nr_pages);
+extern void nandswap_extent_end(void);
+#endif
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+extern void swap_tier_record(struct swap_info_struct *si, struct page *page,
+			     unsigned int size);
+extern bool swap_tier_info(swp_entry_t entry, unsigned int *size,
+			   unsigned int *age_secs);
+extern int swap_tier_unuse(struct vm_area_struct *vma, pmd_t *pmd,
+			   unsigned long addr, swp_entry_t entry,
+			   struct page *page);
+extern void zram_tier_count_fault(swp_entry_t entry);
 #endif
 
 /* Swap 50% full? Release swapcache more aggressively.. */
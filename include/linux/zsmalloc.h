@@ -56,4 +56,8 @@ unsigned long zs_get_total_pages(struct zs_pool *pool);
 unsigned long zs_compact(struct zs_pool *pool);
 
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats);
+
+#if IS_ENABLED(CONFIG_OPLUS_FEATURE_ZRAM_OPT)
+unsigned long zs_get_total_objs(void);
+#endif
 #endif
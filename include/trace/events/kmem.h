@@ -363,6 +363,52 @@ TRACE_EVENT(rss_stat,
 		__entry->member,
 		__entry->size)
 	);
+
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+TRACE_EVENT(mm_flc_label_adjust,
+
+	TP_PROTO(struct zone *zone, int decision,
+		unsigned long old_label, unsigned long new_label,
+		int events, u64 avg_wait_ms, int fi_top, int fi_below),
+
+	TP_ARGS(zone, decision, old_label, new_label, events, avg_wait_ms,
+		fi_top, fi_below),
+
+	TP_STRUCT__entry(
+		__string(name, zone->name)
+		__field(int, decision)
+		__field(unsigned long, old_label)
+		__field(unsigned long, new_label)
+		__field(int, events)
+		__field(u64, avg_wait_ms)
+		__field(int, fi_top)
+		__field(int, fi_below)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, zone->name);
+		__entry->decision = decision;
+		__entry->old_label = old_label;
+		__entry->new_label = new_label;
+		__entry->events = events;
+		__entry->avg_wait_ms = avg_wait_ms;
+		__entry->fi_top = fi_top;
+		__entry->fi_below = fi_below;
+	),
+
+	TP_printk("zone=%s decision=%s label=%lu->%lu events=%d avg_wait_ms=%llu fragindex_top=%d fragindex_below=%d",
+		__get_str(name),
+		__print_symbolic(__entry->decision,
+			{ 0, "hold" }, { 1, "grow" }, { 2, "shrink" }),
+		__entry->old_label,
+		__entry->new_label,
+		__entry->events,
+		__entry->avg_wait_ms,
+		__entry->fi_top,
+		__entry->fi_below)
+);
+#endif
+
 #endif /* _TRACE_KMEM_H */
 
 /* This part must be outside protection */
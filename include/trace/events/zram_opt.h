@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+* Copyright (C) 2020-2022 Oplus. All rights reserved.
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM zram_opt
+
+#if !defined(_TRACE_ZRAM_OPT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_ZRAM_OPT_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(zram_opt_swappiness,
+
+	TP_PROTO(unsigned int stall, unsigned long file_refault,
+		 unsigned long anon_refault, unsigned int ratio, int score,
+		 int swappiness, int direct_swappiness),
+
+	TP_ARGS(stall, file_refault, anon_refault, ratio, score,
+		swappiness, direct_swappiness),
+
+	TP_STRUCT__entry(
+		__field(unsigned int,	stall)
+		__field(unsigned long,	file_refault)
+		__field(unsigned long,	anon_refault)
+		__field(unsigned int,	ratio)
+		__field(int,		score)
+		__field(int,		swappiness)
+		__field(int,		direct_swappiness)
+	),
+
+	TP_fast_assign(
+		__entry->stall		= stall;
+		__entry->file_refault	= file_refault;
+		__entry->anon_refault	= anon_refault;
+		__entry->ratio		= ratio;
+		__entry->score		= score;
+		__entry->swappiness	= swappiness;
+		__entry->direct_swappiness = direct_swappiness;
+	),
+
+	TP_printk("stall=%u.%u%% file_refault=%lu anon_refault=%lu ratio=%u.%02u score=%d swappiness=%d direct_swappiness=%d",
+		__entry->stall / 10, __entry->stall % 10,
+		__entry->file_refault,
+		__entry->anon_refault, __entry->ratio / 100,
+		__entry->ratio % 100, __entry->score,
+		__entry->swappiness, __entry->direct_swappiness)
+);
+
+#endif /* _TRACE_ZRAM_OPT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -12,6 +12,8 @@
  * mechanism for vendor modules to hook and extend functionality
  */
 #if defined(CONFIG_TRACEPOINTS) && defined(CONFIG_ANDROID_VENDOR_HOOKS)
+struct block_device;
+
 DECLARE_HOOK(android_vh_set_swappiness,
 	TP_PROTO(int *swappiness),
 	TP_ARGS(swappiness));
@@ -28,11 +30,21 @@ DECLARE_HOOK(android_vh_check_throttle,
 DECLARE_HOOK(android_vh_check_process_reclaimer,
 	TP_PROTO(int *is_process_reclaimer),
 	TP_ARGS(is_process_reclaimer));
+
+/*
+ * Compressed size of the page just written at @sector of @bdev, filled in
+ * by the owning driver (zram: zram_get_obj_size() of that index), left
+ * alone by everyone else.
+ */
+DECLARE_HOOK(android_vh_swap_slot_obj_size,
+	TP_PROTO(struct block_device *bdev, sector_t sector, unsigned int *size),
+	TP_ARGS(bdev, sector, size));
 #else
 #define trace_android_vh_set_swappiness(swappiness)
 #define trace_android_vh_set_inactive_ratio(inactive_ratio, file)
 #define trace_android_vh_check_throttle(throttle)
 #define trace_android_vh_check_process_reclaimer(task)
+#define trace_android_vh_swap_slot_obj_size(bdev, sector, size)
 #endif
 #endif /* _TRACE_HOOK_VMSCAN_H */
 /* This part must be outside protection */
@@ -97,6 +97,14 @@ enum flat_binder_object_flags {
 	 * context
 	 */
 	FLAT_BINDER_FLAG_TXN_SECURITY_CTX = 0x1000,
+
+	/**
+	 * @FLAT_BINDER_FLAG_ACCEPTS_ZERO_COPY: accept lent data pages
+	 *
+	 * Only when set, TF_ZERO_COPY transactions to this node may map
+	 * the sender's pages into the receiver instead of copying them.
+	 */
+	FLAT_BINDER_FLAG_ACCEPTS_ZERO_COPY = 0x2000,
 };
 
 #ifdef BINDER_IPC_32BIT
@@ -297,6 +305,15 @@ enum transaction_flags {
 	TF_STATUS_CODE	= 0x08,	/* contents are a 32-bit status code */
 	TF_ACCEPT_FDS	= 0x10,	/* allow replies with file descriptors */
 	TF_CLEAR_BUF	= 0x20,	/* clear buffer on txn complete */
+	/*
+	 * Map the sender's page-aligned data pages into the target instead of
+	 * copying them. Only used for transactions to a node that set
+	 * FLAT_BINDER_FLAG_ACCEPTS_ZERO_COPY, carrying no objects, with data
+	 * backed by a memfd sealed with F_SEAL_SHRINK and F_SEAL_WRITE (or
+	 * F_SEAL_FUTURE_WRITE and no writable mapping left); otherwise the
+	 * data is copied.
+	 */
+	TF_ZERO_COPY	= 0x80,
 };
 
 struct binder_transaction_data {
@@ -2071,6 +2071,11 @@ static __latent_entropy struct task_struct *copy_process(
 
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 	init_task_ux_info(p);
+#ifdef CONFIG_RWSEM_UX_CHAIN
+	p->ux_rwsem_wait = NULL;
+	memset(p->ux_rd_slot, 0, sizeof(p->ux_rd_slot));
+	p->ux_rd_holder = NULL;
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 #ifdef OPLUS_FEATURE_HEALTHINFO
 #ifdef CONFIG_OPLUS_JANK_INFO
@@ -30,6 +30,11 @@
 #include <linux/slab.h>
 #include <linux/percpu-rwsem.h>
 #include <linux/torture.h>
+#include <linux/sched/clock.h>
+#include <linux/sort.h>
+#ifdef CONFIG_OPLUS_FEATURE_IM
+#include <linux/im/im.h>
+#endif
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Paul E. McKenney <paulmck@linux.ibm.com>");
@@ -38,6 +43,8 @@ torture_param(int, nwriters_stress, -1,
 	     "Number of write-locking stress-test threads");
 torture_param(int, nreaders_stress, -1,
 	     "Number of read-locking stress-test threads");
+torture_param(int, nwriters_highprio, 2,
+	     "Number of high-priority writers (mutex_ux_lock only)");
 torture_param(int, onoff_holdoff, 0, "Time after boot before CPU hotplugs (s)");
 torture_param(int, onoff_interval, 0,
 	     "Time between CPU hotplugs (s), 0=disable");
@@ -62,9 +69,16 @@ static struct task_struct **reader_tasks;
 static bool lock_is_write_held;
 static bool lock_is_read_held;
 
+#define LOCK_TORTURE_LAT_SAMPLES 1024
+/* twice the longest mutex_ux_lock critical section */
+#define LOCK_TORTURE_LAT_LATE_NS (10 * NSEC_PER_MSEC)
+
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	bool highprio;
+	long n_lat_late; /* acquires slower than LOCK_TORTURE_LAT_LATE_NS */
+	u32 *lat; /* last acquire latencies in ns, NULL if not measured */
 };
 
 /* Forward reference. */
@@ -84,6 +98,7 @@ struct lock_torture_ops {
 	void (*readunlock)(void);
 
 	unsigned long flags; /* for irq spinlocks */
+	bool highprio; /* split writers by priority, measure acquire latency */
 	const char *name;
 };
 
@@ -354,6 +369,44 @@ static struct lock_torture_ops mutex_lock_ops = {
 	.name		= "mutex_lock"
 };
 
+static void torture_mutex_ux_delay(struct torture_random_state *trsp)
+{
+	const unsigned long shortdelay_us = 50;
+	const unsigned long longdelay_ms = 5;
+
+	/*
+	 * Short critical sections with the odd long one, so that waiters
+	 * queue up often but a slow holder does not hide the ordering.
+	 */
+	if (!(torture_random(trsp) % (cxt.nrealwriters_stress * 200)))
+		mdelay(longdelay_ms);
+	else
+		udelay(shortdelay_us);
+	if (!(torture_random(trsp) % (cxt.nrealwriters_stress * 20000)))
+		torture_preempt_schedule();  /* Allow test to be preempted. */
+}
+
+/*
+ * Same mutex as mutex_lock, with the first nwriters_highprio writers
+ * running as render threads at MIN_NICE and acquiring once per frame-ish
+ * interval, while the rest hammer the lock at MAX_NICE. With more than
+ * one of them, UX waiters queue behind each other and behind a passed
+ * over head, so every handoff has to leave HANDOFF set for the rest. The
+ * stats report acquire latency percentiles for both groups and how many
+ * acquires took longer than twice the longest critical section.
+ */
+static struct lock_torture_ops mutex_ux_lock_ops = {
+	.writelock	= torture_mutex_lock,
+	.write_delay	= torture_mutex_ux_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_mutex_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.highprio	= true,
+	.name		= "mutex_ux_lock"
+};
+
 #include <linux/ww_mutex.h>
 static DEFINE_WD_CLASS(torture_ww_class);
 static DEFINE_WW_MUTEX(torture_ww_mutex_0, &torture_ww_class);
@@ -620,16 +673,36 @@ static int lock_torture_writer(void *arg)
 {
 	struct lock_stress_stats *lwsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start = 0;
 
 	VERBOSE_TOROUT_STRING("lock_torture_writer task started");
-	set_user_nice(current, MAX_NICE);
+	if (lwsp->highprio) {
+		set_user_nice(current, MIN_NICE);
+#ifdef CONFIG_OPLUS_FEATURE_IM
+		current->im_flag |= IM_RENDER;
+#endif
+	} else {
+		set_user_nice(current, MAX_NICE);
+	}
 
 	do {
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
+		if (lwsp->highprio)
+			usleep_range(1000, 2000);
 
 		cxt.cur_ops->task_boost(&rand);
+		if (lwsp->lat)
+			start = local_clock();
 		cxt.cur_ops->writelock();
+		if (lwsp->lat) {
+			u64 lat = local_clock() - start;
+
+			lwsp->lat[lwsp->n_lock_acquired % LOCK_TORTURE_LAT_SAMPLES] =
+				min_t(u64, lat, U32_MAX);
+			if (lat > LOCK_TORTURE_LAT_LATE_NS)
+				lwsp->n_lat_late++;
+		}
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lwsp->n_lock_fail++;
 		lock_is_write_held = 1;
@@ -645,6 +718,10 @@ static int lock_torture_writer(void *arg)
 	} while (!torture_must_stop());
 
 	cxt.cur_ops->task_boost(NULL); /* reset prio */
+#ifdef CONFIG_OPLUS_FEATURE_IM
+	if (lwsp->highprio)
+		current->im_flag &= ~IM_RENDER;
+#endif
 	torture_kthread_stopping("lock_torture_writer");
 	return 0;
 }
@@ -711,6 +788,55 @@ static void __torture_print_stats(char *page,
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
 
+static int lock_torture_lat_cmp(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Append acquire latency percentiles over the last samples of the high
+ * and normal priority writers.
+ */
+static void __torture_print_lat(char *page, struct lock_stress_stats *statp)
+{
+	u32 *buf;
+	int i, hp;
+
+	buf = kmalloc_array(cxt.nrealwriters_stress * LOCK_TORTURE_LAT_SAMPLES,
+			    sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return;
+
+	for (hp = 1; hp >= 0; hp--) {
+		long late = 0;
+		int n = 0;
+
+		for (i = 0; i < cxt.nrealwriters_stress; i++) {
+			long cnt = min_t(long, statp[i].n_lock_acquired,
+					 LOCK_TORTURE_LAT_SAMPLES);
+
+			if (!statp[i].lat || statp[i].highprio != hp)
+				continue;
+			memcpy(buf + n, statp[i].lat, cnt * sizeof(*buf));
+			n += cnt;
+			late += statp[i].n_lat_late;
+		}
+		if (!n)
+			continue;
+
+		sort(buf, n, sizeof(*buf), lock_torture_lat_cmp, NULL);
+		page += sprintf(page,
+				"%s acquire latency (us): n: %d  p50: %u  p99: %u  max: %u  late: %ld\n",
+				hp ? "High-prio" : "Normal   ", n,
+				buf[n / 2] / 1000,
+				buf[n - 1 - n / 100] / 1000,
+				buf[n - 1] / 1000, late);
+	}
+	kfree(buf);
+}
+
 /*
  * Print torture statistics.  Caller must ensure that there is only one
  * call to this function at a given time!!!  This is normally accomplished
@@ -735,6 +861,8 @@ static void lock_torture_stats_print(void)
 	}
 
 	__torture_print_stats(buf, cxt.lwsa, true);
+	if (cxt.cur_ops->highprio && cxt.lwsa)
+		__torture_print_lat(buf + strlen(buf), cxt.lwsa);
 	pr_alert("%s", buf);
 	kfree(buf);
 
@@ -776,9 +904,10 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d nwriters_highprio=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
-		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
+		 cxt.nrealwriters_stress, cxt.nrealreaders_stress,
+		 cur_ops->highprio ? nwriters_highprio : 0, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
 		 onoff_interval, onoff_holdoff);
 }
@@ -828,6 +957,8 @@ static void lock_torture_cleanup(void)
 		lock_torture_print_module_parms(cxt.cur_ops,
 						"End of test: SUCCESS");
 
+	for (i = 0; cxt.lwsa && i < cxt.nrealwriters_stress; i++)
+		kfree(cxt.lwsa[i].lat);
 	kfree(cxt.lwsa);
 	cxt.lwsa = NULL;
 	kfree(cxt.lrsa);
@@ -846,6 +977,7 @@ static int __init lock_torture_init(void)
 		&spin_lock_ops, &spin_lock_irq_ops,
 		&rw_lock_ops, &rw_lock_irq_ops,
 		&mutex_lock_ops,
+		&mutex_ux_lock_ops,
 		&ww_mutex_lock_ops,
 #ifdef CONFIG_RT_MUTEXES
 		&rtmutex_lock_ops,
@@ -917,6 +1049,21 @@ static int __init lock_torture_init(void)
 		for (i = 0; i < cxt.nrealwriters_stress; i++) {
 			cxt.lwsa[i].n_lock_fail = 0;
 			cxt.lwsa[i].n_lock_acquired = 0;
+			cxt.lwsa[i].highprio = cxt.cur_ops->highprio &&
+					       i < nwriters_highprio;
+			cxt.lwsa[i].n_lat_late = 0;
+			cxt.lwsa[i].lat = NULL;
+		}
+
+		for (i = 0; cxt.cur_ops->highprio &&
+			    i < cxt.nrealwriters_stress; i++) {
+			cxt.lwsa[i].lat = kcalloc(LOCK_TORTURE_LAT_SAMPLES,
+						  sizeof(u32), GFP_KERNEL);
+			if (!cxt.lwsa[i].lat) {
+				VERBOSE_TOROUT_STRING("cxt.lwsa[].lat: Out of memory");
+				firsterr = -ENOMEM;
+				goto unwind;
+			}
 		}
 	}
 
@@ -42,6 +42,15 @@
 
 #include <trace/hooks/dtask.h>
 
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+#include <linux/im/im.h>
+#include <linux/sched_assist/sched_assist_common.h>
+
+int sysctl_mutex_ux_handoff;
+int sysctl_mutex_ux_bypass_max = 4;
+int sysctl_mutex_ux_starve_ms = 20;
+#endif
+
 void
 __mutex_init(struct mutex *lock, const char *name, struct lock_class_key *key)
 {
@@ -53,6 +62,9 @@ __mutex_init(struct mutex *lock, const char *name, struct lock_class_key *key)
 #endif
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 	lock->ux_dep_task = NULL;
+#ifdef CONFIG_MUTEX_UX_HANDOFF
+	lock->ux_bypass = 0;
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 
 	debug_mutex_init(lock, name, key);
@@ -273,6 +285,71 @@ static void __mutex_handoff(struct mutex *lock, struct task_struct *task)
 	}
 }
 
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+/*
+ * UX handoff: a UX or render thread that has to sleep on a mutex sets
+ * HANDOFF right away instead of waiting to become the head waiter. The
+ * unlock then keeps the owner field, so neither a spinner nor a new
+ * arrival can steal the lock, and hands it straight to the first such
+ * waiter. Passing over the head is bounded by the per-mutex ->ux_bypass
+ * count and by how long the head has been waiting. ww_mutex waiters are
+ * never flagged, their stamp order stays as it is.
+ */
+static inline bool mutex_ux_waiter(struct task_struct *task)
+{
+	return test_task_ux(task) || im_rendering(task);
+}
+
+static struct mutex_waiter *
+mutex_ux_pick_waiter(struct mutex *lock, struct mutex_waiter *first)
+{
+	struct mutex_waiter *w;
+
+	if (!READ_ONCE(sysctl_mutex_ux_handoff) || first->ux)
+		goto head;
+	if (lock->ux_bypass >= READ_ONCE(sysctl_mutex_ux_bypass_max))
+		goto head;
+	if (time_after(jiffies, first->ux_since +
+		       msecs_to_jiffies(READ_ONCE(sysctl_mutex_ux_starve_ms))))
+		goto head;
+
+	list_for_each_entry(w, &lock->wait_list, list) {
+		if (w->ux) {
+			lock->ux_bypass++;
+			return w;
+		}
+	}
+head:
+	lock->ux_bypass = 0;
+	return first;
+}
+
+/*
+ * Called by the new owner with wait_lock held, once it left the wait
+ * list. Every handoff consumes HANDOFF, and neither a passed over head
+ * nor the UX waiters still queued behind it are woken to set it again.
+ * Keep it set while any of them waits, so the next unlock hands off
+ * again and still checks on the head.
+ */
+static void mutex_ux_rearm(struct mutex *lock)
+{
+	struct mutex_waiter *w;
+
+	if (list_empty(&lock->wait_list) ||
+	    !READ_ONCE(sysctl_mutex_ux_handoff))
+		return;
+
+	if (lock->ux_bypass)
+		goto rearm;
+	list_for_each_entry(w, &lock->wait_list, list)
+		if (w->ux)
+			goto rearm;
+	return;
+rearm:
+	__mutex_set_flag(lock, MUTEX_FLAG_HANDOFF);
+}
+#endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF) */
+
 #ifndef CONFIG_DEBUG_LOCK_ALLOC
 /*
  * We split the mutex lock/unlock logic into separate fastpath and
@@ -1009,10 +1086,19 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 
 	lock_contended(&lock->dep_map, ip);
 
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+	waiter.ux_since = jiffies;
+	waiter.ux = !use_ww_ctx && READ_ONCE(sysctl_mutex_ux_handoff) &&
+		    mutex_ux_waiter(current);
+#endif
+
 	if (!use_ww_ctx) {
 		/* add waiting tasks to the end of the waitqueue (FIFO): */
 		__mutex_add_waiter(lock, &waiter, &lock->wait_list);
-
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+		if (waiter.ux)
+			__mutex_set_flag(lock, MUTEX_FLAG_HANDOFF);
+#endif
 
 #ifdef CONFIG_DEBUG_MUTEXES
 		waiter.ww_ctx = MUTEX_POISON_WW_CTX;
@@ -1120,6 +1206,9 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	}
 
 	__mutex_remove_waiter(lock, &waiter);
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+	mutex_ux_rearm(lock);
+#endif
 
 	debug_mutex_free_waiter(&waiter);
 
@@ -1321,6 +1410,10 @@ static noinline void __sched __mutex_unlock_slowpath(struct mutex *lock, unsigne
 			list_first_entry(&lock->wait_list,
 					 struct mutex_waiter, list);
 
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_MUTEX_UX_HANDOFF)
+		if (owner & MUTEX_FLAG_HANDOFF)
+			waiter = mutex_ux_pick_waiter(lock, waiter);
+#endif
 		next = waiter->task;
 
 		debug_mutex_wake_waiter(lock, waiter);
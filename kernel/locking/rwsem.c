@@ -41,6 +41,12 @@
 #include <../sched/sched.h>
 #include <linux/sched/clock.h>
 #endif
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/seq_file.h>
+#include <linux/sched_assist/sched_assist_common.h>
+#endif
 
 /*
  * The least significant 3 bits of the owner value has the following
@@ -329,6 +335,491 @@ rwsem_owner_flags(struct rw_semaphore *sem, unsigned long *pflags)
  * the lock immediately after that.
  */
 
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+/*
+ * UX inheritance through rwsem owner chains.
+ *
+ * The sched_assist hooks in the slowpaths only boost a writer owner:
+ * sem->owner keeps nothing but the last reader, so a UX task queued
+ * behind readers (mmap_sem held for read by reclaim or by a faulting
+ * background thread) was left waiting at normal priority.
+ *
+ * Readers of tracked classes record the sem in a few slots of their own
+ * task_struct and, while they have any, sit in a small per-cpu table of
+ * slot holders. Neither takes a lock, and readers in irq or NMI context
+ * (bpf stackmap trylocks mmap_sem from NMI) are not recorded at all. A
+ * UX waiter scans the holders under RCU and boosts each one with the sem
+ * it queues on. When an owner is itself sleeping on another rwsem, the
+ * walk carries on to the owners of that one for up to rwsem_ux_depth
+ * hops. All wait_locks past the first are trylocked, so the walk adds no
+ * lock dependency and stops on contention instead.
+ *
+ * Each task publishes the rwsem it sleeps on in ->ux_rwsem_wait. Only
+ * walkers take rwsem_ux_chain_lock; a task done waiting passes through
+ * it only while rwsem_ux_walkers says a walk is going on, so the sem a
+ * walker read from ->ux_rwsem_wait stays around until it lets go.
+ *
+ * Sleeping waits and inheritance hits are counted per lock class, keyed
+ * by the lock_class_key init_rwsem() passes in, and read from
+ * <debugfs>/rwsem_ux/stats.
+ */
+#define RWSEM_UX_CLASSES	128
+#define RWSEM_UX_HIST		16
+#define RWSEM_UX_DEPTH_MAX	8
+#define RWSEM_UX_HOLDERS	16
+
+/* low bits of a reader slot, see rwsem_ux_boost_reader() */
+#define RWSEM_UX_BOOSTING	1UL
+#define RWSEM_UX_INHERITED	2UL
+#define RWSEM_UX_SLOT_FLAGS	(RWSEM_UX_BOOSTING | RWSEM_UX_INHERITED)
+
+struct rwsem_ux_class {
+	struct lock_class_key	*key;
+	char			name[32];
+	bool			track;
+	atomic_t		hist[2][RWSEM_UX_HIST];
+	atomic64_t		wait_ns[2];
+	atomic_t		inherit[RWSEM_UX_DEPTH_MAX];
+	atomic_t		readers;
+	atomic_t		overflow;
+	atomic_t		busy;
+};
+
+struct rwsem_ux_holders {
+	struct task_struct	*task[RWSEM_UX_HOLDERS];
+};
+
+static struct rwsem_ux_class rwsem_ux_classes[RWSEM_UX_CLASSES];
+static struct rwsem_ux_class rwsem_ux_other = { .name = "<unclassified>" };
+static DEFINE_PER_CPU(struct rwsem_ux_holders, rwsem_ux_holders);
+static DEFINE_RAW_SPINLOCK(rwsem_ux_chain_lock);
+static atomic_t rwsem_ux_walkers;
+static unsigned int rwsem_ux_depth = 4;
+static bool rwsem_ux_track_all;
+
+static struct rwsem_ux_class *
+rwsem_ux_class_get(struct lock_class_key *key, const char *name)
+{
+	unsigned int i, h;
+
+	if (!key)
+		return NULL;
+
+	h = hash_ptr(key, ilog2(RWSEM_UX_CLASSES));
+	for (i = 0; i < RWSEM_UX_CLASSES; i++) {
+		struct rwsem_ux_class *c;
+		struct lock_class_key *k;
+
+		c = &rwsem_ux_classes[(h + i) & (RWSEM_UX_CLASSES - 1)];
+		k = READ_ONCE(c->key);
+		if (k == key)
+			return c;
+		if (!k && !cmpxchg(&c->key, NULL, key)) {
+			strlcpy(c->name, name ? name : "?", sizeof(c->name));
+			WRITE_ONCE(c->track, name && strstr(name, "mmap_sem"));
+			return c;
+		}
+	}
+	return NULL;
+}
+
+static inline struct rwsem_ux_class *rwsem_ux_class(struct rw_semaphore *sem)
+{
+	return sem->ux_class ? sem->ux_class : &rwsem_ux_other;
+}
+
+static inline bool rwsem_ux_tracked(struct rw_semaphore *sem)
+{
+	struct rwsem_ux_class *c = sem->ux_class;
+
+	return c && (READ_ONCE(c->track) || READ_ONCE(rwsem_ux_track_all));
+}
+
+/*
+ * Enter current in this cpu's holder table. The entry is only cleared
+ * again by current itself, from whichever cpu it runs on by then.
+ */
+static bool rwsem_ux_holder_add(void)
+{
+	struct rwsem_ux_holders *h;
+	int i;
+
+	preempt_disable();
+	h = this_cpu_ptr(&rwsem_ux_holders);
+	for (i = 0; i < RWSEM_UX_HOLDERS; i++) {
+		if (!READ_ONCE(h->task[i]) &&
+		    !cmpxchg(&h->task[i], NULL, current)) {
+			current->ux_rd_holder = &h->task[i];
+			break;
+		}
+	}
+	preempt_enable();
+
+	return current->ux_rd_holder;
+}
+
+static void rwsem_ux_holder_del(struct task_struct *p)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(p->ux_rd_slot); i++)
+		if (READ_ONCE(p->ux_rd_slot[i]))
+			return;
+
+	WRITE_ONCE(*p->ux_rd_holder, NULL);
+	p->ux_rd_holder = NULL;
+}
+
+/*
+ * Record current as a reader owner of @sem. Running out of slots only
+ * costs the boost for this reader, which is counted as an overflow.
+ */
+static void rwsem_ux_reader_add(struct rw_semaphore *sem)
+{
+	struct task_struct *p = current;
+	int i;
+
+	if (!sysctl_sched_assist_enabled || !in_task() || irqs_disabled() ||
+	    !rwsem_ux_tracked(sem))
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(p->ux_rd_slot); i++)
+		if (!READ_ONCE(p->ux_rd_slot[i]))
+			break;
+
+	if (i == ARRAY_SIZE(p->ux_rd_slot) ||
+	    (!p->ux_rd_holder && !rwsem_ux_holder_add())) {
+		atomic_inc(&sem->ux_class->overflow);
+		return;
+	}
+	WRITE_ONCE(p->ux_rd_slot[i], (unsigned long)sem);
+}
+
+/*
+ * Drop current's slot for @sem. Also used by up_read_non_owner(), which
+ * can only tell the slot apart when current took the lock itself; any
+ * other slot left behind goes at exit, see rwsem_ux_task_exit().
+ */
+static void rwsem_ux_reader_del(struct rw_semaphore *sem)
+{
+	struct task_struct *p = current;
+	unsigned long old;
+	int i;
+
+	if (likely(!p->ux_rd_holder) || !in_task())
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(p->ux_rd_slot); i++) {
+		if ((READ_ONCE(p->ux_rd_slot[i]) & ~RWSEM_UX_SLOT_FLAGS) !=
+		    (unsigned long)sem)
+			continue;
+		old = xchg(&p->ux_rd_slot[i], 0);
+		if (old & RWSEM_UX_INHERITED)
+			unset_inherit_ux(p, INHERIT_UX_RWSEM);
+		break;
+	}
+	rwsem_ux_holder_del(p);
+}
+
+void rwsem_ux_task_exit(struct task_struct *p)
+{
+	unsigned long old;
+	int i;
+
+	if (!p->ux_rd_holder)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(p->ux_rd_slot); i++) {
+		old = xchg(&p->ux_rd_slot[i], 0);
+		if (old & RWSEM_UX_INHERITED)
+			unset_inherit_ux(p, INHERIT_UX_RWSEM);
+	}
+	rwsem_ux_holder_del(p);
+}
+
+/*
+ * Lend @waiter's UX to reader @p through its slot @i, holding @sem.
+ * The slot goes from sem to sem|BOOSTING to sem|INHERITED around
+ * set_inherit_ux(). A reader that empties the slot in between finds
+ * nothing to undo, so the second step fails and the boost is undone
+ * here instead.
+ */
+static bool rwsem_ux_boost_reader(struct task_struct *p, int i,
+				  unsigned long sem,
+				  struct task_struct *waiter, int depth)
+{
+	if (cmpxchg(&p->ux_rd_slot[i], sem, sem | RWSEM_UX_BOOSTING) != sem)
+		return false;
+
+	set_inherit_ux(p, INHERIT_UX_RWSEM, waiter->ux_depth + depth,
+		       waiter->ux_state);
+
+	if (cmpxchg(&p->ux_rd_slot[i], sem | RWSEM_UX_BOOSTING,
+		    sem | RWSEM_UX_INHERITED) != (sem | RWSEM_UX_BOOSTING)) {
+		unset_inherit_ux(p, INHERIT_UX_RWSEM);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Boost the recorded readers of @sem. Called under rcu_read_lock(): a
+ * holder entry is cleared before its task gets to exit_notify(), so the
+ * tasks found here are not freed before the walk is done. Returns one
+ * of them that is itself sleeping on an rwsem, with a reference held.
+ */
+static struct task_struct *
+rwsem_ux_boost_readers(struct rw_semaphore *sem, struct task_struct *waiter,
+		       int depth)
+{
+	struct rwsem_ux_class *c = rwsem_ux_class(sem);
+	struct task_struct *p, *blocked = NULL;
+	unsigned long v;
+	int cpu, i, j;
+
+	for_each_possible_cpu(cpu) {
+		struct rwsem_ux_holders *h = per_cpu_ptr(&rwsem_ux_holders, cpu);
+
+		for (j = 0; j < RWSEM_UX_HOLDERS; j++) {
+			p = READ_ONCE(h->task[j]);
+			if (!p || p == waiter)
+				continue;
+
+			for (i = 0; i < ARRAY_SIZE(p->ux_rd_slot); i++) {
+				v = READ_ONCE(p->ux_rd_slot[i]);
+				if ((v & ~RWSEM_UX_SLOT_FLAGS) !=
+				    (unsigned long)sem)
+					continue;
+				if (!(v & RWSEM_UX_SLOT_FLAGS) &&
+				    !test_task_ux(p) &&
+				    rwsem_ux_boost_reader(p, i, v, waiter,
+							  depth)) {
+					atomic_inc(&c->inherit[depth]);
+					atomic_inc(&c->readers);
+				}
+				if (!blocked && READ_ONCE(p->ux_rwsem_wait))
+					blocked = get_task_struct(p);
+				break;
+			}
+		}
+	}
+
+	return blocked;
+}
+
+/*
+ * Writer owner of @sem, or NULL when it is reader owned or held by an
+ * anonymous writer. With waiters queued the writer cannot get past
+ * rwsem_wake() while sem->wait_lock is held, so it stays alive.
+ */
+static struct task_struct *rwsem_ux_writer(struct rw_semaphore *sem)
+{
+	long owner = atomic_long_read(&sem->owner);
+
+	if (owner & RWSEM_READER_OWNED)
+		return NULL;
+	if ((owner & RWSEM_NONSPINNABLE) == RWSEM_NONSPINNABLE)
+		return NULL;
+	return (struct task_struct *)(owner & ~RWSEM_OWNER_FLAGS_MASK);
+}
+
+/*
+ * Boost the owners of @sem, whose wait_lock is held, on behalf of
+ * @waiter. At depth 0 a writer owner has already been handled by
+ * rwsem_set_inherit_ux(). Returns an owner that is itself sleeping on
+ * an rwsem, with a reference held, so the walk can go on from it once
+ * the wait_lock is dropped.
+ */
+static struct task_struct *
+rwsem_ux_boost(struct rw_semaphore *sem, struct task_struct *waiter, int depth)
+{
+	struct rwsem_ux_class *c = rwsem_ux_class(sem);
+	struct task_struct *owner;
+
+	if (is_rwsem_reader_owned(sem))
+		return rwsem_ux_boost_readers(sem, waiter, depth);
+
+	owner = rwsem_ux_writer(sem);
+	if (!owner)
+		return NULL;
+
+	if (!depth) {
+		if (sem->ux_dep_task == owner)
+			atomic_inc(&c->inherit[0]);
+	} else if (!sem->ux_dep_task && !test_task_ux(owner)) {
+		set_inherit_ux(owner, INHERIT_UX_RWSEM,
+			       waiter->ux_depth + depth, waiter->ux_state);
+		sem->ux_dep_task = owner;
+		atomic_inc(&c->inherit[depth]);
+	}
+
+	return READ_ONCE(owner->ux_rwsem_wait) ? get_task_struct(owner) : NULL;
+}
+
+/*
+ * Called with sem->wait_lock held once current is queued on @sem.
+ * Publishes what current sleeps on and, for a UX waiter, walks the
+ * owner chain. Returns the start of the wait for rwsem_ux_wait_end().
+ */
+static u64 rwsem_ux_wait_start(struct rw_semaphore *sem)
+{
+	struct rw_semaphore *s = sem;
+	struct task_struct *blocked;
+	unsigned int max;
+	int depth = 0;
+
+	WRITE_ONCE(current->ux_rwsem_wait, sem);
+
+	max = min_t(unsigned int, READ_ONCE(rwsem_ux_depth),
+		    RWSEM_UX_DEPTH_MAX);
+	if (!sysctl_sched_assist_enabled || !max || !test_task_ux(current))
+		return local_clock();
+
+	atomic_inc(&rwsem_ux_walkers);
+	smp_mb__after_atomic();
+	raw_spin_lock(&rwsem_ux_chain_lock);
+	rcu_read_lock();
+	for (;;) {
+		blocked = rwsem_ux_boost(s, current, depth);
+		if (s != sem)
+			raw_spin_unlock(&s->wait_lock);
+		if (!blocked)
+			break;
+
+		s = READ_ONCE(blocked->ux_rwsem_wait);
+		put_task_struct(blocked);
+		if (!s || ++depth >= max)
+			break;
+		/* fails on a sem already held too, i.e. on a deadlock cycle */
+		if (!raw_spin_trylock(&s->wait_lock)) {
+			atomic_inc(&rwsem_ux_class(sem)->busy);
+			break;
+		}
+	}
+	rcu_read_unlock();
+	raw_spin_unlock(&rwsem_ux_chain_lock);
+	atomic_dec(&rwsem_ux_walkers);
+
+	return local_clock();
+}
+
+static void rwsem_ux_wait_end(struct rw_semaphore *sem, u64 start, int write)
+{
+	struct rwsem_ux_class *c = rwsem_ux_class(sem);
+	u64 delta = local_clock() - start;
+	unsigned long flags;
+
+	WRITE_ONCE(current->ux_rwsem_wait, NULL);
+	/* pairs with the barrier in rwsem_ux_wait_start() */
+	smp_mb();
+	if (atomic_read(&rwsem_ux_walkers)) {
+		/* a walker may still be looking at @sem */
+		raw_spin_lock_irqsave(&rwsem_ux_chain_lock, flags);
+		raw_spin_unlock_irqrestore(&rwsem_ux_chain_lock, flags);
+	}
+
+	atomic_inc(&c->hist[write][min_t(int, fls64(div_u64(delta, NSEC_PER_USEC)),
+					  RWSEM_UX_HIST - 1)]);
+	atomic64_add(delta, &c->wait_ns[write]);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void rwsem_ux_show_class(struct seq_file *m, struct rwsem_ux_class *c)
+{
+	static const char * const kind[] = { "read", "write" };
+	unsigned int n[2] = { 0, 0 };
+	int i, j;
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < RWSEM_UX_HIST; j++)
+			n[i] += atomic_read(&c->hist[i][j]);
+	if (!n[0] && !n[1] && !atomic_read(&c->inherit[0]) &&
+	    !atomic_read(&c->readers))
+		return;
+
+	seq_printf(m, "%s%s\n", c->name, c->track ? " [tracked]" : "");
+	for (i = 0; i < 2; i++) {
+		seq_printf(m, "  %-6s %8u waits %8llu us avg |", kind[i], n[i],
+			   n[i] ? div64_u64(atomic64_read(&c->wait_ns[i]),
+					    (u64)n[i] * NSEC_PER_USEC) : 0);
+		for (j = 0; j < RWSEM_UX_HIST; j++)
+			seq_printf(m, " %u", atomic_read(&c->hist[i][j]));
+		seq_putc(m, '\n');
+	}
+	seq_puts(m, "  inherit");
+	for (j = 0; j < RWSEM_UX_DEPTH_MAX; j++)
+		seq_printf(m, " d%d %u", j, atomic_read(&c->inherit[j]));
+	seq_printf(m, " | readers %u overflow %u busy %u\n",
+		   atomic_read(&c->readers), atomic_read(&c->overflow),
+		   atomic_read(&c->busy));
+}
+
+static int rwsem_ux_stats_show(struct seq_file *m, void *v)
+{
+	int i;
+
+	seq_printf(m, "max_depth %u, wait buckets in us: <1", rwsem_ux_depth);
+	for (i = 1; i < RWSEM_UX_HIST - 1; i++)
+		seq_printf(m, " <%u", 1U << i);
+	seq_printf(m, " >=%u\n", 1U << (RWSEM_UX_HIST - 2));
+
+	for (i = 0; i < RWSEM_UX_CLASSES; i++)
+		if (READ_ONCE(rwsem_ux_classes[i].key))
+			rwsem_ux_show_class(m, &rwsem_ux_classes[i]);
+	rwsem_ux_show_class(m, &rwsem_ux_other);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rwsem_ux_stats);
+
+static void rwsem_ux_clear(struct rwsem_ux_class *c)
+{
+	int i, j;
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < RWSEM_UX_HIST; j++)
+			atomic_set(&c->hist[i][j], 0);
+		atomic64_set(&c->wait_ns[i], 0);
+	}
+	for (j = 0; j < RWSEM_UX_DEPTH_MAX; j++)
+		atomic_set(&c->inherit[j], 0);
+	atomic_set(&c->readers, 0);
+	atomic_set(&c->overflow, 0);
+	atomic_set(&c->busy, 0);
+}
+
+static ssize_t rwsem_ux_reset_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	int i;
+
+	for (i = 0; i < RWSEM_UX_CLASSES; i++)
+		rwsem_ux_clear(&rwsem_ux_classes[i]);
+	rwsem_ux_clear(&rwsem_ux_other);
+	return count;
+}
+
+static const struct file_operations rwsem_ux_reset_fops = {
+	.write	= rwsem_ux_reset_write,
+	.llseek	= noop_llseek,
+};
+
+static int __init rwsem_ux_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("rwsem_ux", NULL);
+
+	debugfs_create_file("stats", 0444, dir, NULL, &rwsem_ux_stats_fops);
+	debugfs_create_file("reset", 0200, dir, NULL, &rwsem_ux_reset_fops);
+	debugfs_create_u32("max_depth", 0644, dir, &rwsem_ux_depth);
+	debugfs_create_bool("track_all", 0644, dir, &rwsem_ux_track_all);
+	return 0;
+}
+late_initcall(rwsem_ux_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+#else
+static inline void rwsem_ux_reader_add(struct rw_semaphore *sem) {}
+static inline void rwsem_ux_reader_del(struct rw_semaphore *sem) {}
+#endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN) */
+
 /*
  * Initialize an rwsem:
  */
@@ -355,6 +846,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	trace_android_vh_rwsem_init(sem);
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 	sem->ux_dep_task = NULL;
+#ifdef CONFIG_RWSEM_UX_CHAIN
+	sem->ux_class = rwsem_ux_class_get(key, name);
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 }
 EXPORT_SYMBOL(__init_rwsem);
@@ -1014,6 +1508,9 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, int state)
 	DEFINE_WAKE_Q(wake_q);
 	bool wake = false;
 	bool already_on_list = false;
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+	u64 ux_wait;
+#endif
 
 	/*
 	 * Save the current read-owner of rwsem, if available, and the
@@ -1115,6 +1612,9 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, int state)
 	if (sysctl_sched_assist_enabled && !is_rwsem_reader_owned(sem)) {
 		rwsem_set_inherit_ux(current, waiter.task, rwsem_owner(sem), sem);
 	}
+#ifdef CONFIG_RWSEM_UX_CHAIN
+	ux_wait = rwsem_ux_wait_start(sem);
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 	raw_spin_unlock_irq(&sem->wait_lock);
 	wake_up_q(&wake_q);
@@ -1151,6 +1651,9 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, int state)
 
 	__set_current_state(TASK_RUNNING);
 	trace_android_vh_rwsem_read_wait_finish(sem);
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+	rwsem_ux_wait_end(sem, ux_wait, 0);
+#endif
 	lockevent_inc(rwsem_rlock);
 	return sem;
 
@@ -1163,6 +1666,9 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, int state)
 	raw_spin_unlock_irq(&sem->wait_lock);
 	__set_current_state(TASK_RUNNING);
 	trace_android_vh_rwsem_read_wait_finish(sem);
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+	rwsem_ux_wait_end(sem, ux_wait, 0);
+#endif
 	lockevent_inc(rwsem_rlock_fail);
 	return ERR_PTR(-EINTR);
 }
@@ -1193,6 +1699,9 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
 	bool already_on_list = false;
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+	u64 ux_wait;
+#endif
 
 	/* do optimistic spinning and steal lock if possible */
 	if (rwsem_can_spin_on_owner(sem, RWSEM_WR_NONSPINNABLE) &&
@@ -1275,6 +1784,9 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	if (sysctl_sched_assist_enabled && !is_rwsem_reader_owned(sem)) {
 		rwsem_set_inherit_ux(waiter.task, current, rwsem_owner(sem), sem);
 	}
+#ifdef CONFIG_RWSEM_UX_CHAIN
+	ux_wait = rwsem_ux_wait_start(sem);
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 
 	/* wait until we successfully acquire the lock */
@@ -1352,6 +1864,9 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	list_del(&waiter.list);
 	rwsem_disable_reader_optspin(sem, disable_rspin);
 	raw_spin_unlock_irq(&sem->wait_lock);
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+	rwsem_ux_wait_end(sem, ux_wait, 1);
+#endif
 	lockevent_inc(rwsem_wlock);
 
 	return ret;
@@ -1371,6 +1886,9 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 		rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 	raw_spin_unlock_irq(&sem->wait_lock);
 	wake_up_q(&wake_q);
+#if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_RWSEM_UX_CHAIN)
+	rwsem_ux_wait_end(sem, ux_wait, 1);
+#endif
 	lockevent_inc(rwsem_wlock_fail);
 
 	return ERR_PTR(-EINTR);
@@ -1583,6 +2101,7 @@ void __sched down_read(struct rw_semaphore *sem)
 	rwsem_acquire_read(&sem->dep_map, 0, 0, _RET_IP_);
 
 	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	rwsem_ux_reader_add(sem);
 }
 EXPORT_SYMBOL(down_read);
 
@@ -1596,6 +2115,7 @@ int __sched down_read_killable(struct rw_semaphore *sem)
 		return -EINTR;
 	}
 
+	rwsem_ux_reader_add(sem);
 	return 0;
 }
 EXPORT_SYMBOL(down_read_killable);
@@ -1607,8 +2127,10 @@ int down_read_trylock(struct rw_semaphore *sem)
 {
 	int ret = __down_read_trylock(sem);
 
-	if (ret == 1)
+	if (ret == 1) {
 		rwsem_acquire_read(&sem->dep_map, 0, 1, _RET_IP_);
+		rwsem_ux_reader_add(sem);
+	}
 	return ret;
 }
 EXPORT_SYMBOL(down_read_trylock);
@@ -1662,6 +2184,7 @@ EXPORT_SYMBOL(down_write_trylock);
 void up_read(struct rw_semaphore *sem)
 {
 	rwsem_release(&sem->dep_map, 1, _RET_IP_);
+	rwsem_ux_reader_del(sem);
 	__up_read(sem);
 }
 EXPORT_SYMBOL(up_read);
@@ -1685,6 +2208,7 @@ void downgrade_write(struct rw_semaphore *sem)
 	lock_downgrade(&sem->dep_map, _RET_IP_);
 	trace_android_vh_rwsem_write_finished(sem);
 	__downgrade_write(sem);
+	rwsem_ux_reader_add(sem);
 }
 EXPORT_SYMBOL(downgrade_write);
 
@@ -1695,6 +2219,7 @@ void down_read_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, subclass, 0, _RET_IP_);
 	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	rwsem_ux_reader_add(sem);
 }
 EXPORT_SYMBOL(down_read_nested);
 
@@ -1740,6 +2265,7 @@ EXPORT_SYMBOL(down_write_killable_nested);
 void up_read_non_owner(struct rw_semaphore *sem)
 {
 	DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
+	rwsem_ux_reader_del(sem);
 	__up_read(sem);
 }
 EXPORT_SYMBOL(up_read_non_owner);
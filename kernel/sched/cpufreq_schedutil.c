@@ -14,6 +14,10 @@
 #include <trace/events/power.h>
 #include <linux/sched/sysctl.h>
 #include <trace/hooks/sched.h>
+#include <linux/dcvs_cogov.h>
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+#include <linux/im/im.h>
+#endif
 
 #define IOWAIT_BOOST_MIN	(SCHED_CAPACITY_SCALE / 8)
 
@@ -69,6 +73,9 @@ struct sugov_policy {
 
 	bool			limits_changed;
 	bool			need_freq_update;
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+	unsigned int		frame_freq;
+#endif
 #if defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST)
 	unsigned int flags;
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
@@ -101,6 +108,310 @@ static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
 static unsigned int stale_ns;
 static DEFINE_PER_CPU(struct sugov_tunables *, cached_tunables);
 
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+/*
+ * Frame deadline mode. A render thread writes its frame period in us to
+ * /proc/sugov_frame when it starts a frame and 0 when the frame is done.
+ * The cycles each frame took are averaged per thread, and while a frame
+ * is open and its thread runs on a CPU of a policy, that policy is kept
+ * at least at the lowest frequency retiring that much work within the
+ * period less SUGOV_FRAME_MARGIN percent. A frame still open past its
+ * deadline gets fmax. The frame floor is not subject to the up rate
+ * limit, which otherwise costs the first frames of a scroll.
+ *
+ * Slots are written under sugov_frame_lock and read locklessly through
+ * their seqcount by the update hooks. A frame left open SUGOV_FRAME_MAX_US
+ * past its deadline, by a thread that forgot it or is gone, is retired as
+ * abandoned from the update hook that finds it.
+ */
+#define SUGOV_FRAME_SLOTS	4
+#define SUGOV_FRAME_MARGIN	10
+#define SUGOV_FRAME_MAX_US	(USEC_PER_SEC / 10)
+
+enum {
+	FRAME_MISS_HALF,
+	FRAME_MISS,
+	FRAME_SLACK_10,
+	FRAME_SLACK_25,
+	FRAME_SLACK_50,
+	FRAME_SLACK_75,
+	FRAME_SLACK_100,
+	FRAME_ABANDONED,
+	FRAME_NR_BUCKETS,
+};
+
+static const char * const sugov_frame_bucket_names[FRAME_NR_BUCKETS] = {
+	"missed>50%",
+	"missed",
+	"slack<10%",
+	"slack<25%",
+	"slack<50%",
+	"slack<75%",
+	"slack>=75%",
+	"abandoned",
+};
+
+struct sugov_frame {
+	seqcount_t		seq;
+	struct task_struct	*task;	/* compared against rq->curr only */
+	u64			start;
+	u64			deadline;
+	u64			exec_start;
+	u64			work;	/* cycles per frame, EWMA */
+	unsigned int		freq;	/* floor while the frame is open */
+};
+
+static struct sugov_frame sugov_frames[SUGOV_FRAME_SLOTS];
+static u64 sugov_frame_hist[FRAME_NR_BUCKETS];
+static int sugov_frames_open;
+static DEFINE_RAW_SPINLOCK(sugov_frame_lock);
+
+/*
+ * Slot of @p, or with @alloc a free slot or else the one with the oldest
+ * deadline, to be taken over by sugov_frame_begin(). Called with
+ * sugov_frame_lock held.
+ */
+static struct sugov_frame *sugov_frame_slot(struct task_struct *p, bool alloc)
+{
+	struct sugov_frame *f, *victim = &sugov_frames[0];
+
+	for (f = sugov_frames; f < sugov_frames + SUGOV_FRAME_SLOTS; f++) {
+		if (f->task == p)
+			return f;
+		if (!f->task || (victim->task && f->deadline < victim->deadline))
+			victim = f;
+	}
+
+	return alloc ? victim : NULL;
+}
+
+/* Called with sugov_frame_lock held, inside the write section of @f */
+static void sugov_frame_close(struct sugov_frame *f)
+{
+	f->start = 0;
+	WRITE_ONCE(sugov_frames_open, sugov_frames_open - 1);
+}
+
+static void sugov_frame_account(struct sugov_frame *f, u64 now)
+{
+	u64 period = f->deadline - f->start;
+	unsigned int pct;
+	int bucket;
+
+	if (now > f->deadline) {
+		bucket = now - f->deadline > period / 2 ?
+			 FRAME_MISS_HALF : FRAME_MISS;
+	} else {
+		pct = div64_u64((f->deadline - now) * 100, period);
+		if (pct < 10)
+			bucket = FRAME_SLACK_10;
+		else if (pct < 25)
+			bucket = FRAME_SLACK_25;
+		else if (pct < 50)
+			bucket = FRAME_SLACK_50;
+		else if (pct < 75)
+			bucket = FRAME_SLACK_75;
+		else
+			bucket = FRAME_SLACK_100;
+	}
+	sugov_frame_hist[bucket]++;
+}
+
+static void sugov_frame_begin(unsigned int period_us)
+{
+	u64 period = (u64)period_us * NSEC_PER_USEC;
+	u64 now = ktime_get_ns();
+	u64 budget = div_u64(period * (100 - SUGOV_FRAME_MARGIN), 100);
+	struct sugov_frame *f;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&sugov_frame_lock, flags);
+	f = sugov_frame_slot(current, true);
+	write_seqcount_begin(&f->seq);
+	if (f->task != current) {
+		if (f->start)
+			sugov_frame_close(f);
+		f->task = current;
+		f->work = 0;
+	}
+	if (f->start)
+		sugov_frame_hist[FRAME_ABANDONED]++;
+	else
+		WRITE_ONCE(sugov_frames_open, sugov_frames_open + 1);
+
+	f->start = now;
+	f->deadline = now + period;
+	f->exec_start = current->se.sum_exec_runtime;
+	/* cycles / ns = GHz, so scale by 10^6 to get kHz */
+	f->freq = min_t(u64, div64_u64(f->work * NSEC_PER_MSEC, budget),
+			UINT_MAX);
+	write_seqcount_end(&f->seq);
+	raw_spin_unlock_irqrestore(&sugov_frame_lock, flags);
+}
+
+static void sugov_frame_end(void)
+{
+	unsigned int cur = cpufreq_quick_get(raw_smp_processor_id());
+	u64 exec = current->se.sum_exec_runtime;
+	u64 now = ktime_get_ns();
+	struct sugov_frame *f;
+	unsigned long flags;
+	u64 cycles;
+
+	raw_spin_lock_irqsave(&sugov_frame_lock, flags);
+	f = sugov_frame_slot(current, false);
+	if (!f || !f->start)
+		goto unlock;
+
+	sugov_frame_account(f, now);
+	cycles = div64_u64((exec - f->exec_start) * cur, NSEC_PER_MSEC);
+	write_seqcount_begin(&f->seq);
+	f->work = f->work ? (f->work * 3 + cycles) >> 2 : cycles;
+	sugov_frame_close(f);
+	write_seqcount_end(&f->seq);
+unlock:
+	raw_spin_unlock_irqrestore(&sugov_frame_lock, flags);
+}
+
+/*
+ * Retire @f as abandoned if it is still the frame seen in its @seq read
+ * section. Skipped when the lock is busy, the next update tries again.
+ */
+static void sugov_frame_expire(struct sugov_frame *f, unsigned int seq)
+{
+	if (!raw_spin_trylock(&sugov_frame_lock))
+		return;
+
+	if (!read_seqcount_retry(&f->seq, seq)) {
+		write_seqcount_begin(&f->seq);
+		sugov_frame_close(f);
+		write_seqcount_end(&f->seq);
+		sugov_frame_hist[FRAME_ABANDONED]++;
+	}
+	raw_spin_unlock(&sugov_frame_lock);
+}
+
+/*
+ * Frequency floor for @sg_policy from open frames whose thread is running
+ * on one of its CPUs. Runs from the update hooks with irqs disabled and
+ * takes no lock unless a frame has to be retired.
+ */
+static unsigned int sugov_frame_freq(struct sugov_policy *sg_policy)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	struct task_struct *task;
+	unsigned int freq = 0, ffreq, seq;
+	u64 now, start, deadline;
+	struct sugov_frame *f;
+	int cpu;
+
+	if (!READ_ONCE(sugov_frames_open))
+		return 0;
+
+	now = ktime_get_ns();
+	for (f = sugov_frames; f < sugov_frames + SUGOV_FRAME_SLOTS; f++) {
+		do {
+			seq = read_seqcount_begin(&f->seq);
+			task = f->task;
+			start = f->start;
+			deadline = f->deadline;
+			ffreq = f->freq;
+		} while (read_seqcount_retry(&f->seq, seq));
+
+		if (!start)
+			continue;
+		if (now > deadline + SUGOV_FRAME_MAX_US * NSEC_PER_USEC) {
+			sugov_frame_expire(f, seq);
+			continue;
+		}
+
+		for_each_cpu(cpu, policy->cpus) {
+			if (READ_ONCE(cpu_rq(cpu)->curr) != task)
+				continue;
+			freq = max(freq, now >= deadline ?
+				   policy->cpuinfo.max_freq : ffreq);
+			break;
+		}
+	}
+
+	return freq;
+}
+
+static unsigned int sugov_frame_apply(struct sugov_policy *sg_policy,
+				      unsigned int next_f)
+{
+	if (sg_policy->frame_freq <= next_f)
+		return next_f;
+
+	/* get_next_freq() must not hand the raised freq back later */
+	sg_policy->cached_raw_freq = 0;
+	return cpufreq_driver_resolve_freq(sg_policy->policy,
+					   sg_policy->frame_freq);
+}
+
+static ssize_t sugov_frame_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	unsigned int period_us;
+	int ret;
+
+	ret = kstrtouint_from_user(buf, count, 0, &period_us);
+	if (ret)
+		return ret;
+
+	if (period_us > SUGOV_FRAME_MAX_US)
+		return -EINVAL;
+
+	if (!im_render(current) && !im_sf(current) &&
+	    !(current->im_flag & IM_HWUI))
+		return -EPERM;
+
+	if (period_us)
+		sugov_frame_begin(period_us);
+	else
+		sugov_frame_end();
+
+	return count;
+}
+
+static int sugov_frame_show(struct seq_file *m, void *v)
+{
+	u64 hist[FRAME_NR_BUCKETS];
+	unsigned long flags;
+	int i, open;
+
+	raw_spin_lock_irqsave(&sugov_frame_lock, flags);
+	memcpy(hist, sugov_frame_hist, sizeof(hist));
+	open = sugov_frames_open;
+	raw_spin_unlock_irqrestore(&sugov_frame_lock, flags);
+
+	for (i = 0; i < FRAME_NR_BUCKETS; i++)
+		seq_printf(m, "%s: %llu\n", sugov_frame_bucket_names[i], hist[i]);
+	seq_printf(m, "open: %d\n", open);
+
+	return 0;
+}
+
+static int sugov_frame_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sugov_frame_show, NULL);
+}
+
+static const struct file_operations sugov_frame_fops = {
+	.open		= sugov_frame_open,
+	.read		= seq_read,
+	.write		= sugov_frame_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#else
+static inline unsigned int sugov_frame_apply(struct sugov_policy *sg_policy,
+					     unsigned int next_f)
+{
+	return next_f;
+}
+#endif /* CONFIG_OPLUS_FEATURE_SUGOV_FRAME */
+
 /************************ Governor internals ***********************/
 
 static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
@@ -125,12 +436,20 @@ static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
 	if (!cpufreq_this_cpu_can_update(sg_policy->policy))
 		return false;
 
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+	sg_policy->frame_freq = sugov_frame_freq(sg_policy);
+#endif
 	if (unlikely(sg_policy->limits_changed)) {
 		sg_policy->limits_changed = false;
 		sg_policy->need_freq_update = true;
 		return true;
 	}
 
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+	if (sg_policy->frame_freq > sg_policy->next_freq)
+		return true;
+#endif
+
 	/* No need to recalculate next freq for min_rate_limit_us
 	 * at least. However we might still decide to further rate
 	 * limit once frequency change direction is decided, according
@@ -156,6 +475,11 @@ static bool sugov_up_down_rate_limit(struct sugov_policy *sg_policy, u64 time,
 	if (sg_policy->flags & SCHED_CPUFREQ_BOOST)
 		return false;
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+	if (next_freq > sg_policy->next_freq &&
+	    sg_policy->frame_freq > sg_policy->next_freq)
+		return false;
+#endif
 	if (next_freq > sg_policy->next_freq &&
 	    delta_ns < sg_policy->up_rate_delay_ns)
 			return true;
@@ -824,6 +1148,7 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 
 	sugov_walt_adjust(sg_cpu, &util, &max);
 	next_f = get_next_freq(sg_policy, util, max);
+	next_f = sugov_frame_apply(sg_policy, next_f);
 	/*
 	 * Do not reduce the frequency if the CPU has not been idle
 	 * recently, as the reduction is likely to be premature then.
@@ -834,6 +1159,7 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 		/* Reset cached freq as next_freq has changed */
 		sg_policy->cached_raw_freq = 0;
 	}
+	dcvs_cogov_update_cpu(sg_policy->policy, time, util, max, next_f);
 
 	/*
 	 * This code runs under rq->lock for the target CPU, so it won't run
@@ -855,7 +1181,7 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 	struct cpufreq_policy *policy = sg_policy->policy;
 	u64 last_freq_update_time = sg_policy->last_freq_update_time;
 	unsigned long util = 0, max = 1;
-	unsigned int j;
+	unsigned int j, next_f;
 
 	for_each_cpu(j, policy->cpus) {
 		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
@@ -895,7 +1221,10 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 		sugov_walt_adjust(j_sg_cpu, &util, &max);
 	}
 
-	return get_next_freq(sg_policy, util, max);
+	next_f = sugov_frame_apply(sg_policy, get_next_freq(sg_policy, util, max));
+	dcvs_cogov_update_cpu(policy, time, util, max, next_f);
+
+	return next_f;
 }
 
 static void
@@ -1653,6 +1982,13 @@ struct cpufreq_governor *cpufreq_default_governor(void)
 
 static int __init sugov_register(void)
 {
+#ifdef CONFIG_OPLUS_FEATURE_SUGOV_FRAME
+	int i;
+
+	for (i = 0; i < SUGOV_FRAME_SLOTS; i++)
+		seqcount_init(&sugov_frames[i].seq);
+	proc_create("sugov_frame", 0666, NULL, &sugov_frame_fops);
+#endif
 	return cpufreq_register_governor(&schedutil_gov);
 }
 core_initcall(sugov_register);
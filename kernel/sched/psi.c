@@ -1020,6 +1020,25 @@ int psi_show(struct seq_file *m, struct psi_group *group, enum psi_res res)
 	return 0;
 }
 
+/*
+ * Cumulative system memory stall time in ns, brought up to date first.
+ * Lets in-kernel controllers sample faster than the 2s averages.
+ */
+void psi_memstall_total(u64 *some, u64 *full)
+{
+	if (static_branch_likely(&psi_disabled)) {
+		*some = *full = 0;
+		return;
+	}
+
+	mutex_lock(&psi_system.avgs_lock);
+	collect_percpu_times(&psi_system, PSI_AVGS, NULL);
+	*some = psi_system.total[PSI_AVGS][PSI_MEM_SOME];
+	*full = psi_system.total[PSI_AVGS][PSI_MEM_FULL];
+	mutex_unlock(&psi_system.avgs_lock);
+}
+EXPORT_SYMBOL_GPL(psi_memstall_total);
+
 static int psi_io_show(struct seq_file *m, void *v)
 {
 	return psi_show(m, &psi_system, PSI_IO);
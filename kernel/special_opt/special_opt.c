@@ -4,16 +4,50 @@
  */
 
 
+#include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/cpuhotplug.h>
+#include <linux/mutex.h>
+#include <linux/pm_qos.h>
 #include <linux/sched.h>
-#include <linux/reciprocal_div.h>
+#include <linux/sched/signal.h>
 #include <../kernel/sched/sched.h>
 #include "special_opt.h"
 
 #if IS_ENABLED(CONFIG_OPLUS_FEATURE_UIFRIST_HEAVYLOAD)
+#include <trace/events/sched.h>
 #include <trace/hooks/sched.h>
 static int sysctl_cpu_multi_thread = 0;
-static int ux_prefer_cpu[NR_CPUS] = { 0 };
 module_param_named(enable, sysctl_cpu_multi_thread, uint, 0644);
+
+/*
+ * CPUs heavy load tasks are steered to, and everything else kept off.
+ * It is rebuilt into the spare buffer and switched in with one store, so
+ * the find_best_target hook tests it without a lock.
+ */
+static struct cpumask ux_prefer_masks[2];
+static struct cpumask *ux_prefer_mask = &ux_prefer_masks[0];
+static DEFINE_MUTEX(ux_map_lock);
+
+/* cpufreq limits as last seen, in kHz; 0 until the policy shows up */
+static unsigned int ux_cpu_max_freq[NR_CPUS];
+static unsigned int ux_cpu_hw_max_freq[NR_CPUS];
+static struct cpufreq_policy *ux_watched_policy[NR_CPUS];
+static struct notifier_block ux_qos_nb[NR_CPUS];
+/* online cpus as seen by our hotplug callbacks, and their capacities */
+static struct cpumask ux_online_mask;
+static unsigned long ux_cpu_cap[NR_CPUS];
+
+/* a cpu capped below this percentage of its own capacity is throttled */
+static unsigned int ux_thermal_pct = UX_THERMAL_PCT;
+
+/* heavy load thresholds of a cpu, in util units, for its current capacity */
+struct heavy_load_thresh {
+	unsigned long cap;
+	unsigned long enter;
+	unsigned long exit;
+};
+static DEFINE_PER_CPU(struct heavy_load_thresh, heavy_load_thresh);
 #endif  /* IS_ENABLED(CONFIG_OPLUS_FEATURE_UIFRIST_HEAVYLOAD) */
 
 bool specopt_skip_balance(void)
@@ -21,49 +55,336 @@ bool specopt_skip_balance(void)
 	return (1 == sysctl_cpu_multi_thread) ? true : false;
 }
 
+/*
+ * The classification is kept in p->heavy_load by heavy_load_pelt_se(),
+ * so this is cheap enough for the wakeup and tick paths.
+ */
 bool is_heavy_load_task(struct task_struct *p)
 {
-	int cpu;
-	unsigned long thresh_load;
-	struct reciprocal_value spc_rdiv = reciprocal_value(100);
 	if (!sysctl_cpu_multi_thread || !p)
 		return false;
-	cpu = task_cpu(p);
-	thresh_load = capacity_orig_of(cpu) * HEAVY_LOAD_SCALE;
-	if (task_util(p) > reciprocal_divide(thresh_load, spc_rdiv))
-		return true;
-	return false;
+	return READ_ONCE(p->heavy_load);
 }
 
 #if IS_ENABLED(CONFIG_OPLUS_FEATURE_UIFRIST_HEAVYLOAD)
 
-static int ux_init_cpu_data(void)
+/* capacity_orig only moves with thermal or max frequency limits */
+static struct heavy_load_thresh *heavy_load_thresh_of(int cpu)
+{
+	struct heavy_load_thresh *th = &per_cpu(heavy_load_thresh, cpu);
+	unsigned long cap = capacity_orig_of(cpu);
+
+	if (unlikely(READ_ONCE(th->cap) != cap)) {
+		WRITE_ONCE(th->enter, cap * HEAVY_LOAD_SCALE / 100);
+		WRITE_ONCE(th->exit, cap * HEAVY_LOAD_EXIT_SCALE / 100);
+		WRITE_ONCE(th->cap, cap);
+	}
+	return th;
+}
+
+/*
+ * Reclassify a task whenever its PELT signal is updated. The task turns
+ * heavy above HEAVY_LOAD_SCALE percent of its cpu's capacity and back
+ * only below HEAVY_LOAD_EXIT_SCALE, so a util hovering around the
+ * threshold does not flip it on every wakeup.
+ */
+static void heavy_load_pelt_se(void *data, struct sched_entity *se)
+{
+	struct heavy_load_thresh *th;
+	struct task_struct *p;
+	unsigned long util;
+	int heavy;
+
+	if (!sysctl_cpu_multi_thread || !entity_is_task(se))
+		return;
+
+	p = container_of(se, struct task_struct, se);
+	th = heavy_load_thresh_of(task_cpu(p));
+	util = task_util(p);
+	heavy = READ_ONCE(p->heavy_load);
+	if (heavy ? util < READ_ONCE(th->exit) : util > READ_ONCE(th->enter))
+		WRITE_ONCE(p->heavy_load, !heavy);
+}
+
+/* children start light and earn the flag on their own */
+static void heavy_load_fork_handler(void *data, struct task_struct *p)
+{
+	p->heavy_load = 0;
+}
+
+static int heavy_tasks_get(char *buf, const struct kernel_param *kp)
+{
+	struct task_struct *g, *p;
+	int len = 0;
+
+	rcu_read_lock();
+	for_each_process_thread(g, p) {
+		if (!READ_ONCE(p->heavy_load))
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %s cpu%d\n",
+				 task_tgid_nr(p), task_pid_nr(p), p->comm,
+				 task_cpu(p));
+		if (len >= PAGE_SIZE - 1)
+			break;
+	}
+	rcu_read_unlock();
+
+	return len;
+}
+
+static const struct kernel_param_ops heavy_tasks_ops = {
+	.get = heavy_tasks_get,
+};
+/* tgid, tid, comm and cpu of every task currently classified heavy */
+module_param_cb(heavy_tasks, &heavy_tasks_ops, NULL, 0444);
+
+/* capacity of @cpu under its current cpufreq max limit */
+static unsigned long ux_cpu_capacity(int cpu)
+{
+	unsigned long cap = arch_scale_cpu_capacity(cpu);
+	unsigned int max = ux_cpu_max_freq[cpu];
+	unsigned int hw_max = ux_cpu_hw_max_freq[cpu];
+
+	if (hw_max && max && max < hw_max)
+		cap = cap * max / hw_max;
+	return cap;
+}
+
+/*
+ * Prefer every usable cpu above the min capacity cluster, as before, but
+ * leave out a throttled cpu when another candidate is at least as fast
+ * right now. On 1+3+4 parts this keeps UX threads off a capped prime core
+ * while the gold cores still run at full speed. Isolated cpus stay in the
+ * map: isolation has no notifier in this tree, so it is applied when the
+ * map is used, see ux_prefer_cpus().
+ */
+static void ux_rebuild_cpu_map_locked(void)
+{
+	unsigned int pct = READ_ONCE(ux_thermal_pct);
+	unsigned long min_orig = ULONG_MAX;
+	struct cpumask *new;
+	int cpu, other;
+
+	lockdep_assert_held(&ux_map_lock);
+	new = ux_prefer_mask == &ux_prefer_masks[0] ?
+		&ux_prefer_masks[1] : &ux_prefer_masks[0];
+	cpumask_clear(new);
+
+	for_each_possible_cpu(cpu)
+		min_orig = min(min_orig, arch_scale_cpu_capacity(cpu));
+
+	for_each_cpu(cpu, &ux_online_mask) {
+		if (arch_scale_cpu_capacity(cpu) <= min_orig)
+			continue;
+		ux_cpu_cap[cpu] = ux_cpu_capacity(cpu);
+		cpumask_set_cpu(cpu, new);
+	}
+
+	for_each_cpu(cpu, new) {
+		if (ux_cpu_cap[cpu] * 100 >=
+		    arch_scale_cpu_capacity(cpu) * pct)
+			continue;
+		for_each_cpu(other, new) {
+			if (other != cpu && ux_cpu_cap[other] >= ux_cpu_cap[cpu]) {
+				cpumask_clear_cpu(cpu, new);
+				break;
+			}
+		}
+	}
+
+	/* a single cluster, or every big cpu gone: no cpu is special */
+	if (cpumask_empty(new))
+		cpumask_copy(new, &ux_online_mask);
+
+	WRITE_ONCE(ux_prefer_mask, new);
+}
+
+static void ux_rebuild_cpu_map(void)
+{
+	mutex_lock(&ux_map_lock);
+	ux_rebuild_cpu_map_locked();
+	mutex_unlock(&ux_map_lock);
+}
+
+/*
+ * The map to steer by, or NULL while core_ctl has isolated every cpu in
+ * it: then no cpu is special, rather than heavy tasks having nowhere to go.
+ */
+static const struct cpumask *ux_prefer_cpus(void)
+{
+	const struct cpumask *mask = READ_ONCE(ux_prefer_mask);
+
+	if (cpumask_subset(mask, cpu_isolated_mask))
+		return NULL;
+	return mask;
+}
+
+static bool test_ux_task_cpu(const struct cpumask *mask, int cpu)
+{
+	return cpumask_test_cpu(cpu, mask);
+}
+
+static int ux_cpu_online(unsigned int cpu)
+{
+	mutex_lock(&ux_map_lock);
+	cpumask_set_cpu(cpu, &ux_online_mask);
+	ux_rebuild_cpu_map_locked();
+	mutex_unlock(&ux_map_lock);
+	return 0;
+}
+
+static int ux_cpu_offline(unsigned int cpu)
+{
+	mutex_lock(&ux_map_lock);
+	cpumask_clear_cpu(cpu, &ux_online_mask);
+	ux_rebuild_cpu_map_locked();
+	mutex_unlock(&ux_map_lock);
+	return 0;
+}
+
+/* FREQ_QOS_MAX changed, which is how thermal caps a cluster */
+static int ux_qos_max_notifier(struct notifier_block *nb,
+			       unsigned long max, void *data)
 {
-	int i = 0;
-	int min_cpu = 0, ux_cpu = 0;
+	int first = nb - ux_qos_nb;
+	struct cpufreq_policy *policy;
+	int cpu;
+
+	mutex_lock(&ux_map_lock);
+	policy = ux_watched_policy[first];
+	if (policy)
+		for_each_cpu(cpu, policy->related_cpus)
+			ux_cpu_max_freq[cpu] = max;
+	ux_rebuild_cpu_map_locked();
+	mutex_unlock(&ux_map_lock);
+
+	return NOTIFY_OK;
+}
 
-	for (; i < nr_cpu_ids; ++i) {
-		ux_prefer_cpu[i] = -1;
+/*
+ * The qos notifier chains are only touched without ux_map_lock held: a
+ * notification in flight holds its chain while it waits for the lock.
+ */
+static void ux_watch_policy(struct cpufreq_policy *policy)
+{
+	int first = cpumask_first(policy->related_cpus);
+	int cpu;
+
+	mutex_lock(&ux_map_lock);
+	if (ux_watched_policy[first]) {
+		mutex_unlock(&ux_map_lock);
+		return;
+	}
+	for_each_cpu(cpu, policy->related_cpus) {
+		ux_cpu_max_freq[cpu] = policy->max;
+		ux_cpu_hw_max_freq[cpu] = policy->cpuinfo.max_freq;
 	}
+	ux_watched_policy[first] = policy;
+	ux_rebuild_cpu_map_locked();
+	mutex_unlock(&ux_map_lock);
+
+	ux_qos_nb[first].notifier_call = ux_qos_max_notifier;
+	if (freq_qos_add_notifier(&policy->constraints, FREQ_QOS_MAX,
+				  &ux_qos_nb[first])) {
+		pr_err("uifirst: no thermal limits for cpu%d\n", first);
+		mutex_lock(&ux_map_lock);
+		ux_watched_policy[first] = NULL;
+		mutex_unlock(&ux_map_lock);
+	}
+}
+
+static void ux_unwatch_policy(struct cpufreq_policy *policy)
+{
+	int first = cpumask_first(policy->related_cpus);
+	bool watched;
+	int cpu;
+
+	mutex_lock(&ux_map_lock);
+	watched = ux_watched_policy[first] == policy;
+	if (watched) {
+		ux_watched_policy[first] = NULL;
+		for_each_cpu(cpu, policy->related_cpus)
+			ux_cpu_max_freq[cpu] = ux_cpu_hw_max_freq[cpu] = 0;
+		ux_rebuild_cpu_map_locked();
+	}
+	mutex_unlock(&ux_map_lock);
+
+	if (watched)
+		freq_qos_remove_notifier(&policy->constraints, FREQ_QOS_MAX,
+					 &ux_qos_nb[first]);
+}
+
+static int ux_policy_notifier(struct notifier_block *nb,
+			      unsigned long event, void *data)
+{
+	struct cpufreq_policy *policy = data;
+
+	if (event == CPUFREQ_CREATE_POLICY)
+		ux_watch_policy(policy);
+	else if (event == CPUFREQ_REMOVE_POLICY)
+		ux_unwatch_policy(policy);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block ux_policy_nb = {
+	.notifier_call = ux_policy_notifier,
+};
 
-	ux_cpu = cpumask_weight(topology_core_cpumask(min_cpu));
-	if (ux_cpu == 0) {
+static int ux_init_cpu_data(void)
+{
+	struct cpufreq_policy *policy;
+	int cpu, rc;
+
+	rc = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "special_opt:ux_map",
+			       ux_cpu_online, ux_cpu_offline);
+	if (rc < 0) {
 		pr_err("failed to init ux cpu data\n");
-		return -1;
+		return rc;
 	}
 
-	for (i = 0; i < nr_cpu_ids && ux_cpu < nr_cpu_ids; ++i) {
-		ux_prefer_cpu[i] = ux_cpu++;
+	rc = cpufreq_register_notifier(&ux_policy_nb, CPUFREQ_POLICY_NOTIFIER);
+	if (rc)
+		pr_err("uifirst: cpufreq policy notifier failed! rc=%d\n", rc);
+
+	/* policies that were there before the notifier */
+	for_each_possible_cpu(cpu) {
+		policy = cpufreq_cpu_get(cpu);
+		if (!policy)
+			continue;
+		ux_watch_policy(policy);
+		cpufreq_cpu_put(policy);
 	}
 
 	return 0;
 }
 
-static bool test_ux_task_cpu(int cpu)
+static int ux_prefer_cpus_get(char *buf, const struct kernel_param *kp)
+{
+	return scnprintf(buf, PAGE_SIZE, "%*pbl\n",
+			 cpumask_pr_args(READ_ONCE(ux_prefer_mask)));
+}
+
+static const struct kernel_param_ops ux_prefer_cpus_ops = {
+	.get = ux_prefer_cpus_get,
+};
+/* cpus heavy load tasks are currently steered to */
+module_param_cb(ux_prefer_cpus, &ux_prefer_cpus_ops, NULL, 0444);
+
+static int ux_thermal_pct_set(const char *val, const struct kernel_param *kp)
 {
-	return (cpu >= ux_prefer_cpu[0]);
+	int ret = param_set_uint(val, kp);
+
+	if (!ret)
+		ux_rebuild_cpu_map();
+	return ret;
 }
 
+static const struct kernel_param_ops ux_thermal_pct_ops = {
+	.set = ux_thermal_pct_set,
+	.get = param_get_uint,
+};
+module_param_cb(ux_thermal_pct, &ux_thermal_pct_ops, &ux_thermal_pct, 0644);
+
 static void check_preempt_wakeup_handler(void *data, struct task_struct *p,
 				  int *ignore)
 {
@@ -87,20 +408,27 @@ static void check_preempt_tick_handler(void *data, struct task_struct *p,
 static void find_best_target_handler(void *data, struct task_struct *p, int cpu,
 			      int *ignore)
 {
+	const struct cpumask *mask;
+
 	if (sysctl_cpu_multi_thread == 0)
 		return;
 
+	mask = ux_prefer_cpus();
+	if (!mask)
+		return;
+
 	if (is_heavy_load_task(p)) {
-		if (!test_ux_task_cpu(cpu))
+		if (!test_ux_task_cpu(mask, cpu))
 			*ignore = 1;
 	} else {
-		if (test_ux_task_cpu(cpu))
+		if (test_ux_task_cpu(mask, cpu))
 			*ignore = 1;
 	}
 }
 
 static void cpupri_find_fitness_handler(void *data, struct task_struct *p, struct cpumask *lowest_mask)
 {
+	const struct cpumask *mask;
 	unsigned int cpu;
 	if (sysctl_cpu_multi_thread == 0)
 		return;
@@ -109,9 +437,13 @@ static void cpupri_find_fitness_handler(void *data, struct task_struct *p, struc
 		return;
 	}
 
+	mask = ux_prefer_cpus();
+	if (!mask)
+		return;
+
 	cpu = cpumask_first(lowest_mask);
 	while (cpu < nr_cpu_ids) {
-		if (test_ux_task_cpu(cpu)) {
+		if (test_ux_task_cpu(mask, cpu)) {
 			cpumask_clear_cpu(cpu, lowest_mask);
 		}
 
@@ -153,18 +485,36 @@ static int register_vendor_hooks()
 		       rc);
 		return rc;
 	}
+
+	rc = register_trace_android_rvh_finish_prio_fork(
+		heavy_load_fork_handler, NULL);
+	if (rc != 0) {
+		pr_err("uifirst: register_trace_android_rvh_finish_prio_fork failed! rc=%d\n",
+		       rc);
+		return rc;
+	}
+
+	rc = register_trace_pelt_se_tp(heavy_load_pelt_se, NULL);
+	if (rc != 0) {
+		pr_err("uifirst: register_trace_pelt_se_tp failed! rc=%d\n",
+		       rc);
+		return rc;
+	}
 	return 0;
 }
 
 static int __init init_uifirst_sepecial_opt(void)
 {
-	int rc;
+	int rc, cpu;
 
 	rc = ux_init_cpu_data();
 	if (rc != 0) {
 		return rc;
 	}
 
+	for_each_possible_cpu(cpu)
+		heavy_load_thresh_of(cpu);
+
 	rc = register_vendor_hooks();
 	if (rc != 0) {
 		return rc;
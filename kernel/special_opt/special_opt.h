@@ -8,6 +8,10 @@
 #define _SPECIAL_OPT_H
 #define HEAVY_LOAD_RUNTIME (1024000000)
 #define HEAVY_LOAD_SCALE (80)
+/* a heavy task stays heavy until its util drops below this percentage */
+#define HEAVY_LOAD_EXIT_SCALE (70)
+/* default for special_opt.ux_thermal_pct */
+#define UX_THERMAL_PCT (90)
 extern bool is_heavy_load_task(struct task_struct *p);
 extern bool specopt_skip_balance(void);
 #endif /* _SPECIAL_OPT_H */
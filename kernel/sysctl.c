@@ -1679,6 +1679,33 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0666,
 		.proc_handler = proc_dointvec,
 	},
+#ifdef CONFIG_MUTEX_UX_HANDOFF
+	{
+		.procname	= "mutex_ux_handoff",
+		.data		= &sysctl_mutex_ux_handoff,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
+	{
+		.procname	= "mutex_ux_bypass_max",
+		.data		= &sysctl_mutex_ux_bypass_max,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+	},
+	{
+		.procname	= "mutex_ux_starve_ms",
+		.data		= &sysctl_mutex_ux_starve_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+	},
+#endif
 #endif /* defined(OPLUS_FEATURE_SCHED_ASSIST) && defined(CONFIG_OPLUS_FEATURE_SCHED_ASSIST) */
 #ifdef OPLUS_FEATURE_TASK_CPUSTATS
 #ifdef CONFIG_OPLUS_CTP
@@ -3071,6 +3071,12 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
 	page = lookup_swap_cache(entry, vma, vmf->address);
 	swapcache = page;
+#if defined(CONFIG_NANDSWAP)
+	nandswap_record_fault(vma, vmf->address, entry);
+#endif
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	zram_tier_count_fault(entry);
+#endif
 
 	if (!page) {
 		struct swap_info_struct *si = swp_swap_info(entry);
@@ -411,7 +411,7 @@ static void shrink_zone_span(struct zone *zone, unsigned long start_pfn,
 	}
 
 #if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
-	ajust_zone_label(zone);
+	flc_rebucket_zone_label(zone);
 #endif
 	/*
 	 * The section is not biggest or smallest mem_section in the zone, it
@@ -440,7 +440,7 @@ static void shrink_zone_span(struct zone *zone, unsigned long start_pfn,
 	zone->zone_start_pfn = 0;
 	zone->spanned_pages = 0;
 #if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
-	ajust_zone_label(zone);
+	flc_rebucket_zone_label(zone);
 #endif
 	zone_span_writeunlock(zone);
 }
@@ -691,7 +691,7 @@ static void __meminit resize_zone_range(struct zone *zone, unsigned long start_p
 
 	zone->spanned_pages = max(start_pfn + nr_pages, old_end_pfn) - zone->zone_start_pfn;
 #if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
-	ajust_zone_label(zone);
+	flc_rebucket_zone_label(zone);
 #endif
 }
 
@@ -154,6 +154,55 @@ const struct file_operations proc_free_area_fops = {
     .write      = proc_free_area_write,
 };
 
+static int proc_flc_pcp_show(struct seq_file *m, void *p)
+{
+	pg_data_t *pgdat = NODE_DATA(0);
+	unsigned long hit, miss, refill, drain, cached;
+	struct flc_pcp *fp;
+	int zone_type, idx, cpu;
+
+	for (zone_type = 0; zone_type < MAX_NR_ZONES; zone_type++) {
+		struct zone *zone = &pgdat->node_zones[zone_type];
+
+		if (!managed_zone(zone))
+			continue;
+
+		cached = 0;
+		for_each_possible_cpu(cpu)
+			cached += per_cpu_ptr(zone->pageset, cpu)->flc_pcp.count;
+
+		seq_printf(m, "zone_name = %s, cached = %lu\n",
+			   zone_names[zone_type], cached);
+
+		for (idx = 0; idx < FLC_PCP_ORDERS; idx++) {
+			hit = miss = refill = drain = 0;
+			for_each_possible_cpu(cpu) {
+				fp = &per_cpu_ptr(zone->pageset, cpu)->flc_pcp;
+				hit += fp->hit[idx];
+				miss += fp->miss[idx];
+				refill += fp->refill[idx];
+				drain += fp->drain[idx];
+			}
+			seq_printf(m, "order = %d, hit = %lu, miss = %lu, refill = %lu, drain = %lu\n",
+				   idx + FLC_PCP_MIN_ORDER, hit, miss, refill, drain);
+		}
+	}
+
+	return 0;
+}
+
+static int proc_flc_pcp_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proc_flc_pcp_show, NULL);
+}
+
+const struct file_operations proc_flc_pcp_fops = {
+	.open		= proc_flc_pcp_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 
 void list_sort_add(struct page *page, struct zone *zone, unsigned int order, int mt)
 {
@@ -201,15 +250,11 @@ int page_to_flc(struct page *page)
     return flc;
 }
 
-void ajust_zone_label(struct zone *zone)
+static void ajust_zone_segment(struct zone *zone)
 {
     int i;
     unsigned long prev_base;
 
-    for (i = 0; i < FREE_AREA_COUNTS; i++) {
-        zone->zone_label[i].label = zone->zone_start_pfn + zone->spanned_pages * (i + 1) / FREE_AREA_COUNTS;
-	}
-
     for (i = 0; i < FREE_AREA_COUNTS; i++) {
         if (i == 0)
             prev_base = zone->zone_start_pfn;
@@ -221,6 +266,17 @@ void ajust_zone_label(struct zone *zone)
     }
 }
 
+void ajust_zone_label(struct zone *zone)
+{
+    int i;
+
+    for (i = 0; i < FREE_AREA_COUNTS; i++) {
+        zone->zone_label[i].label = zone->zone_start_pfn + zone->spanned_pages * (i + 1) / FREE_AREA_COUNTS;
+	}
+
+    ajust_zone_segment(zone);
+}
+
 unsigned int ajust_flc(unsigned int current_flc, unsigned int order)
 {
     /* when alloc_order >= HIGH_ORDER_TO_FLC, 
@@ -233,3 +289,324 @@ unsigned int ajust_flc(unsigned int current_flc, unsigned int order)
 }
 
 
+
+/*
+ * Label controller.
+ *
+ * ajust_flc() makes high orders try the top flc first and low orders try it
+ * last, so the top flc is where high-order blocks survive. The controller
+ * moves the boundary between the top flc and the one below it once per
+ * window: when high-order slowpath allocations keep failing or stalling
+ * and the top flc has no free block of label_ctrl_order left while its
+ * neighbour still has one, the top flc takes label_ctrl_step pageblocks
+ * from the neighbour. After label_ctrl_idle_windows quiet windows it gives
+ * them back, step by step, until the boundary is at its default position.
+ */
+enum {
+	FLC_LABEL_HOLD,
+	FLC_LABEL_GROW,
+	FLC_LABEL_SHRINK,
+};
+
+static unsigned int label_ctrl_enable = 1;
+static unsigned int label_ctrl_interval_ms = 1000;
+static unsigned int label_ctrl_order = 4;
+static unsigned int label_ctrl_events = 4;
+static unsigned int label_ctrl_stall_ms = 10;
+static unsigned int label_ctrl_step = 32;
+static unsigned int label_ctrl_max_pct = 50;
+static unsigned int label_ctrl_idle_windows = 30;
+
+module_param_named(label_ctrl_enable, label_ctrl_enable, uint, 0644);
+module_param_named(label_ctrl_interval_ms, label_ctrl_interval_ms, uint, 0644);
+module_param_named(label_ctrl_order, label_ctrl_order, uint, 0644);
+module_param_named(label_ctrl_events, label_ctrl_events, uint, 0644);
+module_param_named(label_ctrl_stall_ms, label_ctrl_stall_ms, uint, 0644);
+module_param_named(label_ctrl_step, label_ctrl_step, uint, 0644);
+module_param_named(label_ctrl_max_pct, label_ctrl_max_pct, uint, 0644);
+module_param_named(label_ctrl_idle_windows, label_ctrl_idle_windows, uint, 0644);
+
+static atomic_t high_order_events = ATOMIC_INIT(0);
+static atomic_t high_order_count = ATOMIC_INIT(0);
+static atomic64_t high_order_wait_ms = ATOMIC64_INIT(0);
+static unsigned int label_idle_windows[MAX_NR_ZONES];
+
+static void flc_label_ctrl_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(flc_label_work, flc_label_ctrl_fn);
+/* no window is queued, the next high-order event queues one */
+static bool flc_label_parked;
+
+static void flc_label_kick(void)
+{
+	if (READ_ONCE(flc_label_parked) && xchg(&flc_label_parked, false))
+		queue_delayed_work(system_power_efficient_wq, &flc_label_work,
+			msecs_to_jiffies(max(label_ctrl_interval_ms, 100U)));
+}
+
+/*
+ * Called next to memory_alloc_monitor() at the end of the allocation
+ * slowpath, @page is NULL when the allocation failed.
+ */
+void flc_alloc_monitor(unsigned int order, struct page *page, u64 wait_ms)
+{
+	if (order < HIGH_ORDER_TO_FLC)
+		return;
+
+	atomic_inc(&high_order_count);
+	atomic64_add(wait_ms, &high_order_wait_ms);
+	if (!page || wait_ms >= label_ctrl_stall_ms) {
+		atomic_inc(&high_order_events);
+		flc_label_kick();
+	}
+}
+
+/* Same as fragmentation_index(), restricted to a single flc */
+static int flc_fragmentation_index(struct zone *zone, int flc,
+					unsigned int order)
+{
+	unsigned long free_pages = 0, blocks_total = 0, blocks_suitable = 0;
+	unsigned long blocks;
+	unsigned int o;
+
+	if (order >= MAX_ORDER)
+		return 0;
+
+	for (o = 0; o < MAX_ORDER; o++) {
+		blocks = READ_ONCE(zone->free_area[flc][o].nr_free);
+		blocks_total += blocks;
+		free_pages += blocks << o;
+		if (o >= order)
+			blocks_suitable += blocks << (o - order);
+	}
+
+	if (!blocks_total)
+		return 0;
+
+	if (blocks_suitable)
+		return -1000;
+
+	return 1000 - div_u64(1000 + div_u64(free_pages * 1000ULL, 1UL << order),
+			      blocks_total);
+}
+
+/*
+ * Move every free page whose head pfn lies in (start_pfn, end_pfn] from
+ * the free_area of @from to the one of @to. The pages are put on the list
+ * of their pageblock's migratetype, as move_freepages() does.
+ *
+ * Caller holds zone->lock and has already updated the labels.
+ */
+static void flc_relabel_range(struct zone *zone, unsigned long start_pfn,
+			unsigned long end_pfn, int from, int to)
+{
+	unsigned long pfn = start_pfn + 1;
+	struct page *page;
+	unsigned int order;
+	int mt;
+
+	while (pfn <= end_pfn) {
+		if (!pfn_valid(pfn)) {
+			pfn++;
+			continue;
+		}
+
+		page = pfn_to_page(pfn);
+		if (!PageBuddy(page) || page_zone(page) != zone) {
+			pfn++;
+			continue;
+		}
+
+		order = page_order(page);
+		mt = get_pageblock_migratetype(page);
+		list_move(&page->lru, &zone->free_area[to][order].free_list[mt]);
+		zone->free_area[from][order].nr_free--;
+		zone->free_area[to][order].nr_free++;
+		pfn += 1UL << order;
+	}
+}
+
+/*
+ * Move the boundary below the top flc from @from to @to one pageblock at
+ * a time, rebucketing the free pages that change flc as it goes. Each
+ * pageblock is done in a zone->lock section of its own, so irqs are never
+ * off for more than one pageblock. Stops if the boundary was moved under
+ * us, although memory hotplug, the only other writer, is held off by
+ * get_online_mems() in flc_label_ctrl_fn().
+ */
+static void flc_move_label(struct zone *zone, unsigned long from,
+			unsigned long to)
+{
+	const int top = FREE_AREA_COUNTS - 1;
+	unsigned long label = from, next;
+	unsigned long flags;
+
+	while (label != to) {
+		if (to < label)
+			next = label - min(label - to, pageblock_nr_pages);
+		else
+			next = label + min(to - label, pageblock_nr_pages);
+
+		spin_lock_irqsave(&zone->lock, flags);
+		if (zone->zone_label[top - 1].label != label) {
+			spin_unlock_irqrestore(&zone->lock, flags);
+			break;
+		}
+		zone->zone_label[top - 1].label = next;
+		ajust_zone_segment(zone);
+		if (next < label)
+			flc_relabel_range(zone, next, label, top - 1, top);
+		else
+			flc_relabel_range(zone, label, next, top, top - 1);
+		spin_unlock_irqrestore(&zone->lock, flags);
+
+		label = next;
+		cond_resched();
+	}
+}
+
+/*
+ * One window for @zone. Returns true while the boundary is off its
+ * default position, i.e. while idle windows still have to be counted.
+ */
+static bool flc_label_ctrl_zone(struct zone *zone, int events, u64 avg_wait_ms)
+{
+	const int top = FREE_AREA_COUNTS - 1;
+	unsigned long old_label, new_label, def_label, min_label, step;
+	unsigned int *idle = &label_idle_windows[zone_idx(zone)];
+	int decision = FLC_LABEL_HOLD;
+	int fi_top, fi_below;
+	unsigned long flags;
+
+	fi_top = flc_fragmentation_index(zone, top, label_ctrl_order);
+	fi_below = flc_fragmentation_index(zone, top - 1, label_ctrl_order);
+	step = (unsigned long)label_ctrl_step * pageblock_nr_pages;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	old_label = new_label = zone->zone_label[top - 1].label;
+	def_label = zone->zone_start_pfn +
+			zone->spanned_pages * top / FREE_AREA_COUNTS;
+	min_label = zone_end_pfn(zone) -
+			zone->spanned_pages * min(label_ctrl_max_pct, 100U) / 100;
+	/* the flc below must keep at least one step of its own */
+	min_label = max(min_label, zone->zone_label[top - 2].label + step);
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	if (events)
+		*idle = 0;
+
+	if (events >= label_ctrl_events && fi_top != -1000 &&
+			fi_below == -1000 && old_label > min_label) {
+		new_label = old_label > min_label + step ?
+				old_label - step : min_label;
+		decision = FLC_LABEL_GROW;
+	} else if (!events && old_label < def_label &&
+			++(*idle) >= label_ctrl_idle_windows) {
+		new_label = min(old_label + step, def_label);
+		decision = FLC_LABEL_SHRINK;
+		*idle = 0;
+	}
+
+	if (new_label != old_label)
+		flc_move_label(zone, old_label, new_label);
+
+	if (events || decision != FLC_LABEL_HOLD)
+		trace_mm_flc_label_adjust(zone, decision, old_label, new_label,
+					  events, avg_wait_ms, fi_top, fi_below);
+
+	return new_label != def_label;
+}
+
+/*
+ * Runs once per label_ctrl_interval_ms while there is something to do:
+ * high-order events in the last window, or a boundary that still has
+ * to go back to its default. Otherwise it parks until flc_alloc_monitor()
+ * sees the next event. The work is deferrable, an idle cpu is not woken
+ * for it.
+ */
+static void flc_label_ctrl_fn(struct work_struct *work)
+{
+	pg_data_t *pgdat = NODE_DATA(0);
+	int events, count, zone_type;
+	u64 wait_ms, avg_wait_ms = 0;
+	bool busy = false;
+
+	events = atomic_xchg(&high_order_events, 0);
+	count = atomic_xchg(&high_order_count, 0);
+	wait_ms = atomic64_xchg(&high_order_wait_ms, 0);
+	if (count)
+		avg_wait_ms = div_u64(wait_ms, count);
+
+	if (!label_ctrl_enable || !label_ctrl_step ||
+			label_ctrl_order >= MAX_ORDER)
+		goto park;
+
+	busy = events;
+	get_online_mems();
+	for (zone_type = 0; zone_type < MAX_NR_ZONES; zone_type++) {
+		struct zone *zone = &pgdat->node_zones[zone_type];
+
+		if (!managed_zone(zone))
+			continue;
+
+		if (flc_label_ctrl_zone(zone, events, avg_wait_ms))
+			busy = true;
+	}
+	put_online_mems();
+
+	if (busy) {
+		queue_delayed_work(system_power_efficient_wq, &flc_label_work,
+			msecs_to_jiffies(max(label_ctrl_interval_ms, 100U)));
+		return;
+	}
+
+park:
+	WRITE_ONCE(flc_label_parked, true);
+	/* an event that came in meanwhile did not see the park */
+	smp_mb();
+	if (atomic_read(&high_order_events))
+		flc_label_kick();
+}
+
+/*
+ * Memory hotplug resizes @zone and resets its labels to the defaults.
+ * The free pages whose flc changed with that are rebucketed under the
+ * same zone->lock section, so per-flc nr_free keeps matching
+ * page_to_flc(). The label controller is held off meanwhile: it runs
+ * under get_online_mems() and hotplug callers are inside
+ * mem_hotplug_begin().
+ */
+void flc_rebucket_zone_label(struct zone *zone)
+{
+	unsigned int flc, order, to;
+	struct page *page, *next;
+	unsigned long flags;
+	int mt;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	ajust_zone_label(zone);
+	for (flc = 0; flc < FREE_AREA_COUNTS; flc++) {
+		for_each_migratetype_order(order, mt) {
+			struct list_head *list =
+				&zone->free_area[flc][order].free_list[mt];
+
+			list_for_each_entry_safe(page, next, list, lru) {
+				to = page_to_flc(page);
+				if (to == flc)
+					continue;
+				list_move(&page->lru,
+					  &zone->free_area[to][order].free_list[mt]);
+				zone->free_area[flc][order].nr_free--;
+				zone->free_area[to][order].nr_free++;
+			}
+		}
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+}
+
+static int __init flc_label_ctrl_init(void)
+{
+	queue_delayed_work(system_power_efficient_wq, &flc_label_work,
+			   msecs_to_jiffies(label_ctrl_interval_ms));
+	return 0;
+}
+late_initcall(flc_label_ctrl_init);
@@ -9,10 +9,13 @@
 #define HIGH_ORDER_TO_FLC 3
 
 extern const struct file_operations proc_free_area_fops;
+extern const struct file_operations proc_flc_pcp_fops;
 
 extern void list_sort_add(struct page *page, struct zone *zone, unsigned int order, int mt);
 extern int page_to_flc(struct page *page);
 extern void ajust_zone_label(struct zone *zone);
+extern void flc_rebucket_zone_label(struct zone *zone);
 extern unsigned int ajust_flc(unsigned int current_flc, unsigned int order);
+extern void flc_alloc_monitor(unsigned int order, struct page *page, u64 wait_ms);
 
 #endif //__MULTI_FREEAREA_H__
@@ -1390,6 +1390,103 @@ static void free_one_page(struct zone *zone,
 	spin_unlock(&zone->lock);
 }
 
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+static inline bool flc_pcp_order(unsigned int order)
+{
+	return order >= FLC_PCP_MIN_ORDER && order <= FLC_PCP_MAX_ORDER;
+}
+
+/*
+ * Return up to @count base pages from the flc pcp lists to the buddy
+ * allocator, all under a single hold of zone->lock. Higher orders are
+ * given back first as they have the best chance to merge, and each list
+ * is emptied from its tail, i.e. the least preferred flc goes first.
+ */
+static void free_flc_pcp_bulk(struct zone *zone, int count,
+					struct flc_pcp *fp)
+{
+	struct list_head head[FLC_PCP_ORDERS];
+	bool isolated_pageblocks;
+	struct page *page, *tmp;
+	int order, idx, mt;
+
+	count = min(fp->count, count);
+	for (idx = FLC_PCP_ORDERS - 1; idx >= 0; idx--) {
+		order = idx + FLC_PCP_MIN_ORDER;
+		INIT_LIST_HEAD(&head[idx]);
+
+		for (mt = 0; mt < MIGRATE_PCPTYPES && count > 0; mt++) {
+			struct list_head *list = &fp->lists[idx][mt];
+
+			while (count > 0 && !list_empty(list)) {
+				page = list_last_entry(list, struct page, lru);
+				list_move_tail(&page->lru, &head[idx]);
+				fp->count -= 1 << order;
+				fp->drain[idx]++;
+				count -= 1 << order;
+			}
+		}
+	}
+
+	spin_lock(&zone->lock);
+	isolated_pageblocks = has_isolate_pageblock(zone);
+
+	for (idx = FLC_PCP_ORDERS - 1; idx >= 0; idx--) {
+		order = idx + FLC_PCP_MIN_ORDER;
+
+		list_for_each_entry_safe(page, tmp, &head[idx], lru) {
+			mt = get_pcppage_migratetype(page);
+			/* Pageblock could have been isolated meanwhile */
+			if (unlikely(isolated_pageblocks))
+				mt = get_pageblock_migratetype(page);
+
+			__free_one_page(page, page_to_pfn(page), zone, order, mt);
+			trace_mm_page_pcpu_drain(page, order, mt);
+		}
+	}
+	spin_unlock(&zone->lock);
+}
+
+/*
+ * Put a low-order page on this CPU's flc pcp lists. Pages belonging to the
+ * flc that ajust_flc() prefers for this order go to the head so they are
+ * handed out again first. Returns false if the page is not cacheable and
+ * has to be freed to the buddy allocator directly.
+ *
+ * Must be called with interrupts disabled.
+ */
+static bool free_flc_pcp_page(struct zone *zone, struct page *page,
+				unsigned int order, int migratetype)
+{
+	struct flc_pcp *fp;
+	int idx;
+
+	if (!flc_pcp_order(order))
+		return false;
+
+	/* Isolated, highatomic and CMA pages stay out of the cache */
+	if (migratetype >= MIGRATE_PCPTYPES || is_migrate_cma(migratetype))
+		return false;
+
+	fp = &this_cpu_ptr(zone->pageset)->flc_pcp;
+	if (!READ_ONCE(fp->high))
+		return false;
+
+	idx = order - FLC_PCP_MIN_ORDER;
+	set_pcppage_migratetype(page, migratetype);
+	if (page_to_flc(page) == ajust_flc(0, order))
+		list_add(&page->lru, &fp->lists[idx][migratetype]);
+	else
+		list_add_tail(&page->lru, &fp->lists[idx][migratetype]);
+	fp->count += 1 << order;
+
+	if (fp->count >= READ_ONCE(fp->high))
+		free_flc_pcp_bulk(zone, READ_ONCE(fp->batch), fp);
+
+	return true;
+}
+#endif
+
 static void __meminit __init_single_page(struct page *page, unsigned long pfn,
 				unsigned long zone, int nid)
 {
@@ -1476,6 +1573,12 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	migratetype = get_pfnblock_migratetype(page, pfn);
 	local_irq_save(flags);
 	__count_vm_events(PGFREE, 1 << order);
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	if (free_flc_pcp_page(page_zone(page), page, order, migratetype)) {
+		local_irq_restore(flags);
+		return;
+	}
+#endif
 	free_one_page(page_zone(page), page, pfn, order, migratetype);
 	local_irq_restore(flags);
 }
@@ -3069,6 +3172,10 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 	pcp = &pset->pcp;
 	if (pcp->count)
 		free_pcppages_bulk(zone, pcp->count, pcp);
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	if (pset->flc_pcp.count)
+		free_flc_pcp_bulk(zone, pset->flc_pcp.count, &pset->flc_pcp);
+#endif
 	local_irq_restore(flags);
 }
 
@@ -3172,10 +3279,18 @@ void drain_all_pages(struct zone *zone)
 			pcp = per_cpu_ptr(zone->pageset, cpu);
 			if (pcp->pcp.count)
 				has_pcps = true;
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+			if (pcp->flc_pcp.count)
+				has_pcps = true;
+#endif
 		} else {
 			for_each_populated_zone(z) {
 				pcp = per_cpu_ptr(z->pageset, cpu);
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+				if (pcp->pcp.count || pcp->flc_pcp.count) {
+#else
 				if (pcp->pcp.count) {
+#endif
 					has_pcps = true;
 					break;
 				}
@@ -3528,6 +3643,63 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 	return page;
 }
 
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+/*
+ * Remove a low-order page from this CPU's flc pcp lists. An empty list is
+ * refilled from the multi free_area lists with a whole batch under one hold
+ * of zone->lock; __rmqueue() walks the flcs in ajust_flc() order, so the
+ * refill comes from the label this order prefers.
+ */
+static struct page *rmqueue_flc_pcp(struct zone *preferred_zone,
+			struct zone *zone, unsigned int order,
+			int migratetype, unsigned int alloc_flags)
+{
+	struct flc_pcp *fp;
+	struct list_head *list;
+	struct page *page = NULL;
+	unsigned long flags;
+	int idx = order - FLC_PCP_MIN_ORDER;
+	int alloced;
+
+	local_irq_save(flags);
+	fp = &this_cpu_ptr(zone->pageset)->flc_pcp;
+	if (!READ_ONCE(fp->high))
+		goto out;
+
+	list = &fp->lists[idx][migratetype];
+	if (!list_empty(list)) {
+		fp->hit[idx]++;
+	} else {
+		fp->miss[idx]++;
+		alloced = rmqueue_bulk(zone, order,
+				max(1, READ_ONCE(fp->batch) >> order),
+				list, migratetype, alloc_flags);
+		if (!alloced)
+			goto out;
+		fp->count += alloced << order;
+		fp->refill[idx]++;
+	}
+
+	do {
+		if (list_empty(list)) {
+			page = NULL;
+			break;
+		}
+		page = list_first_entry(list, struct page, lru);
+		list_del(&page->lru);
+		fp->count -= 1 << order;
+	} while (check_new_pages(page, order));
+
+	if (page) {
+		__count_zid_vm_events(PGALLOC, page_zonenum(page), 1 << order);
+		zone_statistics(preferred_zone, zone);
+	}
+out:
+	local_irq_restore(flags);
+	return page;
+}
+#endif
+
 /*
  * Allocate a page from the given zone. Use pcplists for order-0 allocations.
  */
@@ -3551,6 +3723,23 @@ struct page *rmqueue(struct zone *preferred_zone,
 	 * allocate greater than order-1 page units with __GFP_NOFAIL.
 	 */
 	WARN_ON_ONCE((gfp_flags & __GFP_NOFAIL) && (order > 1));
+
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	/*
+	 * Movable requests that may use CMA keep going to the buddy lists
+	 * directly, the flc pcp lists never hold CMA pages.
+	 */
+	if (flc_pcp_order(order) && migratetype < MIGRATE_PCPTYPES &&
+			!is_migrate_cma(migratetype) &&
+			!(migratetype == MIGRATE_MOVABLE &&
+			  gfp_flags & __GFP_CMA)) {
+		page = rmqueue_flc_pcp(preferred_zone, zone, order,
+					migratetype, alloc_flags);
+		if (page)
+			goto out;
+	}
+#endif
+
 	spin_lock_irqsave(&zone->lock, flags);
 
 	do {
@@ -5014,6 +5203,9 @@ __alloc_pages_slowpath(gfp_t gfp_mask, unsigned int order,
 	memory_alloc_monitor(gfp_mask, order, jiffies_to_msecs(jiffies - alloc_start));
 #endif
 #endif /* OPLUS_FEATURE_HEALTHINFO */
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	flc_alloc_monitor(order, page, jiffies_to_msecs(jiffies - alloc_start));
+#endif
 	return page;
 }
 
@@ -6522,12 +6714,21 @@ static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
 	int migratetype;
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	int idx;
+#endif
 
 	memset(p, 0, sizeof(*p));
 
 	pcp = &p->pcp;
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	for (idx = 0; idx < FLC_PCP_ORDERS; idx++)
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+							migratetype++)
+			INIT_LIST_HEAD(&p->flc_pcp.lists[idx][migratetype]);
+#endif
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
@@ -6550,6 +6751,21 @@ static void pageset_set_high(struct per_cpu_pageset *p,
 	pageset_update(&p->pcp, high, batch);
 }
 
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+/*
+ * Size the flc pcp lists from the order-0 pcp batch, but never below one
+ * page of the highest cached order. The boot pagesets never get here and
+ * keep high == 0, which disables the cache.
+ */
+static void flc_pcp_set_high_and_batch(struct per_cpu_pageset *p)
+{
+	int batch = max(READ_ONCE(p->pcp.batch), 1 << FLC_PCP_MAX_ORDER);
+
+	WRITE_ONCE(p->flc_pcp.batch, batch);
+	WRITE_ONCE(p->flc_pcp.high, 4 * batch);
+}
+#endif
+
 static void pageset_set_high_and_batch(struct zone *zone,
 				       struct per_cpu_pageset *pcp)
 {
@@ -6559,6 +6775,9 @@ static void pageset_set_high_and_batch(struct zone *zone,
 				percpu_pagelist_fraction));
 	else
 		pageset_set_batch(pcp, zone_batchsize(zone));
+#if defined(CONFIG_PHYSICAL_ANTI_FRAGMENTATION)
+	flc_pcp_set_high_and_batch(pcp);
+#endif
 }
 
 static void __meminit zone_pageset_init(struct zone *zone, int cpu)
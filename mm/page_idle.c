@@ -92,7 +92,11 @@ static bool page_idle_clear_pte_refs_one(struct page *page,
 	return true;
 }
 
-static void page_idle_clear_pte_refs(struct page *page)
+/*
+ * Transfer the young bits of all ptes mapping @page to its idle/young
+ * flags. Also used by process reclaim to check shared pages.
+ */
+void page_idle_clear_pte_refs(struct page *page)
 {
 	/*
 	 * Since rwc.arg is unused, rwc is effectively immutable, so we
@@ -117,6 +121,7 @@ static void page_idle_clear_pte_refs(struct page *page)
 	if (need_lock)
 		unlock_page(page);
 }
+EXPORT_SYMBOL_GPL(page_idle_clear_pte_refs);
 
 static ssize_t page_idle_bitmap_read(struct file *file, struct kobject *kobj,
 				     struct bin_attribute *attr, char *buf,
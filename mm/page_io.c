@@ -25,6 +25,9 @@
 #include <linux/psi.h>
 #include <linux/uio.h>
 #include <linux/sched/task.h>
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+#include <trace/hooks/vh_vmscan.h>
+#endif
 #include <asm/pgtable.h>
 
 static struct bio *get_swap_bio(gfp_t gfp_flags,
@@ -322,6 +325,16 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 
 	ret = bdev_write_page(sis->bdev, swap_page_sector(page), page, wbc);
 	if (!ret) {
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+		/* rw_page is synchronous, the object is stored by now */
+		if (sis->tier_map) {
+			unsigned int size = 0;
+
+			trace_android_vh_swap_slot_obj_size(sis->bdev,
+					swap_page_sector(page), &size);
+			swap_tier_record(sis, page, size);
+		}
+#endif
 		count_swpout_vm_event(page);
 		return 0;
 	}
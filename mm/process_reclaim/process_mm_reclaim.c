@@ -24,6 +24,14 @@
 #include <asm/tlbflush.h>
 #include <linux/proc_fs.h>
 #include <linux/version.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/workqueue.h>
+#include <linux/percpu.h>
+#include <linux/cpu.h>
+#include <linux/page_idle.h>
+#include <linux/mmu_notifier.h>
+#include <linux/ptrace.h>
 #ifdef  CONFIG_FG_TASK_UID
 #include <linux/healthinfo/fg.h>
 #endif
@@ -45,6 +53,10 @@ enum reclaim_type {
 	RECLAIM_INACTIVE_FILE,
 	RECLAIM_INACTIVE_ANON,
 	RECLAIM_INACTIVE,
+	/*
+	 * reclaim only pages not accessed since the previous idle pass
+	 */
+	RECLAIM_IDLE,
 };
 
 #if !defined(CONFIG_OPLUS_SYSTEM_KERNEL_QCOM) || (LINUX_VERSION_CODE >= KERNEL_VERSION(5,4,0))
@@ -61,6 +73,8 @@ struct reclaim_param {
 	int nr_reclaimed;
 	/* flag that relcaim inactive pages only */
 	bool inactive_lru;
+	/* flag that reclaim pages idle since the previous pass only */
+	bool idle_only;
 	/* the target reclaimed process */
 	struct task_struct *reclaimed_task;
 };
@@ -100,9 +114,13 @@ static unsigned long stop_jiffies;
 static int reclaimer_pid = -1;
 static struct proc_dir_entry *enable = NULL;
 
+/* worker of the async engine currently running a job on this cpu */
+static DEFINE_PER_CPU(struct task_struct *, async_reclaimer);
+
 static void current_is_process_reclaimer(void *data, int *is_reclaimer)
 {
-	*is_reclaimer = (reclaimer_pid == current->group_leader->pid);
+	*is_reclaimer = (reclaimer_pid == current->group_leader->pid) ||
+		(this_cpu_read(async_reclaimer) == current);
 }
 
 /* If count < 0 means someone is waiting for sem write lock */
@@ -111,8 +129,8 @@ static inline int rwsem_is_waited(struct rw_semaphore *sem)
 	return atomic_long_read(&sem->count) < 0;
 }
 
-static inline int __is_reclaim_should_cancel(struct task_struct *task,
-		struct mm_struct *mm)
+static inline int __is_reclaim_job_should_cancel(struct task_struct *task,
+		struct mm_struct *mm, unsigned long deadline)
 {
 	if (mm != task->mm)
 		return -PR_TASK_DIE;
@@ -124,12 +142,18 @@ static inline int __is_reclaim_should_cancel(struct task_struct *task,
 #endif
 	if (task->state == TASK_RUNNING)
 		return -PR_TASK_RUN;
-	if (time_is_before_eq_jiffies(stop_jiffies))
+	if (time_is_before_eq_jiffies(deadline))
 		return -PR_TIME_OUT;
 
 	return 0;
 }
 
+static inline int __is_reclaim_should_cancel(struct task_struct *task,
+		struct mm_struct *mm)
+{
+	return __is_reclaim_job_should_cancel(task, mm, stop_jiffies);
+}
+
 int is_reclaim_should_cancel(struct mm_walk *walk)
 {
 	struct task_struct *task;
@@ -148,6 +172,63 @@ int is_reclaim_should_cancel(struct mm_walk *walk)
 	return __is_reclaim_should_cancel(task, mm);
 }
 
+#ifdef CONFIG_IDLE_PAGE_TRACKING
+/*
+ * RECLAIM_IDLE check, called with the pte lock held. A page is a candidate
+ * only if the previous pass marked it idle and nothing cleared the mark
+ * since: mark_page_accessed(), page_referenced() and a young bit in this
+ * pte all count as an access. Every other page is marked idle for the next
+ * pass. Like page_idle, a young pte is moved to the page young flag so
+ * that page reclaim still sees the access.
+ */
+static bool reclaim_pte_idle(struct vm_area_struct *vma, unsigned long addr,
+		pte_t *pte, struct page *page)
+{
+	if (ptep_clear_young_notify(vma, addr, pte)) {
+		clear_page_idle(page);
+		set_page_young(page);
+	}
+
+	if (page_is_idle(page))
+		return true;
+
+	set_page_idle(page);
+	return false;
+}
+#else
+static inline bool reclaim_pte_idle(struct vm_area_struct *vma,
+		unsigned long addr, pte_t *pte, struct page *page)
+{
+	return false;
+}
+#endif
+
+/*
+ * The pte walk only sees the mapping of the reclaimed process. Put back
+ * the isolated pages that another mapping accessed since the previous
+ * idle pass, @isolated_stat tells whether NR_ISOLATED_* was raised.
+ */
+static void reclaim_filter_shared_idle(struct list_head *page_list,
+		bool isolated_stat)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, page_list, lru) {
+		if (page_mapcount(page) <= 1)
+			continue;
+
+		page_idle_clear_pte_refs(page);
+		if (page_is_idle(page))
+			continue;
+
+		list_del(&page->lru);
+		if (isolated_stat)
+			dec_node_page_state(page, NR_ISOLATED_ANON +
+					page_is_file_cache(page));
+		putback_lru_page(page);
+	}
+}
+
 static int mm_reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 		unsigned long end, struct mm_walk *walk)
 {
@@ -187,6 +268,9 @@ static int mm_reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 					PageUnevictable(page)))
 			continue;
 
+		if (rp->idle_only && !reclaim_pte_idle(vma, addr, pte, page))
+			continue;
+
 		if (isolate_lru_page(page))
 			continue;
 
@@ -218,6 +302,10 @@ static int mm_reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 	}
 	pte_unmap_unlock(pte - 1, ptl);
 
+	if (rp->idle_only)
+		reclaim_filter_shared_idle(&page_list,
+				IS_ENABLED(CONFIG_OPLUS_SYSTEM_KERNEL_QCOM));
+
 	/* 
 	 * check whether the reclaim process should cancel
          */
@@ -243,6 +331,59 @@ static int mm_reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 	return 0;
 }
 
+/* Parse every reclaim type but RECLAIM_RANGE, which carries arguments */
+static int reclaim_type_from_str(const char *type_buf)
+{
+	if (!strcmp(type_buf, "file"))
+		return RECLAIM_FILE;
+	else if (!strcmp(type_buf, "anon"))
+		return RECLAIM_ANON;
+	else if (!strcmp(type_buf, "all"))
+		return RECLAIM_ALL;
+	else if (!strcmp(type_buf, "inactive"))
+		return RECLAIM_INACTIVE;
+	else if (!strcmp(type_buf, "inactive_file"))
+		return RECLAIM_INACTIVE_FILE;
+	else if (!strcmp(type_buf, "inactive_anon"))
+		return RECLAIM_INACTIVE_ANON;
+#ifdef CONFIG_IDLE_PAGE_TRACKING
+	else if (!strcmp(type_buf, "idle"))
+		return RECLAIM_IDLE;
+#endif
+
+	return -EINVAL;
+}
+
+static inline bool reclaim_type_inactive(enum reclaim_type type)
+{
+	return (type == RECLAIM_INACTIVE) ||
+		(type == RECLAIM_INACTIVE_FILE) ||
+		(type == RECLAIM_INACTIVE_ANON);
+}
+
+static bool reclaim_vma_skip(enum reclaim_type type,
+		struct vm_area_struct *vma)
+{
+	if (is_vm_hugetlb_page(vma))
+		return true;
+
+	/*
+	 * filter only reclaim anon pages
+	 */
+	if ((type == RECLAIM_ANON ||
+		type == RECLAIM_INACTIVE_ANON) && vma->vm_file)
+		return true;
+
+	/*
+	 * filter only reclaim file-backed pages
+	 */
+	if ((type == RECLAIM_FILE ||
+		type == RECLAIM_INACTIVE_FILE) && !vma->vm_file)
+		return true;
+
+	return false;
+}
+
 static noinline ssize_t reclaim_task_write(struct task_struct* task, char *buffer)
 {
 	struct mm_struct *mm;
@@ -265,22 +406,14 @@ static noinline ssize_t reclaim_task_write(struct task_struct* task, char *buffe
 		goto out_err;
 
 	type_buf = strstrip(buffer);
-	if (!strcmp(type_buf, "file"))
-		type = RECLAIM_FILE;
-	else if (!strcmp(type_buf, "anon"))
-		type = RECLAIM_ANON;
-	else if (!strcmp(type_buf, "all"))
-		type = RECLAIM_ALL;
-	else if (!strcmp(type_buf, "inactive"))
-		type = RECLAIM_INACTIVE;
-	else if (!strcmp(type_buf, "inactive_file"))
-		type = RECLAIM_INACTIVE_FILE;
-	else if (!strcmp(type_buf, "inactive_anon"))
-		type = RECLAIM_INACTIVE_ANON;
+	err = reclaim_type_from_str(type_buf);
+	if (err >= 0)
+		type = err;
 	else if (isdigit(*type_buf))
 		type = RECLAIM_RANGE;
 	else
 		goto out_err;
+	err = 0;
 
 	if (type == RECLAIM_RANGE) {
 		char *token;
@@ -319,12 +452,8 @@ static noinline ssize_t reclaim_task_write(struct task_struct* task, char *buffe
 	/* 
 	 * Flag that relcaim inactive pages only in mm_reclaim_pte_range
 	 */
-	if ((type == RECLAIM_INACTIVE) ||
-			(type == RECLAIM_INACTIVE_FILE) ||
-			(type == RECLAIM_INACTIVE_ANON))
-		rp.inactive_lru = true;
-	else
-		rp.inactive_lru = false;
+	rp.inactive_lru = reclaim_type_inactive(type);
+	rp.idle_only = (type == RECLAIM_IDLE);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5,4,0)
 	reclaim_walk.mm = mm;
@@ -357,23 +486,9 @@ static noinline ssize_t reclaim_task_write(struct task_struct* task, char *buffe
 		}
 	} else {
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
-			if (is_vm_hugetlb_page(vma))
+			if (reclaim_vma_skip(type, vma))
 				continue;
 
-			/*
-			 * filter only reclaim anon pages
-			 */
-			if ((type == RECLAIM_ANON ||
-				type == RECLAIM_INACTIVE_ANON) && vma->vm_file)
-				continue;
-
-			/*
-			 * filter only reclaim file-backed pages
-			 */
-			if ((type == RECLAIM_FILE ||
-				type == RECLAIM_INACTIVE_FILE) && !vma->vm_file)
-					continue;
-
 			rp.vma = vma;
 			err = walk_page_range_hook(mm, vma->vm_start,
 					vma->vm_end, &reclaim_walk_ops,
@@ -404,6 +519,493 @@ static noinline ssize_t reclaim_task_write(struct task_struct* task, char *buffe
 	return -EINVAL;
 }
 
+/*
+ * Asynchronous reclaim engine.
+ *
+ * Jobs written to /proc/process_reclaim_async are queued and served by
+ * per-cpu workers, so several background processes can be reclaimed in
+ * parallel without serializing on reclaim_mutex. A worker isolates the
+ * pages of its target across VMAs into batches of async_batch_pages and
+ * hands every batch to reclaim_pages(); the cancel checks of the
+ * synchronous path run after each batch. Reading the proc file shows the
+ * queued, running and recently finished jobs, and poll() on it wakes up
+ * whenever a job finishes.
+ */
+#define ASYNC_JOB_HISTORY	32
+
+enum reclaim_job_state {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE,
+	JOB_CANCELLED,
+};
+
+static const char * const job_state_str[] = {
+	"queued", "running", "done", "cancelled",
+};
+
+static const char * const job_reason_str[] = {
+	[PR_PASS]	= "pass",
+	[PR_SEM_OUT]	= "sem_out",
+	[PR_TASK_FG]	= "task_fg",
+	[PR_TIME_OUT]	= "time_out",
+	[PR_FULL]	= "full",
+	[PR_TASK_RUN]	= "task_run",
+	[PR_TASK_DIE]	= "task_die",
+};
+
+static const char * const reclaim_type_str[] = {
+	[RECLAIM_FILE]		= "file",
+	[RECLAIM_ANON]		= "anon",
+	[RECLAIM_ALL]		= "all",
+	[RECLAIM_RANGE]		= "range",
+	[RECLAIM_INACTIVE_FILE]	= "inactive_file",
+	[RECLAIM_INACTIVE_ANON]	= "inactive_anon",
+	[RECLAIM_INACTIVE]	= "inactive",
+	[RECLAIM_IDLE]		= "idle",
+};
+
+struct reclaim_job {
+	struct list_head list;
+	unsigned long id;
+	pid_t pid;
+	struct task_struct *task;
+	/* euid of the submitter, who can read the job back */
+	kuid_t owner;
+	enum reclaim_type type;
+	/* max pages to reclaim */
+	unsigned long budget;
+	enum reclaim_job_state state;
+	/* PR_* code the job stopped with */
+	int reason;
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+	/* major faults of the target since its previous pass */
+	unsigned long nr_refaults;
+	u64 submit_ns;
+	u64 start_ns;
+	u64 end_ns;
+};
+
+/* per walk state of a running job */
+struct reclaim_batch {
+	struct reclaim_job *job;
+	struct vm_area_struct *vma;
+	struct list_head page_list;
+	unsigned int nr_isolated;
+	unsigned long deadline;
+};
+
+static unsigned int async_batch_pages = 512;
+static unsigned int async_max_workers = 4;
+static unsigned int async_max_pending = 64;
+static unsigned int async_timeout_ms = 1000;
+module_param_named(async_batch_pages, async_batch_pages, uint, 0644);
+module_param_named(async_max_workers, async_max_workers, uint, 0644);
+module_param_named(async_max_pending, async_max_pending, uint, 0644);
+module_param_named(async_timeout_ms, async_timeout_ms, uint, 0644);
+
+static DEFINE_SPINLOCK(async_lock);
+/* jobs not picked up by a worker yet */
+static LIST_HEAD(async_pending);
+/* running and finished jobs, oldest first */
+static LIST_HEAD(async_history);
+static unsigned int async_nr_pending;
+static unsigned int async_nr_history;
+static unsigned long async_next_id = 1;
+/* bumped on every finished job, used by poll() */
+static unsigned long async_completed;
+static DECLARE_WAIT_QUEUE_HEAD(async_wait);
+static struct workqueue_struct *async_wq;
+static DEFINE_PER_CPU(struct work_struct, async_work);
+
+/*
+ * Major faults of a process at the end of its last pass. Refaults of
+ * reclaimed pages show up as major faults, so the delta seen by the next
+ * pass is what the previous one cost. Protected by async_lock.
+ */
+#define PASS_RECORDS	64
+
+struct reclaim_pass_record {
+	pid_t pid;
+	u64 start_time;
+	unsigned long maj_flt;
+};
+
+static struct reclaim_pass_record pass_records[PASS_RECORDS];
+static unsigned int pass_record_next;
+
+static unsigned long task_maj_flt(struct task_struct *task)
+{
+	struct task_struct *t;
+	unsigned long maj_flt;
+
+	rcu_read_lock();
+	maj_flt = task->signal->maj_flt;
+	for_each_thread(task, t)
+		maj_flt += t->maj_flt;
+	rcu_read_unlock();
+
+	return maj_flt;
+}
+
+static struct reclaim_pass_record *pass_record_find(struct task_struct *task)
+{
+	int i;
+
+	for (i = 0; i < PASS_RECORDS; i++) {
+		if (pass_records[i].pid == task->pid &&
+		    pass_records[i].start_time == task->start_time)
+			return &pass_records[i];
+	}
+	return NULL;
+}
+
+static void pass_record_update(struct task_struct *task, unsigned long maj_flt)
+{
+	struct reclaim_pass_record *rec = pass_record_find(task);
+
+	if (!rec) {
+		rec = &pass_records[pass_record_next];
+		pass_record_next = (pass_record_next + 1) % PASS_RECORDS;
+		rec->pid = task->pid;
+		rec->start_time = task->start_time;
+	}
+	rec->maj_flt = maj_flt;
+}
+
+static void async_reclaim_flush(struct reclaim_batch *rb)
+{
+	if (!rb->nr_isolated)
+		return;
+
+	if (rb->job->type == RECLAIM_IDLE)
+		reclaim_filter_shared_idle(&rb->page_list, false);
+
+	rb->job->nr_reclaimed += reclaim_pages(&rb->page_list);
+	rb->nr_isolated = 0;
+}
+
+static int async_reclaim_pte_range(pmd_t *pmd, unsigned long addr,
+		unsigned long end, struct mm_walk *walk)
+{
+	struct reclaim_batch *rb = walk->private;
+	struct reclaim_job *job = rb->job;
+	struct vm_area_struct *vma = rb->vma;
+	bool inactive_lru = reclaim_type_inactive(job->type);
+	unsigned int batch = max(READ_ONCE(async_batch_pages), 1U);
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+	bool full;
+	int ret;
+
+#ifdef CONFIG_OPLUS_SYSTEM_KERNEL_QCOM
+	split_huge_pmd(vma, addr, pmd);
+#else
+	split_huge_pmd(vma, pmd, addr);
+#endif
+	if (pmd_trans_unstable(pmd))
+		return 0;
+cont:
+	full = false;
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (inactive_lru && (PageActive(page) ||
+					PageUnevictable(page)))
+			continue;
+
+		if (job->type == RECLAIM_IDLE &&
+		    !reclaim_pte_idle(vma, addr, pte, page))
+			continue;
+
+		if (isolate_lru_page(page))
+			continue;
+
+		/* see mm_reclaim_pte_range() */
+		if (PageAnon(page) && !PageSwapBacked(page)) {
+			putback_lru_page(page);
+			continue;
+		}
+
+		list_add(&page->lru, &rb->page_list);
+		rb->nr_isolated++;
+		job->nr_scanned++;
+		if (rb->nr_isolated >= batch ||
+		    job->nr_reclaimed + rb->nr_isolated >= job->budget) {
+			full = true;
+			addr += PAGE_SIZE;
+			break;
+		}
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	if (full) {
+		async_reclaim_flush(rb);
+		if (job->nr_reclaimed >= job->budget)
+			return -PR_FULL;
+	}
+
+	ret = __is_reclaim_job_should_cancel(job->task, walk->mm, rb->deadline);
+	if (ret)
+		return ret;
+	if (addr != end)
+		goto cont;
+	return 0;
+}
+
+static void async_reclaim_job(struct reclaim_job *job)
+{
+	const struct mm_walk_ops async_walk_ops = {
+		.pmd_entry = async_reclaim_pte_range,
+	};
+	struct reclaim_pass_record *rec;
+	struct reclaim_batch rb;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned long maj_flt;
+	int err = 0;
+
+	mm = get_task_mm(job->task);
+	if (!mm) {
+		job->reason = PR_TASK_DIE;
+		return;
+	}
+
+	maj_flt = task_maj_flt(job->task);
+	spin_lock(&async_lock);
+	rec = pass_record_find(job->task);
+	if (rec && maj_flt >= rec->maj_flt)
+		job->nr_refaults = maj_flt - rec->maj_flt;
+	spin_unlock(&async_lock);
+
+	rb.job = job;
+	rb.nr_isolated = 0;
+	rb.deadline = jiffies + msecs_to_jiffies(async_timeout_ms);
+	INIT_LIST_HEAD(&rb.page_list);
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (reclaim_vma_skip(job->type, vma))
+			continue;
+
+		rb.vma = vma;
+		err = walk_page_range(mm, vma->vm_start, vma->vm_end,
+				&async_walk_ops, &rb);
+		if (err < 0)
+			break;
+	}
+	/* pages isolated before a cancel are still worth reclaiming */
+	async_reclaim_flush(&rb);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+
+	maj_flt = task_maj_flt(job->task);
+	spin_lock(&async_lock);
+	pass_record_update(job->task, maj_flt);
+	spin_unlock(&async_lock);
+
+	job->reason = err < 0 ? -err : PR_PASS;
+}
+
+/* Drop the oldest finished jobs beyond ASYNC_JOB_HISTORY, under async_lock */
+static void async_trim_history(void)
+{
+	struct reclaim_job *job, *tmp;
+
+	list_for_each_entry_safe(job, tmp, &async_history, list) {
+		if (async_nr_history <= ASYNC_JOB_HISTORY)
+			break;
+		if (job->state == JOB_RUNNING)
+			continue;
+		list_del(&job->list);
+		async_nr_history--;
+		kfree(job);
+	}
+}
+
+static void async_reclaim_workfn(struct work_struct *work)
+{
+	struct reclaim_job *job;
+
+	for (;;) {
+		spin_lock(&async_lock);
+		job = list_first_entry_or_null(&async_pending,
+				struct reclaim_job, list);
+		if (job) {
+			list_move_tail(&job->list, &async_history);
+			async_nr_pending--;
+			async_nr_history++;
+			job->state = JOB_RUNNING;
+			job->start_ns = ktime_get_ns();
+		}
+		spin_unlock(&async_lock);
+		if (!job)
+			break;
+
+		this_cpu_write(async_reclaimer, current);
+		async_reclaim_job(job);
+		this_cpu_write(async_reclaimer, NULL);
+		put_task_struct(job->task);
+
+		spin_lock(&async_lock);
+		job->task = NULL;
+		job->end_ns = ktime_get_ns();
+		job->state = (job->reason == PR_PASS || job->reason == PR_FULL) ?
+				JOB_DONE : JOB_CANCELLED;
+		async_completed++;
+		async_trim_history();
+		spin_unlock(&async_lock);
+
+		wake_up_interruptible(&async_wait);
+		cond_resched();
+	}
+}
+
+/*
+ * Wake up as many workers as there are queued jobs. Workers are taken
+ * from the lowest numbered cpus first, which are the little cores.
+ */
+static void async_reclaim_kick(unsigned int nr_jobs)
+{
+	unsigned int nr = min(nr_jobs, max(READ_ONCE(async_max_workers), 1U));
+	int cpu;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		if (!nr--)
+			break;
+		queue_work_on(cpu, async_wq, per_cpu_ptr(&async_work, cpu));
+	}
+	put_online_cpus();
+}
+
+/*
+ * Queue a job for @task, which the caller holds a reference on. A job
+ * still waiting for the same pid is updated in place.
+ */
+static int async_reclaim_submit(struct task_struct *task,
+		enum reclaim_type type, unsigned long budget)
+{
+	struct reclaim_job *job, *new;
+	unsigned int nr_pending;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	spin_lock(&async_lock);
+	list_for_each_entry(job, &async_pending, list) {
+		if (job->pid == task->pid) {
+			job->type = type;
+			job->budget = budget;
+			spin_unlock(&async_lock);
+			kfree(new);
+			return 0;
+		}
+	}
+
+	if (async_nr_pending >= async_max_pending) {
+		spin_unlock(&async_lock);
+		kfree(new);
+		return -EAGAIN;
+	}
+
+	get_task_struct(task);
+	new->id = async_next_id++;
+	new->pid = task->pid;
+	new->task = task;
+	new->owner = current_euid();
+	new->type = type;
+	new->budget = budget;
+	new->state = JOB_QUEUED;
+	new->submit_ns = ktime_get_ns();
+	list_add_tail(&new->list, &async_pending);
+	nr_pending = ++async_nr_pending;
+	spin_unlock(&async_lock);
+
+	async_reclaim_kick(nr_pending);
+	return 0;
+}
+
+/*
+ * A reader sees the jobs it submitted, and the pending or running ones on
+ * targets whose maps it could read anyway, not other users' pids.
+ */
+static bool async_job_visible(struct reclaim_job *job)
+{
+	if (uid_eq(job->owner, current_euid()))
+		return true;
+
+	return job->task &&
+		ptrace_may_access(job->task, PTRACE_MODE_READ_FSCREDS);
+}
+
+static void async_show_job(struct seq_file *m, struct reclaim_job *job)
+{
+	u64 now = ktime_get_ns();
+	u64 wait_ns, run_ns = 0;
+
+	if (!async_job_visible(job))
+		return;
+
+	wait_ns = (job->state == JOB_QUEUED ? now : job->start_ns) -
+			job->submit_ns;
+	if (job->state == JOB_RUNNING)
+		run_ns = now - job->start_ns;
+	else if (job->state != JOB_QUEUED)
+		run_ns = job->end_ns - job->start_ns;
+
+	seq_printf(m, "%lu %d %s %s %s %lu %lu %lu %lu %llu %llu\n",
+			job->id, job->pid, reclaim_type_str[job->type],
+			job_state_str[job->state],
+			job->state < JOB_DONE ? "-" : job_reason_str[job->reason],
+			job->nr_scanned, job->nr_reclaimed, job->budget,
+			job->nr_refaults,
+			div_u64(wait_ns, NSEC_PER_USEC),
+			div_u64(run_ns, NSEC_PER_USEC));
+}
+
+static void async_reclaim_destroy(void)
+{
+	struct reclaim_job *job, *tmp;
+
+	if (async_wq)
+		destroy_workqueue(async_wq);
+
+	list_for_each_entry_safe(job, tmp, &async_pending, list) {
+		list_del(&job->list);
+		put_task_struct(job->task);
+		kfree(job);
+	}
+	list_for_each_entry_safe(job, tmp, &async_history, list) {
+		list_del(&job->list);
+		kfree(job);
+	}
+}
+
+static int async_reclaim_init(void)
+{
+	int cpu;
+
+	async_wq = alloc_workqueue("process_reclaimd", WQ_FREEZABLE, 1);
+	if (!async_wq)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu)
+		INIT_WORK(per_cpu_ptr(&async_work, cpu), async_reclaim_workfn);
+
+	return 0;
+}
+
 /* 
  * Create /proc/process_reclaim interface for process reclaim.
  * Because /proc/$pid/reclaim has deifferent permissiones of different processes,
@@ -577,6 +1179,147 @@ static struct file_operations process_reclaim_w_fops = {
 	.llseek = noop_llseek,
 };
 
+/*
+ * /proc/process_reclaim_async
+ *
+ * write "<pid> <type> [pages]" to queue a job, type is one of the non
+ * range types accepted by /proc/process_reclaim and pages defaults to
+ * RECLAIM_PAGE_NUM.
+ * read one line per job:
+ * "id pid type state reason scanned reclaimed budget refaults wait_us run_us"
+ * where refaults are the major faults of the target since its previous
+ * pass.
+ */
+static struct proc_dir_entry *async_entry;
+
+struct async_reader {
+	unsigned long seen;
+};
+
+static ssize_t proc_reclaim_async_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *ppos)
+{
+	char kbuf[PROCESS_RECLAIM_CMD_LEN];
+	char *cmd, *token;
+	unsigned long budget = RECLAIM_PAGE_NUM;
+	struct task_struct *tsk;
+	pid_t tsk_pid;
+	int type, ret;
+
+	if (!process_reclaim_enable) {
+		pr_warn("Process memory reclaim is disabled!\n");
+		return -EFAULT;
+	}
+
+	if (count >= PROCESS_RECLAIM_CMD_LEN)
+		return -EINVAL;
+
+	memset(kbuf, 0, PROCESS_RECLAIM_CMD_LEN);
+	if (copy_from_user(&kbuf, buffer, count))
+		return -EFAULT;
+
+	cmd = strstrip(kbuf);
+	token = strsep(&cmd, " \t");
+	if (!token || kstrtoint(token, 10, &tsk_pid) || tsk_pid <= 0)
+		return -EINVAL;
+
+	token = strsep(&cmd, " \t");
+	if (!token)
+		return -EINVAL;
+	type = reclaim_type_from_str(token);
+	if (type < 0)
+		return type;
+
+	if (cmd && *cmd) {
+		if (kstrtoul(strstrip(cmd), 10, &budget) || !budget)
+			return -EINVAL;
+	}
+
+	rcu_read_lock();
+	tsk = find_task_by_vpid(tsk_pid);
+	if (!tsk) {
+		rcu_read_unlock();
+		return -ESRCH;
+	}
+	tsk = tsk->group_leader;
+	get_task_struct(tsk);
+	rcu_read_unlock();
+
+	/* same bar as for reading the target's memory maps */
+	if (tsk == current->group_leader)
+		ret = -EINVAL;
+	else if (!ptrace_may_access(tsk, PTRACE_MODE_READ_FSCREDS))
+		ret = -EPERM;
+	else
+		ret = async_reclaim_submit(tsk, type, budget);
+	put_task_struct(tsk);
+
+	return ret < 0 ? ret : count;
+}
+
+static int proc_reclaim_async_show(struct seq_file *m, void *v)
+{
+	struct async_reader *reader = m->private;
+	struct reclaim_job *job;
+
+	spin_lock(&async_lock);
+	reader->seen = async_completed;
+	list_for_each_entry(job, &async_history, list)
+		async_show_job(m, job);
+	list_for_each_entry(job, &async_pending, list)
+		async_show_job(m, job);
+	spin_unlock(&async_lock);
+
+	return 0;
+}
+
+static int proc_reclaim_async_open(struct inode *inode, struct file *file)
+{
+	struct async_reader *reader;
+	int ret;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->seen = READ_ONCE(async_completed);
+	ret = single_open(file, proc_reclaim_async_show, reader);
+	if (ret)
+		kfree(reader);
+	return ret;
+}
+
+static int proc_reclaim_async_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	kfree(m->private);
+	return single_release(inode, file);
+}
+
+/* Readable as usual, EPOLLPRI once a job finished since the last read */
+static __poll_t proc_reclaim_async_poll(struct file *file, poll_table *wait)
+{
+	struct seq_file *m = file->private_data;
+	struct async_reader *reader = m->private;
+	__poll_t mask = EPOLLIN | EPOLLRDNORM;
+
+	poll_wait(file, &async_wait, wait);
+	if (READ_ONCE(async_completed) != reader->seen)
+		mask |= EPOLLPRI;
+
+	return mask;
+}
+
+static const struct file_operations process_reclaim_async_fops = {
+	.open		= proc_reclaim_async_open,
+	.read		= seq_read,
+	.write		= proc_reclaim_async_write,
+	.poll		= proc_reclaim_async_poll,
+	.llseek		= seq_lseek,
+	.release	= proc_reclaim_async_release,
+};
+
 static inline int process_mm_reclaim_init_procfs(void)
 {
 	enable = proc_create("process_reclaim", 0222, NULL, &process_reclaim_w_fops);
@@ -584,11 +1327,22 @@ static inline int process_mm_reclaim_init_procfs(void)
 		pr_err("Failed to register proc interface\n");
 		return -ENOMEM;
 	}
+
+	async_entry = proc_create("process_reclaim_async", 0664, NULL,
+			&process_reclaim_async_fops);
+	if (!async_entry) {
+		pr_err("Failed to register async proc interface\n");
+		proc_remove(enable);
+		enable = NULL;
+		return -ENOMEM;
+	}
 	return 0;
 }
 
 static void process_mm_reclaim_destory_procfs(void)
 {
+	if (async_entry)
+		proc_remove(async_entry);
 	if (enable)
 		proc_remove(enable);
 }
@@ -615,8 +1369,15 @@ static int __init process_reclaim_proc_init(void)
 		return rc;
 	}
 
+	rc = async_reclaim_init();
+	if (rc) {
+		unregister_trace_android_vh_check_process_reclaimer(current_is_process_reclaimer, NULL);
+		return rc;
+	}
+
 	rc = process_mm_reclaim_init_procfs();
 	if (rc) {
+		async_reclaim_destroy();
 		unregister_trace_android_vh_check_process_reclaimer(current_is_process_reclaimer, NULL);
 		return rc;
 	}
@@ -625,8 +1386,9 @@ static int __init process_reclaim_proc_init(void)
 
 static void process_reclaim_proc_exit(void)
 {
-	unregister_trace_android_vh_check_process_reclaimer(current_is_process_reclaimer, NULL);
 	process_mm_reclaim_destory_procfs();
+	async_reclaim_destroy();
+	unregister_trace_android_vh_check_process_reclaimer(current_is_process_reclaimer, NULL);
 }
 
 module_init(process_reclaim_proc_init);
@@ -585,6 +585,155 @@ static void dec_cluster_info_page(struct swap_info_struct *p,
 		free_cluster(p, idx);
 }
 
+#if defined(CONFIG_NANDSWAP)
+/*
+ * Extent placement for nandswap: while nswapoutd swaps out one task, its
+ * slots are taken from a run of physically contiguous free clusters and
+ * filled in order, so the task can be read back with large sequential
+ * I/O. Only nswapoutd allocates from the nandswap device, so the run does
+ * not have to be carved out of the free list up front; each cluster is
+ * claimed when the fill pointer enters it. All state is under si->lock.
+ */
+struct nandswap_extent {
+	struct percpu_cluster cluster;	/* cluster being filled */
+	unsigned int next;		/* next cluster of the run */
+	unsigned int end;		/* one past the last cluster of the run */
+	unsigned int gen;
+};
+
+static struct nandswap_extent ns_extent;
+static unsigned int ns_extent_want;	/* clusters per extent, 0 = off */
+static unsigned int ns_extent_gen;	/* bumped for every new owner */
+struct nandswap_extent_stat nandswap_extent_stat;
+
+/* called by nswapoutd around the swap out of one task, 0 turns it off */
+void nandswap_extent_begin(unsigned long nr_pages)
+{
+	WRITE_ONCE(ns_extent_gen, ns_extent_gen + 1);
+	WRITE_ONCE(ns_extent_want, DIV_ROUND_UP(nr_pages, SWAPFILE_CLUSTER));
+}
+
+void nandswap_extent_end(void)
+{
+	WRITE_ONCE(ns_extent_want, 0);
+}
+
+static void nandswap_extent_reset(void)
+{
+	cluster_set_null(&ns_extent.cluster.index);
+	ns_extent.next = ns_extent.end = 0;
+	ns_extent.gen = READ_ONCE(ns_extent_gen);
+}
+
+/* unlink a cluster from the middle of a cluster list */
+static bool cluster_list_del(struct swap_cluster_list *list,
+			     struct swap_cluster_info *ci, unsigned int idx)
+{
+	unsigned int prev, cur;
+
+	if (cluster_list_empty(list))
+		return false;
+
+	cur = cluster_list_first(list);
+	if (cur == idx) {
+		cluster_list_del_first(list, ci);
+		return true;
+	}
+
+	while (cur != cluster_next(&list->tail)) {
+		prev = cur;
+		cur = cluster_next(&ci[prev]);
+		if (cur != idx)
+			continue;
+
+		spin_lock_nested(&ci[prev].lock, SINGLE_DEPTH_NESTING);
+		cluster_set_next(&ci[prev], cluster_next(&ci[idx]));
+		spin_unlock(&ci[prev].lock);
+		if (cluster_next(&list->tail) == idx)
+			cluster_set_next_flag(&list->tail, prev, 0);
+		return true;
+	}
+
+	return false;
+}
+
+/* find the first run of @want free clusters, or the longest shorter one */
+static bool nandswap_extent_pick(struct swap_info_struct *si,
+				 unsigned int want)
+{
+	unsigned int nr = DIV_ROUND_UP(si->max, SWAPFILE_CLUSTER);
+	unsigned int i, run = 0, best = 0, best_start = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (!cluster_is_free(&si->cluster_info[i])) {
+			run = 0;
+			continue;
+		}
+		if (++run > best) {
+			best = run;
+			best_start = i + 1 - run;
+			if (best >= want)
+				break;
+		}
+	}
+
+	if (!best) {
+		nandswap_extent_stat.fallback++;
+		return false;
+	}
+
+	nandswap_extent_stat.picked++;
+	if (best < want)
+		nandswap_extent_stat.short_runs++;
+	ns_extent.next = best_start;
+	ns_extent.end = best_start + best;
+	return true;
+}
+
+static bool nandswap_extent_next_cluster(struct swap_info_struct *si)
+{
+	struct percpu_cluster *cluster = &ns_extent.cluster;
+	unsigned int idx;
+
+	for ( ; ; ) {
+		if (ns_extent.next >= ns_extent.end &&
+		    !nandswap_extent_pick(si, READ_ONCE(ns_extent_want)))
+			return false;
+
+		idx = ns_extent.next++;
+		if (!cluster_list_del(&si->free_clusters, si->cluster_info, idx))
+			continue;
+
+		cluster_set_count_flag(&si->cluster_info[idx], 0, 0);
+		cluster_set_next_flag(&cluster->index, idx, 0);
+		cluster->next = idx * SWAPFILE_CLUSTER;
+		nandswap_extent_stat.clusters++;
+		return true;
+	}
+}
+
+static inline bool nandswap_extent_active(struct swap_info_struct *si)
+{
+	if (!(si->flags & SWP_NANDSWAP) || !si->cluster_info ||
+	    !READ_ONCE(ns_extent_want) || current != nswapoutd)
+		return false;
+
+	if (ns_extent.gen != READ_ONCE(ns_extent_gen))
+		nandswap_extent_reset();
+	return true;
+}
+#endif
+
+static inline struct percpu_cluster *alloc_cluster_of(
+		struct swap_info_struct *si)
+{
+#if defined(CONFIG_NANDSWAP)
+	if (nandswap_extent_active(si))
+		return &ns_extent.cluster;
+#endif
+	return this_cpu_ptr(si->percpu_cluster);
+}
+
 /*
  * It's possible scan_swap_map() uses a free cluster in the middle of free
  * cluster list. Avoiding such abuse to avoid list corruption.
@@ -604,7 +753,7 @@ scan_swap_map_ssd_cluster_conflict(struct swap_info_struct *si,
 	if (!conflict)
 		return false;
 
-	percpu_cluster = this_cpu_ptr(si->percpu_cluster);
+	percpu_cluster = alloc_cluster_of(si);
 	cluster_set_null(&percpu_cluster->index);
 	return true;
 }
@@ -622,8 +771,13 @@ static bool scan_swap_map_try_ssd_cluster(struct swap_info_struct *si,
 	unsigned long tmp, max;
 
 new_cluster:
-	cluster = this_cpu_ptr(si->percpu_cluster);
+	cluster = alloc_cluster_of(si);
 	if (cluster_is_null(&cluster->index)) {
+#if defined(CONFIG_NANDSWAP)
+		if (cluster == &ns_extent.cluster &&
+		    nandswap_extent_next_cluster(si))
+			goto check_cluster;
+#endif
 		if (!cluster_list_empty(&si->free_clusters)) {
 			cluster->index = si->free_clusters.head;
 			cluster->next = cluster_next(&cluster->index) *
@@ -640,6 +794,9 @@ static bool scan_swap_map_try_ssd_cluster(struct swap_info_struct *si,
 			return false;
 	}
 
+#if defined(CONFIG_NANDSWAP)
+check_cluster:
+#endif
 	found_free = false;
 
 	/*
@@ -1334,6 +1491,10 @@ static void swap_entry_free(struct swap_info_struct *p, swp_entry_t entry)
 	VM_BUG_ON(count != SWAP_HAS_CACHE);
 	p->swap_map[offset] = 0;
 	dec_cluster_info_page(p, p->cluster_info, offset);
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	if (p->tier_map)
+		WRITE_ONCE(p->tier_map[offset], 0);
+#endif
 	unlock_cluster(ci);
 
 	mem_cgroup_uncharge_swap(entry, 1);
@@ -1940,6 +2101,72 @@ static int unuse_pte(struct vm_area_struct *vma, pmd_t *pmd,
 	return ret;
 }
 
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+/*
+ * Per-slot tier info for synchronous (zram) devices: the compressed size
+ * the driver reported through android_vh_swap_slot_obj_size, in 32 byte
+ * units in the high byte (0 if no driver answered), and the swap out time
+ * in SWAP_TIER_EPOCH_SECS units in the low byte. Ages wrap after ~68
+ * minutes, which is far beyond any age the tiering policy asks for.
+ */
+#define SWAP_TIER_EPOCH_SECS	16
+#define SWAP_TIER_SIZE_SHIFT	5
+
+static inline unsigned int swap_tier_epoch(void)
+{
+	return (jiffies / (SWAP_TIER_EPOCH_SECS * HZ)) & 0xff;
+}
+
+void swap_tier_record(struct swap_info_struct *si, struct page *page,
+		      unsigned int size)
+{
+	unsigned int units = min(DIV_ROUND_UP(size, 1U << SWAP_TIER_SIZE_SHIFT),
+				 255U);
+	swp_entry_t entry = { .val = page_private(page) };
+
+	WRITE_ONCE(si->tier_map[swp_offset(entry)],
+		   units << 8 | swap_tier_epoch());
+}
+
+bool swap_tier_info(swp_entry_t entry, unsigned int *size,
+		    unsigned int *age_secs)
+{
+	struct swap_info_struct *si;
+	unsigned short val = 0;
+
+	si = get_swap_device(entry);
+	if (!si)
+		return false;
+	if (si->tier_map)
+		val = READ_ONCE(si->tier_map[swp_offset(entry)]);
+	put_swap_device(si);
+
+	if (!(val >> 8))
+		return false;
+
+	*size = (val >> 8) << SWAP_TIER_SIZE_SHIFT;
+	*age_secs = ((swap_tier_epoch() - val) & 0xff) * SWAP_TIER_EPOCH_SECS;
+	return true;
+}
+
+/*
+ * Map a locked swap cache page back at @addr and drop its swap slot, so
+ * that the next reclaim of the page picks a slot on another device.
+ * Returns 1 if the page was mapped, 0 if the pte changed meanwhile.
+ */
+int swap_tier_unuse(struct vm_area_struct *vma, pmd_t *pmd,
+		    unsigned long addr, swp_entry_t entry, struct page *page)
+{
+	int ret;
+
+	ret = unuse_pte(vma, pmd, addr, entry, page);
+	if (ret > 0)
+		try_to_free_swap(page);
+
+	return ret;
+}
+#endif
+
 static int unuse_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 			unsigned long addr, unsigned long end,
 			unsigned int type, bool frontswap,
@@ -2491,6 +2718,7 @@ static void _enable_swap_info(struct swap_info_struct *p)
 	if (p->prio == SWAP_NANDSWAP_PRIO) {
 		p->flags |= SWP_NANDSWAP;
 		nandswap_si = p;
+		nandswap_extent_reset();
 	}
 #endif
 
@@ -2559,6 +2787,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	unsigned char *swap_map;
 	struct swap_cluster_info *cluster_info;
 	unsigned long *frontswap_map;
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	unsigned short *tier_map;
+#endif
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -2688,6 +2919,10 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	cluster_info = p->cluster_info;
 	p->cluster_info = NULL;
 	frontswap_map = frontswap_map_get(p);
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	tier_map = p->tier_map;
+	p->tier_map = NULL;
+#endif
 	spin_unlock(&p->lock);
 	spin_unlock(&swap_lock);
 	frontswap_invalidate_area(p->type);
@@ -2698,6 +2933,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	vfree(swap_map);
 	kvfree(cluster_info);
 	kvfree(frontswap_map);
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	vfree(tier_map);
+#endif
 	/* Destroy swap account information */
 	swap_cgroup_swapoff(p->type);
 	exit_swap_address_space(p->type);
@@ -3157,6 +3395,9 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	unsigned char *swap_map = NULL;
 	struct swap_cluster_info *cluster_info = NULL;
 	unsigned long *frontswap_map = NULL;
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	unsigned short *tier_map = NULL;
+#endif
 	struct page *page = NULL;
 	struct inode *inode = NULL;
 	bool inced_nr_rotate_swap = false;
@@ -3235,6 +3476,12 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	if (bdi_cap_synchronous_io(inode_to_bdi(inode)))
 		p->flags |= SWP_SYNCHRONOUS_IO;
 
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	/* tiering works without it, just without candidates on this device */
+	if (p->flags & SWP_SYNCHRONOUS_IO)
+		tier_map = vzalloc(array_size(maxpages, sizeof(*tier_map)));
+#endif
+
 	if (p->bdev && blk_queue_nonrot(bdev_get_queue(p->bdev))) {
 		int cpu;
 		unsigned long ci, nr_cluster;
@@ -3338,6 +3585,9 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	if (swap_flags & SWAP_FLAG_PREFER)
 		prio =
 		  (swap_flags & SWAP_FLAG_PRIO_MASK) >> SWAP_FLAG_PRIO_SHIFT;
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	p->tier_map = tier_map;
+#endif
 	enable_swap_info(p, prio, swap_map, cluster_info, frontswap_map);
 
 #if defined(CONFIG_NANDSWAP)
@@ -3381,6 +3631,9 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	vfree(swap_map);
 	kvfree(cluster_info);
 	kvfree(frontswap_map);
+#if defined(CONFIG_OPLUS_ZRAM_TIER)
+	vfree(tier_map);
+#endif
 	if (inced_nr_rotate_swap)
 		atomic_dec(&nr_rotate_swap);
 	if (swap_file)
@@ -2325,6 +2325,7 @@ unsigned long reclaim_pages(struct list_head *page_list)
 
 	return nr_reclaimed;
 }
+EXPORT_SYMBOL_GPL(reclaim_pages);
 
 /*
  * The inactive anon list should be small enough that the VM never has
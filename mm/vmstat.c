@@ -2054,6 +2054,11 @@ void __init init_mm_internals(void)
 		pr_err("vmstat: failed to create '/proc/free_area_list_show'\n");
         return;
     }
+    pentry = proc_create("free_area_pcp_show", 0444, NULL, &proc_flc_pcp_fops);
+    if (!pentry) {
+		pr_err("vmstat: failed to create '/proc/free_area_pcp_show'\n");
+        return;
+    }
 #endif
 #endif
 }
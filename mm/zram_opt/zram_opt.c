@@ -6,12 +6,62 @@
 #define pr_fmt(fmt) "zram_opt: " fmt
 
 #include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/mutex.h>
 #include <trace/hooks/vh_vmscan.h>
 #include <linux/swap.h>
+#include <linux/psi.h>
+#include <linux/vmstat.h>
+#include <linux/workqueue.h>
+#include <linux/zsmalloc.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/zram_opt.h>
+
+/* set points, used as is when the controller is off */
 static int g_direct_swappiness = 60;
 static int g_swappiness = 160;
 
+/*
+ * Swappiness controller. Every period the swappiness used by kswapd and
+ * direct reclaim is moved inside [min, max] around its set point:
+ *  - file refaults outweighing anon refaults (swap-ins) push it up, the
+ *    opposite pulls it down; this term is weighted by how much of the
+ *    period was spent in memory stall, so it only steers under pressure;
+ *  - a good zram compression ratio pushes it up, a poor one pulls it
+ *    down, since swapping to zram then frees little memory.
+ * Each step moves half way to the target, at most max_step.
+ */
+static bool zo_dynamic = true;
+static unsigned int zo_period_ms = 300;
+static int g_swappiness_min = 100;
+static int g_swappiness_max = 200;
+static int g_direct_swappiness_min = 20;
+static int g_direct_swappiness_max = 100;
+static int zo_max_step = 10;
+/* refaults per period below which the refault balance is noise */
+static unsigned int zo_refault_min = 32;
+/* compression ratio (x100) treated as neutral */
+static unsigned int zo_ratio_neutral = 250;
+
+static int zo_cur_swappiness = 160;
+static int zo_cur_direct_swappiness = 60;
+
+struct zo_sample {
+	u64 time;
+	u64 stall;
+	unsigned long file_refault;
+	unsigned long anon_refault;
+};
+
+/* serializes zo_last and the controller state between work and param set */
+static DEFINE_MUTEX(zo_lock);
+static struct zo_sample zo_last;
+static bool zo_started;
+
+static void zo_tune_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(zo_tune_work, zo_tune_fn);
+
 struct zram_opt_ops {
 	void (*zo_set_swappiness)(void *data, int *swappiness);
 	void (*zo_set_inactive_ratio)(void *data, unsigned long *inactive_ratio, bool file);
@@ -20,14 +70,166 @@ struct zram_opt_ops {
 
 static void zo_set_swappiness(void *data, int *swappiness)
 {
+	bool dynamic = READ_ONCE(zo_dynamic);
+
 	if (current_is_kswapd())
-		*swappiness = g_swappiness;
+		*swappiness = dynamic ? READ_ONCE(zo_cur_swappiness) : g_swappiness;
 	else
-		*swappiness = g_direct_swappiness;
+		*swappiness = dynamic ? READ_ONCE(zo_cur_direct_swappiness) :
+			g_direct_swappiness;
 
 	return;
 }
 
+/* 5.4 has no anon shadow entries, a swap-in is an anon refault */
+static unsigned long zo_swapins(void)
+{
+	unsigned long sum = 0;
+#ifdef CONFIG_VM_EVENT_COUNTERS
+	int cpu;
+
+	/* only PSWPIN is needed, don't fold every vm event like all_vm_events */
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		sum += per_cpu(vm_event_states, cpu).event[PSWPIN];
+	put_online_cpus();
+#endif
+	return sum;
+}
+
+/*
+ * Refault counters are only read when memory stall moved since @last: with
+ * no stall the refault balance carries no weight, so an idle period costs
+ * two cheap reads. The refault fields then stay at their last values, and
+ * the next stalled period's file and anon deltas still cover the same span.
+ */
+static void zo_sample(struct zo_sample *sample, const struct zo_sample *last)
+{
+	u64 full;
+
+	sample->time = ktime_get_ns();
+	psi_memstall_total(&sample->stall, &full);
+	if (last && sample->stall == last->stall) {
+		sample->file_refault = last->file_refault;
+		sample->anon_refault = last->anon_refault;
+		return;
+	}
+	sample->file_refault = global_node_page_state(WORKINGSET_REFAULT);
+	sample->anon_refault = zo_swapins();
+}
+
+/* compression ratio of zram x100, neutral if nothing is stored */
+static unsigned int zo_compr_ratio(void)
+{
+#if IS_REACHABLE(CONFIG_ZSMALLOC)
+	unsigned long pages = global_zone_page_state(NR_ZSPAGES);
+	unsigned long objs = zs_get_total_objs();
+
+	if (pages && objs)
+		return min(objs * 100 / pages, 1000UL);
+#endif
+	return READ_ONCE(zo_ratio_neutral);
+}
+
+/* map a score in [-100, 100] onto [min, max] around set point */
+static int zo_target(int score, int set, int lo, int hi)
+{
+	lo = clamp(min(lo, set), 0, 200);
+	hi = clamp(max(hi, set), 0, 200);
+	set = clamp(set, lo, hi);
+
+	if (score >= 0)
+		return set + score * (hi - set) / 100;
+	return set + score * (set - lo) / 100;
+}
+
+static int zo_step(int cur, int target, int lo, int hi)
+{
+	int max_step = max(READ_ONCE(zo_max_step), 1);
+	int delta = target - cur;
+
+	if (delta / 2)
+		delta /= 2;
+	delta = clamp(delta, -max_step, max_step);
+
+	return clamp(cur + delta, clamp(lo, 0, 200), clamp(hi, 0, 200));
+}
+
+static void zo_tune_fn(struct work_struct *work)
+{
+	struct zo_sample now;
+	unsigned long file, anon;
+	unsigned int stall, ratio;
+	int balance = 0, compr, score, w_refault;
+	int set, direct_set;
+	u64 period;
+
+	mutex_lock(&zo_lock);
+	zo_sample(&now, &zo_last);
+	period = now.time - zo_last.time;
+	stall = period ? min_t(u64, div64_u64((now.stall - zo_last.stall) * 1000,
+					      period), 1000) : 0;
+	file = now.file_refault - zo_last.file_refault;
+	anon = now.anon_refault - zo_last.anon_refault;
+	zo_last = now;
+
+	if (file + anon >= READ_ONCE(zo_refault_min))
+		balance = ((long)file - (long)anon) * 100 / (long)(file + anon);
+
+	ratio = zo_compr_ratio();
+	compr = clamp(((int)ratio - (int)READ_ONCE(zo_ratio_neutral)) * 100 /
+		      max_t(int, READ_ONCE(zo_ratio_neutral), 1), -100, 100);
+
+	/* stall of 10% or more lets the refault balance dominate fully */
+	w_refault = min(stall, 100U) / 10;
+	score = (balance * w_refault + compr * 2) / (w_refault + 2);
+
+	set = READ_ONCE(g_swappiness);
+	direct_set = READ_ONCE(g_direct_swappiness);
+	WRITE_ONCE(zo_cur_swappiness,
+		zo_step(zo_cur_swappiness,
+			zo_target(score, set, g_swappiness_min, g_swappiness_max),
+			min(g_swappiness_min, set), max(g_swappiness_max, set)));
+	WRITE_ONCE(zo_cur_direct_swappiness,
+		zo_step(zo_cur_direct_swappiness,
+			zo_target(score, direct_set, g_direct_swappiness_min,
+				  g_direct_swappiness_max),
+			min(g_direct_swappiness_min, direct_set),
+			max(g_direct_swappiness_max, direct_set)));
+
+	trace_zram_opt_swappiness(stall, file, anon, ratio, score,
+				  zo_cur_swappiness, zo_cur_direct_swappiness);
+	mutex_unlock(&zo_lock);
+
+	if (READ_ONCE(zo_dynamic))
+		queue_delayed_work(system_power_efficient_wq, &zo_tune_work,
+			msecs_to_jiffies(clamp(READ_ONCE(zo_period_ms), 100U, 5000U)));
+}
+
+static int zo_dynamic_set(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (ret)
+		return ret;
+
+	mutex_lock(&zo_lock);
+	if (zo_dynamic && zo_started) {
+		WRITE_ONCE(zo_cur_swappiness, g_swappiness);
+		WRITE_ONCE(zo_cur_direct_swappiness, g_direct_swappiness);
+		zo_sample(&zo_last, NULL);
+		queue_delayed_work(system_power_efficient_wq, &zo_tune_work, 0);
+	}
+	mutex_unlock(&zo_lock);
+
+	return 0;
+}
+
+static const struct kernel_param_ops zo_dynamic_ops = {
+	.set = zo_dynamic_set,
+	.get = param_get_bool,
+};
+
 static void zo_set_inactive_ratio(void *data, unsigned long *inactive_ratio, bool file)
 {
 	if (file)
@@ -75,6 +277,16 @@ static int __init zram_opt_init(void)
 		goto error_unregister_trace_inactive_ratio;
 	}
 
+	zo_cur_swappiness = g_swappiness;
+	zo_cur_direct_swappiness = g_direct_swappiness;
+	mutex_lock(&zo_lock);
+	zo_sample(&zo_last, NULL);
+	zo_started = true;
+	mutex_unlock(&zo_lock);
+	if (zo_dynamic)
+		queue_delayed_work(system_power_efficient_wq, &zo_tune_work,
+				   msecs_to_jiffies(zo_period_ms));
+
 	return rc;
 
 error_unregister_trace_inactive_ratio:
@@ -92,6 +304,11 @@ static void __exit zram_opt_exit(void)
 	unregister_trace_android_vh_set_swappiness(ops->zo_set_swappiness, NULL);
 	unregister_trace_android_vh_set_inactive_ratio(ops->zo_set_inactive_ratio, NULL);
 	unregister_trace_android_vh_check_throttle(ops->zo_check_throttle, NULL);
+	mutex_lock(&zo_lock);
+	zo_started = false;
+	zo_dynamic = false;
+	mutex_unlock(&zo_lock);
+	cancel_delayed_work_sync(&zo_tune_work);
 
 	return;
 }
@@ -102,5 +319,16 @@ module_exit(zram_opt_exit);
 
 module_param_named(vm_swappiness, g_swappiness, int, S_IRUGO | S_IWUSR);
 module_param_named(direct_vm_swappiness, g_direct_swappiness, int, S_IRUGO | S_IWUSR);
+module_param_cb(dynamic_swappiness, &zo_dynamic_ops, &zo_dynamic, S_IRUGO | S_IWUSR);
+module_param_named(swappiness_period_ms, zo_period_ms, uint, S_IRUGO | S_IWUSR);
+module_param_named(vm_swappiness_min, g_swappiness_min, int, S_IRUGO | S_IWUSR);
+module_param_named(vm_swappiness_max, g_swappiness_max, int, S_IRUGO | S_IWUSR);
+module_param_named(direct_vm_swappiness_min, g_direct_swappiness_min, int, S_IRUGO | S_IWUSR);
+module_param_named(direct_vm_swappiness_max, g_direct_swappiness_max, int, S_IRUGO | S_IWUSR);
+module_param_named(swappiness_max_step, zo_max_step, int, S_IRUGO | S_IWUSR);
+module_param_named(refault_min, zo_refault_min, uint, S_IRUGO | S_IWUSR);
+module_param_named(ratio_neutral, zo_ratio_neutral, uint, S_IRUGO | S_IWUSR);
+module_param_named(cur_vm_swappiness, zo_cur_swappiness, int, S_IRUGO);
+module_param_named(cur_direct_vm_swappiness, zo_cur_direct_swappiness, int, S_IRUGO);
 
 MODULE_LICENSE("GPL v2");
@@ -0,0 +1,403 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+* Copyright (C) 2020-2022 Oplus. All rights reserved.
+*/
+
+#define pr_fmt(fmt) "zram_tier: " fmt
+
+#include <linux/mm.h>
+#include <linux/mm_inline.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/swapfile.h>
+#include <linux/pagemap.h>
+#include <linux/pagewalk.h>
+#include <linux/rmap.h>
+#include <linux/blkdev.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/task.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/moduleparam.h>
+
+/*
+ * zram keeps everything in RAM, so a page that compressed badly costs
+ * nearly as much as an uncompressed one. Once such a page has sat in zram
+ * long enough, in an app that is cached in the background, it is moved to
+ * nandswap: read back from zram, remapped, and reclaimed again by the tier
+ * thread, which is allowed to allocate nandswap slots. Pages are pushed
+ * per vma in batches under one plug, so nandswap sees large writes.
+ */
+
+#define ZT_BATCH_MAX	256
+#define ZT_MAX_TASKS	16
+
+enum {
+	ZT_ZRAM,
+	ZT_NAND,
+	ZT_NR_TIERS,
+};
+
+static bool zt_enable = true;
+module_param_named(enable, zt_enable, bool, 0644);
+static unsigned int zt_interval_ms = 10000;
+module_param_named(interval_ms, zt_interval_ms, uint, 0644);
+/* only apps cached at least this deep are touched */
+static int zt_min_adj = 800;
+module_param_named(min_adj, zt_min_adj, int, 0644);
+/* compressed size from which a page counts as poorly compressed */
+static unsigned int zt_min_size = 2048;
+module_param_named(min_size, zt_min_size, uint, 0644);
+/* seconds a page must have been in zram */
+static unsigned int zt_min_age = 300;
+module_param_named(min_age, zt_min_age, uint, 0644);
+static unsigned int zt_batch = 128;
+module_param_named(batch, zt_batch, uint, 0644);
+static unsigned int zt_max_pages = 8192;
+module_param_named(max_pages, zt_max_pages, uint, 0644);
+
+struct zt_stat {
+	unsigned long passes;
+	unsigned long scanned;		/* zram swap ptes looked at */
+	unsigned long skip_ratio;	/* compressed well enough */
+	unsigned long skip_young;
+	unsigned long skip_shared;
+	unsigned long moved;		/* pages written to nandswap */
+	unsigned long moved_bytes;	/* zram bytes released by them */
+	unsigned long failed;		/* remapped but not reclaimed */
+};
+
+static struct zt_stat zt_stat;
+static DEFINE_PER_CPU(unsigned long [ZT_NR_TIERS], zt_swapins);
+
+struct zt_walk {
+	struct vm_area_struct *vma;
+	struct page *pages[ZT_BATCH_MAX];
+	unsigned int sizes[ZT_BATCH_MAX];
+	int nr;
+	unsigned int budget;
+};
+
+extern unsigned long nswap_reclaim_page_list(struct list_head *page_list,
+					     struct vm_area_struct *vma, bool scan);
+
+void zram_tier_count_fault(swp_entry_t entry)
+{
+	struct swap_info_struct *si = swp_swap_info(entry);
+
+	if (!si)
+		return;
+
+	if (si->flags & SWP_NANDSWAP)
+		this_cpu_inc(zt_swapins[ZT_NAND]);
+	else if (si->flags & SWP_SYNCHRONOUS_IO)
+		this_cpu_inc(zt_swapins[ZT_ZRAM]);
+}
+
+static void zt_flush(struct zt_walk *zw)
+{
+	LIST_HEAD(page_list);
+	struct page *page;
+	unsigned long bytes = 0, reclaimed;
+	int i, isolated = 0;
+
+	if (!zw->nr)
+		return;
+
+	/* pages remapped by swap_tier_unuse() may still sit in a pagevec */
+	lru_add_drain();
+	for (i = 0; i < zw->nr; i++) {
+		page = zw->pages[i];
+		if (!isolate_lru_page(page)) {
+			list_add(&page->lru, &page_list);
+#ifdef CONFIG_OPLUS_SYSTEM_KERNEL_QCOM
+			inc_node_page_state(page, NR_ISOLATED_ANON +
+					page_is_file_cache(page));
+#endif
+			bytes += zw->sizes[i];
+			isolated++;
+		}
+		put_page(page);
+	}
+	zw->nr = 0;
+
+	if (!isolated)
+		return;
+
+	reclaimed = nswap_reclaim_page_list(&page_list, zw->vma, true);
+	nandswap_account_write(reclaimed);
+
+	zt_stat.moved += reclaimed;
+	/* the zram side is gone for every page we remapped */
+	zt_stat.moved_bytes += bytes;
+	zt_stat.failed += isolated - reclaimed;
+}
+
+static int zt_tier_pte(pmd_t *pmd, unsigned long addr,
+		       unsigned long end, struct mm_walk *walk)
+{
+	struct zt_walk *zw = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	unsigned int size, age;
+	swp_entry_t entry;
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *pte, ptent;
+
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+
+	for (; addr != end; addr += PAGE_SIZE) {
+		if (!zw->budget)
+			return 1;
+
+		pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+		ptent = *pte;
+		pte_unmap_unlock(pte, ptl);
+
+		if (!is_swap_pte(ptent))
+			continue;
+		entry = pte_to_swp_entry(ptent);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+
+		/* only zram slots carry tier info */
+		if (!swap_tier_info(entry, &size, &age))
+			continue;
+
+		zt_stat.scanned++;
+		if (size < READ_ONCE(zt_min_size)) {
+			zt_stat.skip_ratio++;
+			continue;
+		}
+		if (age < READ_ONCE(zt_min_age)) {
+			zt_stat.skip_young++;
+			continue;
+		}
+		/* a slot shared with another mm would stay behind in zram */
+		if (__swap_count(entry) != 1) {
+			zt_stat.skip_shared++;
+			continue;
+		}
+
+		page = read_swap_cache_async(entry, GFP_HIGHUSER_MOVABLE,
+					     vma, addr, false);
+		if (!page)
+			continue;
+
+		lock_page(page);
+		wait_on_page_writeback(page);
+		if (!PageSwapCache(page) || page_private(page) != entry.val ||
+		    swap_tier_unuse(vma, pmd, addr, entry, page) <= 0) {
+			unlock_page(page);
+			put_page(page);
+			continue;
+		}
+		unlock_page(page);
+
+		zw->sizes[zw->nr] = size;
+		zw->pages[zw->nr++] = page;
+		zw->budget--;
+		if (zw->nr >= clamp(READ_ONCE(zt_batch), 1U, (unsigned int)ZT_BATCH_MAX))
+			zt_flush(zw);
+	}
+
+	cond_resched();
+	return 0;
+}
+
+static const struct mm_walk_ops zt_walk_ops = {
+	.pmd_entry = zt_tier_pte,
+};
+
+static void zt_tier_task(struct task_struct *task, struct zt_walk *zw)
+{
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	struct blk_plug plug;
+
+	mm = get_task_mm(task);
+	if (!mm)
+		return;
+
+	blk_start_plug(&plug);
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma && zw->budget; vma = vma->vm_next) {
+		if (!vma_is_anonymous(vma) || (vma->vm_flags & VM_LOCKED) ||
+		    is_vm_hugetlb_page(vma))
+			continue;
+
+		zw->vma = vma;
+		walk_page_range(mm, vma->vm_start, vma->vm_end,
+				&zt_walk_ops, zw);
+		zt_flush(zw);
+	}
+	up_read(&mm->mmap_sem);
+	blk_finish_plug(&plug);
+	mmput(mm);
+}
+
+/* tgid of the last task walked, the next pass resumes after it */
+static pid_t zt_cursor;
+
+/*
+ * Pick the ZT_MAX_TASKS eligible tasks whose tgid follows zt_cursor, wrapping
+ * around the pid space, so every cached app gets its turn however long the
+ * task list is. The distance is taken as unsigned, tgids at or below the
+ * cursor sort after all the ones above it. Returns tasks in that order.
+ */
+static int zt_pick_tasks(struct task_struct **tasks)
+{
+	unsigned int keys[ZT_MAX_TASKS], key;
+	struct task_struct *p;
+	int nr = 0, i, uid;
+
+	rcu_read_lock();
+	for_each_process(p) {
+		if (p->flags & PF_KTHREAD || !p->mm)
+			continue;
+		uid = task_uid(p).val;
+		if (uid % AID_USER_OFFSET < AID_APP)
+			continue;
+		if (p->signal->oom_score_adj < READ_ONCE(zt_min_adj))
+			continue;
+
+		key = (unsigned int)p->tgid - (unsigned int)zt_cursor - 1;
+		if (nr == ZT_MAX_TASKS && key >= keys[nr - 1])
+			continue;
+		if (nr < ZT_MAX_TASKS)
+			nr++;
+		for (i = nr - 1; i > 0 && keys[i - 1] > key; i--) {
+			keys[i] = keys[i - 1];
+			tasks[i] = tasks[i - 1];
+		}
+		keys[i] = key;
+		tasks[i] = p;
+	}
+	for (i = 0; i < nr; i++)
+		get_task_struct(tasks[i]);
+	rcu_read_unlock();
+
+	return nr;
+}
+
+static void zt_pass(struct zt_walk *zw)
+{
+	struct task_struct *tasks[ZT_MAX_TASKS];
+	int i, nr;
+
+	zw->budget = READ_ONCE(zt_max_pages);
+	zw->nr = 0;
+
+	nr = zt_pick_tasks(tasks);
+	for (i = 0; i < nr; i++) {
+		/* swap in of a foreground app wins over tiering */
+		if (zw->budget && nandswap_writable()) {
+			zt_tier_task(tasks[i], zw);
+			zt_cursor = tasks[i]->tgid;
+		}
+		put_task_struct(tasks[i]);
+	}
+
+	zt_stat.passes++;
+}
+
+static int zt_tierd_fn(void *p)
+{
+	struct zt_walk *zw;
+
+	zw = kzalloc(sizeof(*zw), GFP_KERNEL);
+	if (!zw)
+		return -ENOMEM;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		if (READ_ONCE(zt_enable) && nandswap_writable())
+			zt_pass(zw);
+
+		freezable_schedule_timeout_interruptible(
+				msecs_to_jiffies(READ_ONCE(zt_interval_ms)));
+	}
+
+	kfree(zw);
+	return 0;
+}
+
+static int zt_proc_show(struct seq_file *m, void *v)
+{
+	unsigned long swapins[ZT_NR_TIERS] = { 0 };
+	unsigned long resident[ZT_NR_TIERS] = { 0 };
+	unsigned long total;
+	struct swap_info_struct *si;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu)
+		for (i = 0; i < ZT_NR_TIERS; i++)
+			swapins[i] += per_cpu(zt_swapins, cpu)[i];
+
+	spin_lock(&swap_lock);
+	plist_for_each_entry(si, &swap_active_head, list) {
+		if (si->flags & SWP_NANDSWAP)
+			resident[ZT_NAND] += si->inuse_pages;
+		else if (si->flags & SWP_SYNCHRONOUS_IO)
+			resident[ZT_ZRAM] += si->inuse_pages;
+	}
+	spin_unlock(&swap_lock);
+
+	total = swapins[ZT_ZRAM] + swapins[ZT_NAND];
+	seq_printf(m, "%-6s %12s %12s %8s\n",
+		   "tier", "resident", "swapins", "share%");
+	seq_printf(m, "%-6s %12lu %12lu %8lu\n", "zram",
+		   resident[ZT_ZRAM], swapins[ZT_ZRAM],
+		   total ? swapins[ZT_ZRAM] * 100 / total : 0);
+	seq_printf(m, "%-6s %12lu %12lu %8lu\n", "nand",
+		   resident[ZT_NAND], swapins[ZT_NAND],
+		   total ? swapins[ZT_NAND] * 100 / total : 0);
+
+	seq_printf(m, "passes %lu\n"
+		   "scanned %lu\n"
+		   "skip_ratio %lu\n"
+		   "skip_young %lu\n"
+		   "skip_shared %lu\n"
+		   "moved_pages %lu\n"
+		   "moved_zram_bytes %lu\n"
+		   "moved_nand_bytes %lu\n"
+		   "failed %lu\n",
+		   zt_stat.passes, zt_stat.scanned, zt_stat.skip_ratio,
+		   zt_stat.skip_young, zt_stat.skip_shared, zt_stat.moved,
+		   zt_stat.moved_bytes, zt_stat.moved << PAGE_SHIFT,
+		   zt_stat.failed);
+	return 0;
+}
+
+static int zt_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zt_proc_show, NULL);
+}
+
+static const struct file_operations zt_proc_fops = {
+	.open = zt_proc_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init zram_tier_init(void)
+{
+	struct task_struct *thread;
+
+	thread = kthread_run(zt_tierd_fn, NULL, "nswaptierd");
+	if (IS_ERR(thread)) {
+		pr_err("failed to start nswaptierd\n");
+		return PTR_ERR(thread);
+	}
+	nswaptierd = thread;
+
+	proc_create("zram_tier", 0444, NULL, &zt_proc_fops);
+	return 0;
+}
+late_initcall(zram_tier_init);
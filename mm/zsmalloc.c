@@ -197,6 +197,25 @@ static struct vfsmount *zsmalloc_mnt;
 static const int fullness_threshold_frac = 4;
 static size_t huge_class_size;
 
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+/*
+ * Per-cpu cache of objects already allocated from a class, each with its
+ * handle recorded, so zs_malloc() can hand one out without class->lock.
+ * Refilled ZS_MAG_BATCH objects at a time, drained before compaction and
+ * when a CPU goes offline. Cached objects count as used in the class
+ * stats, and compaction and migration move them like any other object
+ * since their handle is set; the shrinker counts them as freeable.
+ */
+#define ZS_MAG_SIZE	16
+#define ZS_MAG_BATCH	8
+
+struct zs_magazine {
+	spinlock_t lock;
+	int nr;
+	unsigned long handles[ZS_MAG_SIZE];
+};
+#endif
+
 struct size_class {
 	spinlock_t lock;
 	struct list_head fullness_list[NR_ZS_FULLNESS];
@@ -211,6 +230,9 @@ struct size_class {
 
 	unsigned int index;
 	struct zs_size_stat stats;
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+	struct zs_magazine __percpu *mag;
+#endif
 };
 
 /* huge object: pages_per_zspage == 1 && maxobj_per_zspage == 1 */
@@ -274,6 +296,10 @@ struct zs_pool {
 	atomic_long_t isolated_pages;
 	bool destroying;
 #endif
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+	/* instance of zs_mag_hp_state, drains magazines of dead CPUs */
+	struct hlist_node mag_node;
+#endif
 };
 
 struct zspage {
@@ -593,12 +619,12 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 	unsigned long obj_allocated, obj_used, pages_used, freeable;
 	unsigned long total_class_almost_full = 0, total_class_almost_empty = 0;
 	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
-	unsigned long total_freeable = 0;
+	unsigned long total_freeable = 0, cached, total_cached = 0;
 
-	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s\n",
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s %8s\n",
 			"class", "size", "almost_full", "almost_empty",
 			"obj_allocated", "obj_used", "pages_used",
-			"pages_per_zspage", "freeable");
+			"pages_per_zspage", "freeable", "cached");
 
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		class = pool->size_class[i];
@@ -613,16 +639,17 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		obj_used = zs_stat_get(class, OBJ_USED);
 		freeable = zs_can_compact(class);
 		spin_unlock(&class->lock);
+		cached = zs_mag_count(class);
 
 		objs_per_zspage = class->objs_per_zspage;
 		pages_used = obj_allocated / objs_per_zspage *
 				class->pages_per_zspage;
 
 		seq_printf(s, " %5u %5u %11lu %12lu %13lu"
-				" %10lu %10lu %16d %8lu\n",
+				" %10lu %10lu %16d %8lu %8lu\n",
 			i, class->size, class_almost_full, class_almost_empty,
 			obj_allocated, obj_used, pages_used,
-			class->pages_per_zspage, freeable);
+			class->pages_per_zspage, freeable, cached);
 
 		total_class_almost_full += class_almost_full;
 		total_class_almost_empty += class_almost_empty;
@@ -630,13 +657,15 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		total_used_objs += obj_used;
 		total_pages += pages_used;
 		total_freeable += freeable;
+		total_cached += cached;
 	}
 
 	seq_puts(s, "\n");
-	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu\n",
+	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu %8lu\n",
 			"Total", "", total_class_almost_full,
 			total_class_almost_empty, total_objs,
-			total_used_objs, total_pages, "", total_freeable);
+			total_used_objs, total_pages, "", total_freeable,
+			total_cached);
 
 	return 0;
 }
@@ -1399,6 +1428,242 @@ static unsigned long obj_malloc(struct size_class *class,
 	return obj;
 }
 
+#if IS_ENABLED(CONFIG_OPLUS_FEATURE_ZRAM_OPT)
+/* objects stored in all pools, zram_opt derives the compression ratio */
+static DEFINE_PER_CPU(long, zs_nr_objs);
+
+unsigned long zs_get_total_objs(void)
+{
+	long nr = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		nr += per_cpu(zs_nr_objs, cpu);
+
+	return max(nr, 0L);
+}
+EXPORT_SYMBOL_GPL(zs_get_total_objs);
+
+static inline void zs_objs_inc(void)
+{
+	this_cpu_inc(zs_nr_objs);
+}
+
+static inline void zs_objs_dec(void)
+{
+	this_cpu_dec(zs_nr_objs);
+}
+#else
+static inline void zs_objs_inc(void) {}
+static inline void zs_objs_dec(void) {}
+#endif
+
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+static void __zs_free(struct zs_pool *pool, unsigned long handle);
+
+/*
+ * Allocate up to @nr objects from @class under one class->lock hold,
+ * adding a new zspage only if no existing one has room.
+ * Returns the number of handles stored in @handles.
+ */
+static int zs_malloc_batch(struct zs_pool *pool, struct size_class *class,
+			   unsigned long *handles, int nr, gfp_t gfp)
+{
+	enum fullness_group newfg;
+	struct zspage *zspage;
+	unsigned long obj;
+	int i, got = 0;
+
+	for (i = 0; i < nr; i++) {
+		handles[i] = cache_alloc_handle(pool, gfp);
+		if (!handles[i])
+			break;
+	}
+	nr = i;
+	if (!nr)
+		return 0;
+
+	spin_lock(&class->lock);
+	while (got < nr && (zspage = find_get_zspage(class))) {
+		obj = obj_malloc(class, zspage, handles[got]);
+		fix_fullness_group(class, zspage);
+		record_obj(handles[got++], obj);
+	}
+	spin_unlock(&class->lock);
+
+	if (got)
+		goto out;
+
+	zspage = alloc_zspage(pool, class, gfp);
+	if (!zspage)
+		goto out;
+
+	spin_lock(&class->lock);
+	while (got < nr && got < class->objs_per_zspage) {
+		obj = obj_malloc(class, zspage, handles[got]);
+		record_obj(handles[got++], obj);
+	}
+	newfg = get_fullness_group(class, zspage);
+	insert_zspage(class, zspage, newfg);
+	set_zspage_mapping(zspage, class->index, newfg);
+	atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+	zs_stat_inc(class, OBJ_ALLOCATED, class->objs_per_zspage);
+
+	/* We completely set up zspage so mark them as movable */
+	SetZsPageMovable(pool, zspage);
+	spin_unlock(&class->lock);
+out:
+	for (i = got; i < nr; i++)
+		cache_free_handle(pool, handles[i]);
+
+	return got;
+}
+
+static unsigned long zs_mag_alloc(struct zs_pool *pool,
+				  struct size_class *class, gfp_t gfp)
+{
+	unsigned long handles[ZS_MAG_BATCH];
+	struct zs_magazine *mag;
+	unsigned long handle = 0;
+	int i, nr;
+
+	mag = raw_cpu_ptr(class->mag);
+	spin_lock(&mag->lock);
+	if (mag->nr)
+		handle = mag->handles[--mag->nr];
+	spin_unlock(&mag->lock);
+	if (handle)
+		return handle;
+
+	/* may sleep, so the magazine is picked again afterwards */
+	nr = zs_malloc_batch(pool, class, handles, ZS_MAG_BATCH, gfp);
+	if (!nr)
+		return 0;
+
+	mag = raw_cpu_ptr(class->mag);
+	spin_lock(&mag->lock);
+	for (i = 1; i < nr && mag->nr < ZS_MAG_SIZE; i++)
+		mag->handles[mag->nr++] = handles[i];
+	spin_unlock(&mag->lock);
+
+	/* another refill of this magazine won the race */
+	for (; i < nr; i++)
+		__zs_free(pool, handles[i]);
+
+	return handles[0];
+}
+
+static void zs_mag_drain_cpu(struct zs_pool *pool, struct size_class *class,
+			     int cpu)
+{
+	unsigned long handles[ZS_MAG_SIZE];
+	struct zs_magazine *mag;
+	int nr;
+
+	mag = per_cpu_ptr(class->mag, cpu);
+	spin_lock(&mag->lock);
+	nr = mag->nr;
+	memcpy(handles, mag->handles, nr * sizeof(handles[0]));
+	mag->nr = 0;
+	spin_unlock(&mag->lock);
+
+	while (nr--)
+		__zs_free(pool, handles[nr]);
+}
+
+static void zs_mag_drain(struct zs_pool *pool, struct size_class *class)
+{
+	int cpu;
+
+	if (!class->mag)
+		return;
+
+	for_each_possible_cpu(cpu)
+		zs_mag_drain_cpu(pool, class, cpu);
+}
+
+static enum cpuhp_state zs_mag_hp_state;
+
+/* nothing refills the magazines of an offline CPU, give them back */
+static int zs_mag_cpu_dead(unsigned int cpu, struct hlist_node *node)
+{
+	struct zs_pool *pool = hlist_entry(node, struct zs_pool, mag_node);
+	struct size_class *class;
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		class = pool->size_class[i];
+		if (class && class->index == i && class->mag)
+			zs_mag_drain_cpu(pool, class, cpu);
+	}
+
+	return 0;
+}
+
+static int zs_mag_register(struct zs_pool *pool)
+{
+	return cpuhp_state_add_instance_nocalls(zs_mag_hp_state,
+						&pool->mag_node);
+}
+
+static void zs_mag_unregister(struct zs_pool *pool)
+{
+	if (!hlist_unhashed(&pool->mag_node))
+		cpuhp_state_remove_instance_nocalls(zs_mag_hp_state,
+						    &pool->mag_node);
+}
+
+static void zs_mag_create(struct size_class *class)
+{
+	int cpu;
+
+	/* a huge class object is a whole page, not worth caching */
+	if (class->objs_per_zspage == 1)
+		return;
+
+	/* optional, zs_malloc() falls back to class->lock without it */
+	class->mag = alloc_percpu(struct zs_magazine);
+	if (!class->mag)
+		return;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(class->mag, cpu)->lock);
+}
+
+static void zs_mag_destroy(struct size_class *class)
+{
+	free_percpu(class->mag);
+}
+
+static unsigned long zs_mag_count(struct size_class *class)
+{
+	unsigned long nr = 0;
+	int cpu;
+
+	if (!class->mag)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		nr += READ_ONCE(per_cpu_ptr(class->mag, cpu)->nr);
+
+	return nr;
+}
+#else
+static inline void zs_mag_drain(struct zs_pool *pool,
+				struct size_class *class) {}
+static inline int zs_mag_register(struct zs_pool *pool)
+{
+	return 0;
+}
+static inline void zs_mag_unregister(struct zs_pool *pool) {}
+static inline void zs_mag_create(struct size_class *class) {}
+static inline void zs_mag_destroy(struct size_class *class) {}
+static inline unsigned long zs_mag_count(struct size_class *class)
+{
+	return 0;
+}
+#endif
 
 /**
  * zs_malloc - Allocate block of given size from pool.
@@ -1420,14 +1685,23 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
-	handle = cache_alloc_handle(pool, gfp);
-	if (!handle)
-		return 0;
-
 	/* extra space in chunk to keep the handle */
 	size += ZS_HANDLE_SIZE;
 	class = pool->size_class[get_size_class_index(size)];
 
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+	if (class->mag) {
+		handle = zs_mag_alloc(pool, class, gfp);
+		if (handle)
+			zs_objs_inc();
+		return handle;
+	}
+#endif
+
+	handle = cache_alloc_handle(pool, gfp);
+	if (!handle)
+		return 0;
+
 	spin_lock(&class->lock);
 	zspage = find_get_zspage(class);
 	if (likely(zspage)) {
@@ -1436,6 +1710,7 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 		fix_fullness_group(class, zspage);
 		record_obj(handle, obj);
 		spin_unlock(&class->lock);
+		zs_objs_inc();
 
 		return handle;
 	}
@@ -1461,6 +1736,7 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	/* We completely set up zspage so mark them as movable */
 	SetZsPageMovable(pool, zspage);
 	spin_unlock(&class->lock);
+	zs_objs_inc();
 
 	return handle;
 }
@@ -1491,7 +1767,7 @@ static void obj_free(struct size_class *class, unsigned long obj)
 	zs_stat_dec(class, OBJ_USED, 1);
 }
 
-void zs_free(struct zs_pool *pool, unsigned long handle)
+static void __zs_free(struct zs_pool *pool, unsigned long handle)
 {
 	struct zspage *zspage;
 	struct page *f_page;
@@ -1502,9 +1778,6 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	enum fullness_group fullness;
 	bool isolated;
 
-	if (unlikely(!handle))
-		return;
-
 	pin_tag(handle);
 	obj = handle_to_obj(handle);
 	obj_to_location(obj, &f_page, &f_objidx);
@@ -1534,6 +1807,15 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	unpin_tag(handle);
 	cache_free_handle(pool, handle);
 }
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	if (unlikely(!handle))
+		return;
+
+	zs_objs_dec();
+	__zs_free(pool, handle);
+}
 EXPORT_SYMBOL_GPL(zs_free);
 
 static void zs_object_copy(struct size_class *class, unsigned long dst,
@@ -2279,6 +2561,8 @@ unsigned long zs_compact(struct zs_pool *pool)
 			continue;
 		if (class->index != i)
 			continue;
+		/* cached objects would pin otherwise empty zspages */
+		zs_mag_drain(pool, class);
 		pages_freed += __zs_compact(pool, class);
 	}
 	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
@@ -2310,6 +2594,24 @@ static unsigned long zs_shrinker_scan(struct shrinker *shrinker,
 	return pages_freed ? pages_freed : SHRINK_STOP;
 }
 
+/*
+ * Like zs_can_compact(), but objects parked in magazines count as free:
+ * zs_compact() drains them first, so the zspages they alone pin are
+ * freeable too.
+ */
+static unsigned long zs_can_reclaim(struct size_class *class)
+{
+	unsigned long obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
+	unsigned long obj_used = zs_stat_get(class, OBJ_USED);
+
+	obj_used -= min(obj_used, zs_mag_count(class));
+	if (obj_allocated <= obj_used)
+		return 0;
+
+	return (obj_allocated - obj_used) / class->objs_per_zspage *
+		class->pages_per_zspage;
+}
+
 static unsigned long zs_shrinker_count(struct shrinker *shrinker,
 		struct shrink_control *sc)
 {
@@ -2326,7 +2628,7 @@ static unsigned long zs_shrinker_count(struct shrinker *shrinker,
 		if (class->index != i)
 			continue;
 
-		pages_to_free += zs_can_compact(class);
+		pages_to_free += zs_can_reclaim(class);
 	}
 
 	return pages_to_free;
@@ -2443,6 +2745,7 @@ struct zs_pool *zs_create_pool(const char *name)
 		class->pages_per_zspage = pages_per_zspage;
 		class->objs_per_zspage = objs_per_zspage;
 		spin_lock_init(&class->lock);
+		zs_mag_create(class);
 		pool->size_class[i] = class;
 		for (fullness = ZS_EMPTY; fullness < NR_ZS_FULLNESS;
 							fullness++)
@@ -2465,6 +2768,9 @@ struct zs_pool *zs_create_pool(const char *name)
 	 */
 	zs_register_shrinker(pool);
 
+	if (zs_mag_register(pool))
+		goto err;
+
 	return pool;
 
 err:
@@ -2477,6 +2783,16 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	zs_mag_unregister(pool);
+
+	/* give cached objects back while deferred zspage freeing still works */
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		if (class && class->index == i)
+			zs_mag_drain(pool, class);
+	}
+
 	zs_unregister_shrinker(pool);
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
@@ -2491,6 +2807,7 @@ void zs_destroy_pool(struct zs_pool *pool)
 		if (class->index != i)
 			continue;
 
+		zs_mag_destroy(class);
 		for (fg = ZS_EMPTY; fg < NR_ZS_FULLNESS; fg++) {
 			if (!list_empty(&class->fullness_list[fg])) {
 				pr_info("Freeing non-empty class with size %db, fullness group %d\n",
@@ -2519,6 +2836,14 @@ static int __init zs_init(void)
 	if (ret)
 		goto hp_setup_fail;
 
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+	ret = cpuhp_setup_state_multi(CPUHP_BP_PREPARE_DYN, "mm/zsmalloc:mag",
+				      NULL, zs_mag_cpu_dead);
+	if (ret < 0)
+		goto mag_setup_fail;
+	zs_mag_hp_state = ret;
+#endif
+
 #ifdef CONFIG_ZPOOL
 	zpool_register_driver(&zs_zpool_driver);
 #endif
@@ -2527,6 +2852,10 @@ static int __init zs_init(void)
 
 	return 0;
 
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+mag_setup_fail:
+	cpuhp_remove_state(CPUHP_MM_ZS_PREPARE);
+#endif
 hp_setup_fail:
 	zsmalloc_unmount();
 out:
@@ -2539,6 +2868,9 @@ static void __exit zs_exit(void)
 	zpool_unregister_driver(&zs_zpool_driver);
 #endif
 	zsmalloc_unmount();
+#ifdef CONFIG_ZSMALLOC_MAGAZINE
+	cpuhp_remove_multi_state(zs_mag_hp_state);
+#endif
 	cpuhp_remove_state(CPUHP_MM_ZS_PREPARE);
 
 	zs_stat_exit();
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Offline replay of the DCVS co-governor. Feeds a recorded counter trace
+ * through the same energy model the kernel uses (drivers/devfreq/
+ * dcvs_cogov_model.c) and compares its joint CPU/memory requests with
+ * the frequencies that were actually in place when the trace was taken.
+ *
+ * Trace format, one record per line, '#' starts a comment:
+ *
+ *   cpu_opp <kHz> <mW>		CPU OPPs of the cluster, any order
+ *   mem_opp <MBps>		memory votes, as in qcom,core-dev-table
+ *   param <name> <value>	target_load, stall_floor, ratio_ceil, mem_cost
+ *   sample <ts_us> <util> <cpu_kHz> <stall_pct> <ratio> <mem_MBps> <bw_MBps>
+ *
+ * util is the schedutil demand in permille of the capacity at the top
+ * OPP (sugov_util_update util * 1000 / max), stall_pct and ratio come
+ * from memlat_dev_meas, bw_MBps from bw_hwmon_meas and mem_MBps from
+ * memlat_dev_update of the device coupled with the cluster.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dcvs_cogov_model.h"
+
+struct totals {
+	unsigned long samples;
+	unsigned long long rec_energy;
+	unsigned long long gov_energy;
+	unsigned long rec_over;
+	unsigned long gov_over;
+	unsigned long mem_bound;
+	unsigned long capped;
+};
+
+static struct cogov_domain dom = {
+	.target_load	= 80,
+	.stall_floor	= 0,
+	.ratio_ceil	= 10,
+	.mem_cost	= 60,
+};
+
+static int set_param(const char *name, unsigned int val)
+{
+	if (!strcmp(name, "target_load"))
+		dom.target_load = val;
+	else if (!strcmp(name, "stall_floor"))
+		dom.stall_floor = val;
+	else if (!strcmp(name, "ratio_ceil"))
+		dom.ratio_ceil = val;
+	else if (!strcmp(name, "mem_cost"))
+		dom.mem_cost = val;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static int cmp_opp(const void *a, const void *b)
+{
+	const struct cogov_opp *x = a, *y = b;
+
+	return x->freq < y->freq ? -1 : x->freq > y->freq;
+}
+
+static void replay(const struct cogov_sample *s, unsigned long long ts,
+		   struct totals *t, int verbose)
+{
+	unsigned int limit = dom.target_load * 10;
+	struct cogov_decision d;
+	unsigned int rec_busy, rec_energy;
+	int ci, mi;
+
+	ci = cogov_find(dom.cpu, dom.nr_cpu, s->cpu_freq);
+	mi = cogov_find(dom.mem, dom.nr_mem, s->mem_freq);
+	rec_energy = cogov_eval(&dom, s, ci, mi, &rec_busy);
+	cogov_decide(&dom, s, &d);
+
+	t->samples++;
+	t->rec_energy += rec_energy;
+	t->gov_energy += d.energy;
+	t->rec_over += rec_busy > limit;
+	t->gov_over += d.saturated;
+	t->mem_bound += d.mem_bound;
+	t->capped += d.mem_bound && !d.saturated && d.cpu_freq < s->cpu_freq;
+
+	if (verbose)
+		printf("%12llu util %4u stall %3u | rec %8u kHz %6u MBps busy %4u E %5u | cogov %8u kHz %6u MBps busy %4u E %5u%s%s\n",
+		       ts, s->util, s->stall_pct, s->cpu_freq, s->mem_freq,
+		       rec_busy, rec_energy, d.cpu_freq, d.mem_freq, d.busy,
+		       d.energy, d.mem_bound ? " mem_bound" : "",
+		       d.saturated ? " saturated" : "");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-v] [-t target_load] [-s stall_floor] [-r ratio_ceil] [-c mem_cost] trace\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	struct cogov_opp cpu[COGOV_MAX_OPP * 4], mem[COGOV_MAX_OPP * 4];
+	unsigned int over[4] = { 0 }, have[4] = { 0 };
+	struct cogov_sample s;
+	struct totals t = { 0 };
+	int nr_cpu = 0, nr_mem = 0, verbose = 0, opt, i, n, lineno = 0;
+	unsigned long long ts;
+	unsigned int a, b;
+	char line[512], name[64];
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "vt:s:r:c:h")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 't':
+			over[0] = atoi(optarg);
+			have[0] = 1;
+			break;
+		case 's':
+			over[1] = atoi(optarg);
+			have[1] = 1;
+			break;
+		case 'r':
+			over[2] = atoi(optarg);
+			have[2] = 1;
+			break;
+		case 'c':
+			over[3] = atoi(optarg);
+			have[3] = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	f = fopen(argv[optind], "r");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p = strchr(line, '#');
+
+		lineno++;
+		if (p)
+			*p = '\0';
+
+		if (sscanf(line, "cpu_opp %u %u", &a, &b) == 2) {
+			if (nr_cpu < COGOV_MAX_OPP * 4)
+				cpu[nr_cpu++] = (struct cogov_opp){ a, b };
+			continue;
+		}
+		if (sscanf(line, "mem_opp %u", &a) == 1) {
+			if (nr_mem < COGOV_MAX_OPP * 4)
+				mem[nr_mem++] = (struct cogov_opp){ a, 0 };
+			continue;
+		}
+		if (sscanf(line, "param %63s %u", name, &a) == 2) {
+			if (set_param(name, a))
+				fprintf(stderr, "line %d: unknown param %s\n",
+					lineno, name);
+			continue;
+		}
+
+		n = sscanf(line, "sample %llu %u %u %u %u %u %u", &ts,
+			   &s.util, &s.cpu_freq, &s.stall_pct, &s.ratio,
+			   &s.mem_freq, &s.bw_mbps);
+		if (n == 7) {
+			/* OPP tables are fixed by the first sample */
+			if (!dom.nr_cpu) {
+				qsort(cpu, nr_cpu, sizeof(*cpu), cmp_opp);
+				qsort(mem, nr_mem, sizeof(*mem), cmp_opp);
+				for (i = 0; i < nr_cpu && i < COGOV_MAX_OPP; i++)
+					dom.cpu[i] = cpu[i];
+				dom.nr_cpu = i;
+				for (i = 0; i < nr_mem && i < COGOV_MAX_OPP; i++)
+					dom.mem[i] = mem[i];
+				dom.nr_mem = i;
+				if (have[0])
+					dom.target_load = over[0];
+				if (have[1])
+					dom.stall_floor = over[1];
+				if (have[2])
+					dom.ratio_ceil = over[2];
+				if (have[3])
+					dom.mem_cost = over[3];
+				if (!dom.nr_cpu) {
+					fprintf(stderr, "no cpu_opp before the first sample\n");
+					return 1;
+				}
+			}
+			replay(&s, ts, &t, verbose);
+			continue;
+		}
+
+		if (strspn(line, " \t\r\n") != strlen(line))
+			fprintf(stderr, "line %d: not understood\n", lineno);
+	}
+	fclose(f);
+
+	if (!t.samples) {
+		printf("no samples\n");
+		return 1;
+	}
+
+	printf("%lu windows, target_load %u%%, stall_floor %u%%, ratio_ceil %u, mem_cost %u mW/GBps\n",
+	       t.samples, dom.target_load, dom.stall_floor, dom.ratio_ceil,
+	       dom.mem_cost);
+	printf("recorded: avg %6.1f mW, %lu windows over target\n",
+	       (double)t.rec_energy / t.samples, t.rec_over);
+	printf("cogov:    avg %6.1f mW, %lu windows saturated, %lu memory bound, %lu with cpu capped\n",
+	       (double)t.gov_energy / t.samples, t.gov_over, t.mem_bound,
+	       t.capped);
+	if (t.rec_energy)
+		printf("energy delta: %+.1f%%\n",
+		       100.0 * ((double)t.gov_energy - t.rec_energy) /
+		       t.rec_energy);
+
+	return 0;
+}
@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * binderThroughputTest-style ping-pong: a client sends synchronous
+ * transactions to a context manager that echoes the payload back, and
+ * the round trip of each one is timed. The test runs on a private
+ * binderfs instance so it does not need servicemanager out of the way.
+ * When binder_alloc.buffer_cache is writable every payload size is run
+ * with the freed-buffer cache off and then on.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <linux/android/binder.h>
+#include <linux/android/binderfs.h>
+
+#include "../../kselftest.h"
+
+#define MAP_SIZE	(1024 * 1024)
+#define CACHE_PARAM	"/sys/module/binder_alloc/parameters/buffer_cache"
+
+static const size_t sizes[] = { 16, 256, 2048, 16384 };
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_str(const char *path, const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+static int make_device(char *dir, char *dev, size_t len)
+{
+	struct binderfs_device device = { .name = "pingpong" };
+	char ctl[PATH_MAX];
+	int fd, ret;
+
+	if (unshare(CLONE_NEWNS) ||
+	    mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL))
+		return -errno;
+	if (!mkdtemp(dir))
+		return -errno;
+	if (mount(NULL, dir, "binder", 0, NULL))
+		return -errno;
+
+	snprintf(ctl, sizeof(ctl), "%s/binder-control", dir);
+	fd = open(ctl, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	ret = ioctl(fd, BINDER_CTL_ADD, &device);
+	close(fd);
+	if (ret < 0)
+		return -errno;
+
+	snprintf(dev, len, "%s/%s", dir, device.name);
+	return 0;
+}
+
+static int binder_open(const char *dev)
+{
+	struct binder_version version = { 0 };
+	void *map;
+	int fd;
+
+	fd = open(dev, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (ioctl(fd, BINDER_VERSION, &version) < 0 ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION)
+		goto err;
+	map = mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wlen,
+			     void *rbuf, size_t rlen, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_size = wlen,
+		.write_buffer = (uintptr_t)wbuf,
+		.read_size = rlen,
+		.read_buffer = (uintptr_t)rbuf,
+	};
+
+	if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0)
+		return -errno;
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return 0;
+}
+
+/* context manager: echo every transaction back with the same payload */
+static void server(const char *dev, int ready_fd)
+{
+	static char payload[16384];
+	uint32_t looper = BC_ENTER_LOOPER;
+	uint32_t rbuf[128];
+	struct {
+		uint32_t free_cmd;
+		binder_uintptr_t buffer;
+		uint32_t reply_cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) reply;
+	size_t consumed, off;
+	char c = 0;
+	int fd;
+
+	fd = binder_open(dev);
+	if (fd < 0 || ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0 ||
+	    binder_write_read(fd, &looper, sizeof(looper), NULL, 0, NULL))
+		_exit(1);
+	if (write(ready_fd, &c, 1) != 1)
+		_exit(1);
+
+	for (;;) {
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed))
+			_exit(1);
+
+		for (off = 0; off < consumed;) {
+			uint32_t cmd = *(uint32_t *)((char *)rbuf + off);
+			struct binder_transaction_data *tr;
+
+			off += sizeof(cmd);
+			if (cmd != BR_TRANSACTION) {
+				off += _IOC_SIZE(cmd);
+				continue;
+			}
+
+			tr = (void *)((char *)rbuf + off);
+			off += sizeof(*tr);
+
+			memset(&reply, 0, sizeof(reply));
+			reply.free_cmd = BC_FREE_BUFFER;
+			reply.buffer = tr->data.ptr.buffer;
+			reply.reply_cmd = BC_REPLY;
+			reply.tr.data_size = tr->data_size;
+			reply.tr.data.ptr.buffer = (uintptr_t)payload;
+			if (binder_write_read(fd, &reply, sizeof(reply),
+					      NULL, 0, NULL))
+				_exit(1);
+		}
+	}
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* one synchronous round trip, freeing the previous reply on the way out */
+static int transact(int fd, void *payload, size_t size,
+		    binder_uintptr_t *reply_buf)
+{
+	struct {
+		uint32_t free_cmd;
+		binder_uintptr_t buffer;
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) wr = { 0 };
+	uint32_t rbuf[128];
+	size_t consumed = 0, off, skip = 0;
+	int ret;
+
+	if (*reply_buf) {
+		wr.free_cmd = BC_FREE_BUFFER;
+		wr.buffer = *reply_buf;
+	} else {
+		skip = sizeof(wr.free_cmd) + sizeof(wr.buffer);
+	}
+	wr.cmd = BC_TRANSACTION;
+	wr.tr.target.handle = 0;
+	wr.tr.code = 1;
+	wr.tr.data_size = size;
+	wr.tr.data.ptr.buffer = (uintptr_t)payload;
+
+	ret = binder_write_read(fd, (char *)&wr + skip, sizeof(wr) - skip,
+				rbuf, sizeof(rbuf), &consumed);
+	for (;;) {
+		if (ret)
+			return ret;
+		for (off = 0; off < consumed;) {
+			uint32_t cmd = *(uint32_t *)((char *)rbuf + off);
+
+			off += sizeof(cmd);
+			if (cmd == BR_REPLY) {
+				struct binder_transaction_data *tr;
+
+				tr = (void *)((char *)rbuf + off);
+				*reply_buf = tr->data.ptr.buffer;
+				return 0;
+			}
+			if (cmd == BR_DEAD_REPLY || cmd == BR_FAILED_REPLY)
+				return -EPIPE;
+			off += _IOC_SIZE(cmd);
+		}
+		ret = binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf),
+					&consumed);
+	}
+}
+
+static int run(int fd, size_t size, int iters, unsigned long long *lat,
+	       const char *mode)
+{
+	static char payload[16384];
+	binder_uintptr_t reply_buf = 0;
+	unsigned long long t0, sum = 0;
+	int i, ret;
+
+	for (i = 0; i < iters; i++) {
+		t0 = now_ns();
+		ret = transact(fd, payload, size, &reply_buf);
+		if (ret) {
+			printf("%6zu bytes: transaction failed: %s\n",
+			       size, strerror(-ret));
+			return ret;
+		}
+		lat[i] = now_ns() - t0;
+		sum += lat[i];
+	}
+
+	if (reply_buf) {
+		struct {
+			uint32_t cmd;
+			binder_uintptr_t buffer;
+		} __attribute__((packed)) fr = { BC_FREE_BUFFER, reply_buf };
+
+		binder_write_read(fd, &fr, sizeof(fr), NULL, 0, NULL);
+	}
+
+	qsort(lat, iters, sizeof(*lat), cmp_ull);
+	printf("%6zu bytes %-10s: %8.0f txn/s  avg %6.1f us  p50 %6.1f us  p99 %6.1f us\n",
+	       size, mode, sum ? iters * 1e9 / sum : 0, sum / 1e3 / iters,
+	       lat[iters / 2] / 1e3, lat[(iters * 99) / 100] / 1e3);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [-d binder device]\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/binderfs_bench_XXXXXX";
+	char dev[PATH_MAX] = { 0 };
+	unsigned long long *lat;
+	int ready[2], fd, opt, i, ret = 0;
+	int iters = 20000;
+	bool toggle;
+	pid_t pid;
+	char c;
+
+	while ((opt = getopt(argc, argv, "n:d:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 'd':
+			snprintf(dev, sizeof(dev), "%s", optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (iters < 100)
+		iters = 100;
+
+	if (!dev[0]) {
+		ret = make_device(dir, dev, sizeof(dev));
+		if (ret) {
+			printf("no binderfs instance available (%s), skipping\n",
+			       strerror(-ret));
+			return KSFT_SKIP;
+		}
+	}
+
+	lat = calloc(iters, sizeof(*lat));
+	if (!lat || pipe(ready))
+		return 1;
+
+	pid = fork();
+	if (pid < 0)
+		return 1;
+	if (!pid) {
+		close(ready[0]);
+		server(dev, ready[1]);
+	}
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1) {
+		printf("%s: cannot become context manager, skipping\n", dev);
+		waitpid(pid, NULL, 0);
+		return KSFT_SKIP;
+	}
+
+	fd = binder_open(dev);
+	if (fd < 0) {
+		perror("binder_open");
+		kill(pid, SIGKILL);
+		return 1;
+	}
+
+	toggle = !access(CACHE_PARAM, W_OK);
+	printf("%d round trips per size%s\n", iters,
+	       toggle ? ", freed-buffer cache off then on" : "");
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		if (toggle) {
+			write_str(CACHE_PARAM, "0");
+			ret = run(fd, sizes[i], iters, lat, "cache off");
+			if (ret)
+				break;
+			write_str(CACHE_PARAM, "1");
+		}
+		ret = run(fd, sizes[i], iters, lat,
+			  toggle ? "cache on" : "");
+		if (ret)
+			break;
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	close(fd);
+	free(lat);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ION system heap allocation latency with and without the pre-zeroed
+ * page stock. Each round empties the heap pools through drop_caches,
+ * gives the pre-zero thread time to refill its stock, then times a
+ * single ION_IOC_ALLOC of the buffer size. This is the allocation a
+ * camera or game sees after the system has been idle for a moment.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include "ion.h"
+#include "../../kselftest.h"
+
+#define PREZERO_PARAM	"/sys/module/msm_ion_heaps/parameters/prezero_enable"
+/* ION_SYSTEM_HEAP_ID in the msm heap id layout */
+#define MSM_SYSTEM_HEAP_ID	25
+
+static const unsigned int sizes_mb[] = { 8, 32, 128 };
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_str(const char *path, const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+static char read_char(const char *path)
+{
+	char c = '1';
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return c;
+	if (read(fd, &c, 1) != 1)
+		c = '1';
+	close(fd);
+	return c;
+}
+
+static int alloc_once(int ionfd, unsigned int heap_id, unsigned int flags,
+		      size_t len, unsigned long long *ns)
+{
+	struct ion_allocation_data data = {
+		.len = len,
+		.heap_id_mask = 1U << heap_id,
+		.flags = flags,
+	};
+	unsigned long long t0;
+
+	t0 = now_ns();
+	if (ioctl(ionfd, ION_IOC_ALLOC, &data) < 0)
+		return -errno;
+	*ns = now_ns() - t0;
+	close(data.fd);
+	return 0;
+}
+
+static int run(int ionfd, unsigned int heap_id, unsigned int flags,
+	       unsigned int mb, int rounds, int settle_ms, const char *mode)
+{
+	unsigned long long ns = 0, sum = 0, min = ~0ULL, max = 0;
+	int r, ret;
+
+	for (r = 0; r < rounds; r++) {
+		/* empty the pools so the allocation misses them */
+		write_str("/proc/sys/vm/drop_caches", "3");
+		usleep(settle_ms * 1000);
+
+		ret = alloc_once(ionfd, heap_id, flags, (size_t)mb << 20, &ns);
+		if (ret) {
+			printf("%4u MB %-3s: ION_IOC_ALLOC failed: %s\n",
+			       mb, mode, strerror(-ret));
+			return ret;
+		}
+		sum += ns;
+		if (ns < min)
+			min = ns;
+		if (ns > max)
+			max = ns;
+	}
+
+	printf("%4u MB %-8s %-3s: avg %8.2f ms  min %8.2f ms  max %8.2f ms\n",
+	       mb, flags & ION_FLAG_CACHED ? "cached" : "uncached", mode,
+	       sum / 1e6 / rounds, min / 1e6, max / 1e6);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-r rounds] [-s settle ms] [-i heap id] [-c]\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int heap_id = MSM_SYSTEM_HEAP_ID, flags = 0;
+	int rounds = 8, settle_ms = 1000;
+	int ionfd, i, opt, ret = 0;
+	char saved[2] = { 0 };
+
+	while ((opt = getopt(argc, argv, "r:s:i:ch")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			settle_ms = atoi(optarg);
+			break;
+		case 'i':
+			heap_id = atoi(optarg);
+			break;
+		case 'c':
+			flags |= ION_FLAG_CACHED;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (rounds < 1)
+		rounds = 1;
+
+	ionfd = open("/dev/ion", O_RDONLY);
+	if (ionfd < 0) {
+		printf("/dev/ion not available, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	if (access(PREZERO_PARAM, W_OK)) {
+		printf("%s not writable, skipping\n", PREZERO_PARAM);
+		close(ionfd);
+		return KSFT_SKIP;
+	}
+
+	/* Y/N from a bool param, written back as-is at the end */
+	saved[0] = read_char(PREZERO_PARAM);
+
+	printf("%d rounds, %d ms settle time between rounds\n",
+	       rounds, settle_ms);
+	for (i = 0; i < (int)(sizeof(sizes_mb) / sizeof(sizes_mb[0])); i++) {
+		write_str(PREZERO_PARAM, "0");
+		ret = run(ionfd, heap_id, flags, sizes_mb[i], rounds,
+			  settle_ms, "off");
+		if (ret)
+			break;
+		write_str(PREZERO_PARAM, "1");
+		ret = run(ionfd, heap_id, flags, sizes_mb[i], rounds,
+			  settle_ms, "on");
+		if (ret)
+			break;
+	}
+
+	write_str(PREZERO_PARAM, saved);
+	close(ionfd);
+	return ret ? 1 : 0;
+}
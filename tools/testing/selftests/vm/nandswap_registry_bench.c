@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stress the nandswap task registry: workers fork short-lived app-uid
+ * children, move them between background and foreground through
+ * /proc/nandswap/swap_ctl and let them exit, so registry insert, lookup
+ * and removal race with each other.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../kselftest.h"
+
+#define SWAP_CTL	"/proc/nandswap/swap_ctl"
+#define FN_ENABLE	"/proc/nandswap/fn_enable"
+
+#define NS_TYPE_FG		0
+#define NS_TYPE_NAND_ACT	1
+
+struct bench_stat {
+	unsigned long long fork_ns;
+	unsigned long long adj_ns;
+	unsigned long long exit_ns;
+	unsigned long forks;
+	unsigned long adjs;
+	unsigned long errors;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_str(const char *path, const char *buf)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	ret = write(fd, buf, strlen(buf));
+	ret = ret < 0 ? -errno : 0;
+	close(fd);
+	return ret;
+}
+
+static int read_str(const char *path, char *buf, size_t len)
+{
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	ret = read(fd, buf, len - 1);
+	close(fd);
+	if (ret < 0)
+		return -errno;
+	buf[ret] = '\0';
+	return 0;
+}
+
+static int set_state(pid_t pid, int adj, int type)
+{
+	char path[64], buf[32];
+
+	snprintf(path, sizeof(path), "/proc/%d/oom_score_adj", pid);
+	snprintf(buf, sizeof(buf), "%d", adj);
+	if (write_str(path, buf))
+		return -1;
+
+	snprintf(buf, sizeof(buf), "%d %d", pid, type);
+	return write_str(SWAP_CTL, buf) ? -1 : 0;
+}
+
+static void worker(struct bench_stat *st, int iters, int cycles, uid_t uid)
+{
+	unsigned long long t0;
+	int ready[2], go[2];
+	pid_t pid;
+	char c;
+	int i, j;
+
+	for (i = 0; i < iters; i++) {
+		if (pipe(ready) || pipe(go)) {
+			st->errors++;
+			return;
+		}
+
+		t0 = now_ns();
+		pid = fork();
+		if (pid < 0) {
+			st->errors++;
+			return;
+		}
+		if (!pid) {
+			close(ready[0]);
+			close(go[1]);
+			/* swap_ctl ignores tasks outside the app uid range */
+			if (uid && setuid(uid))
+				_exit(1);
+			c = 0;
+			if (write(ready[1], &c, 1) != 1)
+				_exit(1);
+			if (read(go[0], &c, 1) < 0)
+				_exit(1);
+			_exit(0);
+		}
+		close(ready[1]);
+		close(go[0]);
+		if (read(ready[0], &c, 1) != 1)
+			st->errors++;
+		st->fork_ns += now_ns() - t0;
+		st->forks++;
+
+		for (j = 0; j < cycles; j++) {
+			t0 = now_ns();
+			if (set_state(pid, 900, NS_TYPE_NAND_ACT) ||
+			    set_state(pid, 0, NS_TYPE_FG))
+				st->errors++;
+			st->adj_ns += now_ns() - t0;
+			st->adjs += 2;
+		}
+
+		t0 = now_ns();
+		close(go[1]);
+		waitpid(pid, NULL, 0);
+		st->exit_ns += now_ns() - t0;
+		close(ready[0]);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-w workers] [-n forks per worker] "
+		"[-c adj cycles per child] [-u app uid] [-e]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int workers = 4, iters = 1000, cycles = 4, enable = 0;
+	uid_t uid = 10099;
+	struct bench_stat *stats, sum = {};
+	unsigned long long start, elapsed;
+	char saved[8] = "";
+	int i, opt, status;
+
+	while ((opt = getopt(argc, argv, "w:n:c:u:eh")) != -1) {
+		switch (opt) {
+		case 'w':
+			workers = atoi(optarg);
+			break;
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 'c':
+			cycles = atoi(optarg);
+			break;
+		case 'u':
+			uid = atoi(optarg);
+			break;
+		case 'e':
+			enable = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (access(SWAP_CTL, W_OK)) {
+		printf("%s not available, skipping\n", SWAP_CTL);
+		return KSFT_SKIP;
+	}
+	if (getuid() && uid) {
+		printf("need root to run children as uid %u, skipping\n", uid);
+		return KSFT_SKIP;
+	}
+
+	if (enable) {
+		read_str(FN_ENABLE, saved, sizeof(saved));
+		write_str(FN_ENABLE, "1");
+	}
+
+	stats = mmap(NULL, sizeof(*stats) * workers, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(stats, 0, sizeof(*stats) * workers);
+
+	start = now_ns();
+	for (i = 0; i < workers; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			workers = i;
+			break;
+		}
+		if (!pid) {
+			worker(&stats[i], iters, cycles, uid);
+			_exit(0);
+		}
+	}
+	while (wait(&status) > 0)
+		;
+	elapsed = now_ns() - start;
+
+	if (enable && saved[0])
+		write_str(FN_ENABLE, saved);
+
+	for (i = 0; i < workers; i++) {
+		sum.fork_ns += stats[i].fork_ns;
+		sum.adj_ns += stats[i].adj_ns;
+		sum.exit_ns += stats[i].exit_ns;
+		sum.forks += stats[i].forks;
+		sum.adjs += stats[i].adjs;
+		sum.errors += stats[i].errors;
+	}
+
+	printf("workers %d forks %lu adj updates %lu errors %lu time %llu ms\n",
+	       workers, sum.forks, sum.adjs, sum.errors, elapsed / 1000000);
+	if (sum.forks)
+		printf("fork+ready %llu ns, exit+reap %llu ns per child\n",
+		       sum.fork_ns / sum.forks, sum.exit_ns / sum.forks);
+	if (sum.adjs)
+		printf("adj update %llu ns, %llu updates/s\n",
+		       sum.adj_ns / sum.adjs,
+		       sum.adjs * 1000000000ULL / (elapsed ? elapsed : 1));
+
+	return sum.errors ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Swap-out throughput to zram against the number of CPUs reclaiming at
+ * once. Each worker is pinned to its own CPU, dirties a private buffer
+ * with partly compressible data and pushes it out with MADV_PAGEOUT, so
+ * the workers race in zs_malloc() on the same size classes.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../kselftest.h"
+
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT	21
+#endif
+
+struct result {
+	unsigned long long ns;
+	unsigned long pages;
+	int error;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int zram_swap_active(void)
+{
+	char line[256];
+	FILE *f;
+	int found = 0;
+
+	f = fopen("/proc/swaps", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, "/dev/zram", 9) ||
+		    !strncmp(line, "/dev/block/zram", 15))
+			found = 1;
+	fclose(f);
+	return found;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char key[64];
+	unsigned long val, ret = 0;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &val) == 2)
+		if (!strcmp(key, name))
+			ret = val;
+	fclose(f);
+	return ret;
+}
+
+/* a quarter random, the rest a repeating pattern: roughly 3:1 in lzo */
+static void fill(char *buf, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((i & 4095) < 1024) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = seed >> 16;
+		} else {
+			buf[i] = i & 0x3f;
+		}
+	}
+}
+
+static void worker(int cpu, size_t len, int rounds, int go_fd,
+		   struct result *res)
+{
+	unsigned long long t0;
+	cpu_set_t set;
+	char *buf;
+	char c;
+	int r;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		res->error = errno;
+		return;
+	}
+
+	if (read(go_fd, &c, 1) < 0)
+		res->error = errno;
+
+	for (r = 0; r < rounds && !res->error; r++) {
+		fill(buf, len, cpu * 7919 + r);
+		t0 = now_ns();
+		if (madvise(buf, len, MADV_PAGEOUT))
+			res->error = errno;
+		res->ns += now_ns() - t0;
+		res->pages += len / getpagesize();
+	}
+
+	munmap(buf, len);
+}
+
+static int run(int nr_cpus, size_t len, int rounds, struct result *res)
+{
+	unsigned long long start, elapsed;
+	unsigned long pswpout, pages = 0;
+	int go[2], i, err = 0;
+
+	memset(res, 0, sizeof(*res) * nr_cpus);
+	if (pipe(go))
+		return -1;
+
+	for (i = 0; i < nr_cpus; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			return -1;
+		if (!pid) {
+			close(go[1]);
+			worker(i, len, rounds, go[0], &res[i]);
+			_exit(0);
+		}
+	}
+	close(go[0]);
+
+	/* let every worker map its buffer before the clock starts */
+	usleep(100000);
+	pswpout = vmstat("pswpout");
+	start = now_ns();
+	close(go[1]);
+	while (wait(NULL) > 0)
+		;
+	elapsed = now_ns() - start;
+	pswpout = vmstat("pswpout") - pswpout;
+
+	for (i = 0; i < nr_cpus; i++) {
+		pages += res[i].pages;
+		if (res[i].error)
+			err = res[i].error;
+	}
+
+	if (err) {
+		printf("%4d cpus: madvise failed: %s\n", nr_cpus, strerror(err));
+		return -1;
+	}
+
+	printf("%4d cpus: %8lu pages in %6llu ms, %8.1f MB/s, swapped out %lu\n",
+	       nr_cpus, pages, elapsed / 1000000,
+	       elapsed ? (double)pswpout * getpagesize() * 1000 / elapsed : 0,
+	       pswpout);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-m MB per worker] [-r rounds] [-c max cpus]\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	int online = sysconf(_SC_NPROCESSORS_ONLN);
+	int max_cpus = online, rounds = 4, mb = 64;
+	struct result *res;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "m:r:c:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			mb = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'c':
+			max_cpus = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (max_cpus < 1 || max_cpus > online)
+		max_cpus = online;
+
+	if (!zram_swap_active()) {
+		printf("no zram swap device active, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	res = mmap(NULL, sizeof(*res) * max_cpus, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	printf("%d MB per worker, %d rounds\n", mb, rounds);
+	for (i = 1; i <= max_cpus; i *= 2) {
+		if (run(i, (size_t)mb << 20, rounds, res))
+			return 1;
+		if (i < max_cpus && i * 2 > max_cpus)
+			i = max_cpus / 2;
+	}
+
+	return 0;
+}